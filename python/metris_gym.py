@@ -0,0 +1,121 @@
+"""Batched metris environments for training agents, over the C API in src/gym.h.
+
+    env = MetrisGym(count=256)
+    observations = env.reset(seed=1)
+    while training:
+        observations, rewards, dones = env.step(policy(observations))
+
+Observations, rewards and dones are numpy arrays allocated once and
+overwritten by every reset and step, so copy anything that has to outlive
+the next call. Each row of `observations` is the cells plane, the falling
+piece plane (both height x width, row-major) and then piece x, piece y and
+drop distance; `planes()` reshapes them for a convolutional network.
+
+The library is looked up in $METRIS_GYM_LIBRARY, then next to this file,
+then in ../_build and ../build.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+ACTION_NONE = 0
+ACTION_MOVE_LEFT = 1
+ACTION_MOVE_RIGHT = 2
+ACTION_ROTATE = 3
+ACTION_SOFT_DROP = 4
+ACTION_HARD_DROP = 5
+ACTION_COUNT = 6
+
+INFO_SIZE = 3
+
+
+def _load_library():
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [os.environ.get("METRIS_GYM_LIBRARY")]
+    for directory in (here, os.path.join(here, "..", "_build"), os.path.join(here, "..", "build")):
+        candidates.append(os.path.join(directory, "libmetris_gym.so"))
+
+    for path in candidates:
+        if path and os.path.exists(path):
+            library = ctypes.CDLL(path)
+            break
+    else:
+        raise OSError("libmetris_gym.so not found; build the metris_gym target or set METRIS_GYM_LIBRARY")
+
+    float_pointer = ctypes.POINTER(ctypes.c_float)
+    byte_pointer = ctypes.POINTER(ctypes.c_uint8)
+
+    library.metris_gym_create.restype = ctypes.c_void_p
+    library.metris_gym_create.argtypes = [ctypes.c_uint32, ctypes.c_int32, ctypes.c_int32, ctypes.c_uint32]
+    library.metris_gym_destroy.restype = None
+    library.metris_gym_destroy.argtypes = [ctypes.c_void_p]
+    library.metris_gym_observation_size.restype = ctypes.c_uint32
+    library.metris_gym_observation_size.argtypes = [ctypes.c_void_p]
+    library.metris_gym_reset.restype = None
+    library.metris_gym_reset.argtypes = [ctypes.c_void_p, ctypes.c_uint64, float_pointer]
+    library.metris_gym_step.restype = None
+    library.metris_gym_step.argtypes = [ctypes.c_void_p, byte_pointer, float_pointer, float_pointer, byte_pointer]
+    return library
+
+
+_library = None
+
+
+class MetrisGym:
+    def __init__(self, count, width=10, height=20, threads=0):
+        global _library
+        if _library is None:
+            _library = _load_library()
+
+        self._handle = _library.metris_gym_create(count, width, height, threads)
+        if not self._handle:
+            raise ValueError(f"cannot make {count} games of {width} x {height}")
+
+        self.count = count
+        self.width = width
+        self.height = height
+        self.observation_size = _library.metris_gym_observation_size(self._handle)
+
+        self.observations = np.zeros((count, self.observation_size), dtype=np.float32)
+        self.rewards = np.zeros(count, dtype=np.float32)
+        self.dones = np.zeros(count, dtype=np.uint8)
+        self._actions = np.zeros(count, dtype=np.uint8)
+
+        self._observations_pointer = self.observations.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        self._rewards_pointer = self.rewards.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        self._dones_pointer = self.dones.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8))
+        self._actions_pointer = self._actions.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8))
+
+    def reset(self, seed=0):
+        _library.metris_gym_reset(self._handle, seed, self._observations_pointer)
+        return self.observations
+
+    def step(self, actions):
+        # Copied into a buffer of our own so any integer array will do.
+        self._actions[:] = actions
+        _library.metris_gym_step(self._handle, self._actions_pointer, self._observations_pointer,
+                                 self._rewards_pointer, self._dones_pointer)
+        return self.observations, self.rewards, self.dones
+
+    def planes(self, observations=None):
+        """The cells and piece planes as (count, 2, height, width), without copying."""
+        if observations is None:
+            observations = self.observations
+        cells = self.width * self.height * 2
+        return observations[:, :cells].reshape(-1, 2, self.height, self.width)
+
+    def close(self):
+        if self._handle:
+            _library.metris_gym_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        self.close()
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstring>
+
+#include "archive.h"
+
+static StringView entry_name(const Archive& archive, const ArchiveEntry& entry) {
+  return archive.file.contents.substr((usize) entry.name_offset, (usize) entry.name_size);
+}
+
+static bool is_range_valid(usize size, u64 offset, u64 length) {
+  return offset <= size && length <= size - offset;
+}
+
+Result<Archive, ArchiveError> open_archive(const Path& path) {
+  ArchiveError error;
+  error.path = path;
+
+  auto file = map_file(path);
+  if (file.isErr()) {
+    error.error_kind = file.unwrapErr().error_kind == ReadFileError::Kind::file_not_found ? ArchiveError::Kind::file_not_found
+                                                                                          : ArchiveError::Kind::file_not_readable;
+    return Err(error);
+  }
+
+  Archive archive;
+  archive.path = path;
+  archive.file = std::move(file).unwrap();
+
+  auto size = archive.file.contents.size();
+  if (size < sizeof(ArchiveHeader)) {
+    close_archive(&archive);
+    error.error_kind = ArchiveError::Kind::invalid_archive;
+    return Err(error);
+  }
+
+  auto memory = (const u8*) archive.file.contents.data();
+  auto header = (const ArchiveHeader*) memory;
+  auto directory_size = (u64) header->entry_count * sizeof(ArchiveEntry);
+  if (header->magic != archive_magic || header->version != archive_version ||
+      !is_range_valid(size, sizeof(ArchiveHeader), directory_size)) {
+    close_archive(&archive);
+    error.error_kind = ArchiveError::Kind::invalid_archive;
+    return Err(error);
+  }
+
+  archive.entries = (const ArchiveEntry*) (memory + sizeof(ArchiveHeader));
+  archive.entry_count = header->entry_count;
+
+  // Validate once here so lookups can trust every offset.
+  for (u32 i = 0; i < archive.entry_count; ++i) {
+    auto& entry = archive.entries[i];
+    if (!is_range_valid(size, entry.name_offset, entry.name_size) ||
+        !is_range_valid(size, entry.data_offset, entry.data_size)) {
+      close_archive(&archive);
+      error.error_kind = ArchiveError::Kind::invalid_archive;
+      return Err(error);
+    }
+  }
+
+  return Ok(archive);
+}
+
+void close_archive(Archive* archive) {
+  unmap_file(&archive->file);
+  *archive = {};
+}
+
+bool archive_find(const Archive& archive, StringView name, StringView* contents) {
+  auto begin = archive.entries;
+  auto end = archive.entries + archive.entry_count;
+
+  auto entry = std::lower_bound(begin, end, name, [&](const ArchiveEntry& entry, StringView name) {
+    return entry_name(archive, entry) < name;
+  });
+  if (entry == end || entry_name(archive, *entry) != name) return false;
+
+  *contents = archive.file.contents.substr((usize) entry->data_offset, (usize) entry->data_size);
+  return true;
+}
+
+void pack_archive(Vec<ArchiveInput>& inputs, String* out) {
+  std::sort(inputs.begin(), inputs.end(), [](const ArchiveInput& a, const ArchiveInput& b) { return a.name < b.name; });
+
+  ArchiveHeader header;
+  header.entry_count = (u32) inputs.size();
+
+  Vec<ArchiveEntry> entries(inputs.size());
+
+  u64 offset = sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry);
+  for (usize i = 0; i < inputs.size(); ++i) {
+    entries[i].name_offset = offset;
+    entries[i].name_size = inputs[i].name.size();
+    offset += inputs[i].name.size();
+  }
+
+  for (usize i = 0; i < inputs.size(); ++i) {
+    offset = (offset + archive_alignment - 1) & ~(archive_alignment - 1);
+    entries[i].data_offset = offset;
+    entries[i].data_size = inputs[i].contents.size();
+    offset += inputs[i].contents.size();
+  }
+
+  out->clear();
+  out->resize((usize) offset, '\0');
+
+  auto memory = out->data();
+  std::memcpy(memory, &header, sizeof(header));
+  std::memcpy(memory + sizeof(header), entries.data(), entries.size() * sizeof(ArchiveEntry));
+  for (usize i = 0; i < inputs.size(); ++i) {
+    std::memcpy(memory + entries[i].name_offset, inputs[i].name.data(), inputs[i].name.size());
+    std::memcpy(memory + entries[i].data_offset, inputs[i].contents.data(), inputs[i].contents.size());
+  }
+}
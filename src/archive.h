@@ -0,0 +1,71 @@
+#pragma once
+
+#include "core.h"
+
+// Asset archive
+//
+// Every asset packed into one file that is memory-mapped and read in place,
+// so loading an asset is a lookup rather than a filesystem round trip:
+//
+//   ArchiveHeader
+//   ArchiveEntry[entry_count]    sorted by name
+//   names                        not null terminated
+//   data                         each entry aligned to archive_alignment
+//
+// Fields are stored in host byte order; the archive is built alongside the
+// binary that reads it.
+
+constexpr u32 archive_magic = 0x4B41504D; // "MPAK"
+constexpr u32 archive_version = 1;
+constexpr u64 archive_alignment = 16;
+
+struct ArchiveHeader {
+  u32 magic = archive_magic;
+  u32 version = archive_version;
+  u32 entry_count = 0;
+  u32 reserved = 0;
+};
+
+struct ArchiveEntry {
+  u64 name_offset = 0;
+  u64 name_size = 0;
+  u64 data_offset = 0;
+  u64 data_size = 0;
+};
+
+static_assert(sizeof(ArchiveHeader) == 16);
+static_assert(sizeof(ArchiveEntry) == 32);
+
+struct Archive {
+  Path       path = {};
+  MappedFile file = {};
+
+  const ArchiveEntry* entries = nullptr;
+  u32                 entry_count = 0;
+};
+
+struct ArchiveError {
+  enum class Kind {
+    none,
+    file_not_found,
+    file_not_readable,
+    invalid_archive,
+  };
+
+  ArchiveError::Kind error_kind = ArchiveError::Kind::none;
+  Path               path       = {};
+};
+
+Result<Archive, ArchiveError> open_archive(const Path& path);
+void close_archive(Archive* archive);
+
+// The view points into the mapping and stays valid until the archive is closed.
+bool archive_find(const Archive& archive, StringView name, StringView* contents);
+
+
+struct ArchiveInput {
+  String name = "";
+  String contents = "";
+};
+
+void pack_archive(Vec<ArchiveInput>& inputs, String* out);
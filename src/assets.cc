@@ -0,0 +1,160 @@
+#include <SDL2/SDL.h>
+#include <SDL_ttf.h>
+
+#include "assets.h"
+
+static f64 milliseconds_between(u64 from, u64 to) {
+    return (f64)(to - from) * 1000.0 / (f64)SDL_GetPerformanceFrequency();
+}
+
+static void loader_thread(AssetManager *manager) {
+    while (true) {
+        Asset *asset = nullptr;
+        {
+            std::unique_lock lock(manager->mutex);
+            manager->wake.wait(lock, [&] { return manager->is_stopping || !manager->queue.empty(); });
+            if (manager->is_stopping) return;
+
+            asset = manager->queue.front();
+            manager->queue.erase(manager->queue.begin());
+        }
+
+        auto file = read_file(asset->path);
+        asset->read_at = SDL_GetPerformanceCounter();
+
+        if (file.isErr()) {
+            asset->state.store(AssetState::failed, std::memory_order_release);
+            continue;
+        }
+
+        asset->contents = std::move(file).unwrap().contents;
+        asset->bytes = asset->contents;
+        asset->state.store(AssetState::read, std::memory_order_release);
+    }
+}
+
+void assets_start(AssetManager &manager, const Path &archive_path, const Path &directory) {
+    manager.directory = directory;
+
+    auto archive = open_archive(archive_path);
+    if (archive.isOk()) {
+        manager.archive = std::move(archive).unwrap();
+        log_info("Mapped asset archive {} ({} assets)", archive_path.string(), manager.archive.entry_count);
+    } else {
+        log_warning("No asset archive at {}, loading loose files from {}", archive_path.string(), directory.string());
+    }
+
+    manager.is_stopping = false;
+    manager.worker = std::thread(loader_thread, &manager);
+}
+
+void assets_stop(AssetManager &manager) {
+    {
+        std::lock_guard lock(manager.mutex);
+        manager.is_stopping = true;
+    }
+    manager.wake.notify_one();
+
+    if (manager.worker.joinable()) {
+        manager.worker.join();
+    }
+
+    for (auto &asset : manager.assets) {
+        if (asset->font) {
+            TTF_CloseFont(asset->font);
+            asset->font = nullptr;
+        }
+    }
+
+    // Fonts read from the mapping, so it has to outlive them.
+    close_archive(&manager.archive);
+}
+
+FontHandle assets_load_font(AssetManager &manager, StringView name, i32 point_size) {
+    FontHandle handle;
+
+    auto key = fmt::format("{}@{}", name, point_size);
+    if (auto index = manager.fonts.find(key)) {
+        handle.index = *index;
+        return handle;
+    }
+
+    handle.index = (u32)manager.assets.size();
+    manager.fonts.insert(std::move(key), handle.index);
+
+    auto asset = std::make_unique<Asset>();
+    asset->kind = AssetKind::font;
+    asset->point_size = point_size;
+    asset->requested_at = SDL_GetPerformanceCounter();
+
+    if (archive_find(manager.archive, name, &asset->bytes)) {
+        asset->path = manager.archive.path / name;
+        asset->read_at = asset->requested_at;
+        asset->state.store(AssetState::read, std::memory_order_release);
+        manager.assets.push_back(std::move(asset));
+        return handle;
+    }
+
+    asset->path = manager.directory / name;
+    {
+        std::lock_guard lock(manager.mutex);
+        manager.queue.push_back(asset.get());
+    }
+    manager.assets.push_back(std::move(asset));
+    manager.wake.notify_one();
+
+    return handle;
+}
+
+void assets_update(AssetManager &manager) {
+    for (auto &asset : manager.assets) {
+        auto state = asset->state.load(std::memory_order_acquire);
+
+        if (state == AssetState::failed && asset->ready_at == 0) {
+            asset->ready_at = SDL_GetPerformanceCounter();
+            log_error("Could not read asset {}", asset->path.string());
+            continue;
+        }
+
+        if (state != AssetState::read) continue;
+
+        switch (asset->kind) {
+        case AssetKind::font: {
+            // The font reads glyphs straight from `bytes` for as long as it is open.
+            auto stream = SDL_RWFromConstMem(asset->bytes.data(), (int)asset->bytes.size());
+            asset->font = TTF_OpenFontRW(stream, 1, asset->point_size);
+        } break;
+        }
+
+        asset->ready_at = SDL_GetPerformanceCounter();
+
+        if (!asset->font) {
+            asset->state.store(AssetState::failed, std::memory_order_relaxed);
+            log_error("Could not decode asset {}: {}", asset->path.string(), TTF_GetError());
+            continue;
+        }
+
+        asset->state.store(AssetState::ready, std::memory_order_relaxed);
+        log_info("Loaded {} in {:.2f} ms (read {:.2f} ms)", asset->path.string(),
+                 milliseconds_between(asset->requested_at, asset->ready_at),
+                 milliseconds_between(asset->requested_at, asset->read_at));
+    }
+}
+
+bool assets_are_loading(const AssetManager &manager) {
+    for (auto &asset : manager.assets) {
+        auto state = asset->state.load(std::memory_order_acquire);
+        if (state == AssetState::queued || state == AssetState::read) return true;
+    }
+
+    return false;
+}
+
+TTF_Font *assets_font(const AssetManager &manager, FontHandle handle) {
+    if (handle.index >= manager.assets.size()) return nullptr;
+
+    auto &asset = manager.assets[handle.index];
+    if (asset->state.load(std::memory_order_acquire) != AssetState::ready) return nullptr;
+
+    return asset->font;
+}
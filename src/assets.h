@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "archive.h"
+#include "core.h"
+#include "hash_table.h"
+
+struct _TTF_Font;
+typedef struct _TTF_Font TTF_Font;
+
+// Assets
+//
+// Assets are looked up by name in the memory-mapped archive first, where
+// their bytes are already in memory. Anything missing from it is read as a
+// loose file on a background thread. Anything that has to touch SDL is
+// finished on the main thread in assets_update. Handles are valid right away
+// and resolve to nullptr until their asset is ready, so the game can start
+// drawing before every asset has arrived.
+
+enum class AssetKind : u8 {
+    font,
+};
+
+enum class AssetState : u8 {
+    queued,
+    read,   // Bytes are in memory, waiting for assets_update to decode them.
+    ready,
+    failed,
+};
+
+struct Asset {
+    AssetKind kind = AssetKind::font;
+    Path path = {};
+    i32 point_size = 0;
+
+    std::atomic<AssetState> state = AssetState::queued;
+
+    // Points into the archive mapping, or into `contents` for loose files.
+    // Decoded assets may keep pointing into it.
+    StringView bytes = {};
+    String contents = {};
+
+    TTF_Font *font = nullptr;
+
+    u64 requested_at = 0;
+    u64 read_at = 0;
+    u64 ready_at = 0;
+};
+
+struct FontHandle {
+    u32 index = 0;
+};
+
+struct AssetManager {
+    Vec<OwnPtr<Asset>> assets = {};
+
+    // "name@point_size" to an index into `assets`, so asking for the same
+    // font twice shares one decoded copy.
+    HashTable<String, u32> fonts = {};
+
+    Archive archive = {};
+    Path directory = {};
+
+    std::thread worker = {};
+    std::mutex mutex = {};
+    std::condition_variable wake = {};
+    Vec<Asset *> queue = {};
+    bool is_stopping = false;
+};
+
+// Loose files are looked up under `directory` when the archive is missing
+// or doesn't contain them.
+void assets_start(AssetManager &manager, const Path &archive_path, const Path &directory);
+void assets_stop(AssetManager &manager);
+
+// `name` is relative to the asset directory, e.g. "fonts/font.ttf".
+FontHandle assets_load_font(AssetManager &manager, StringView name, i32 point_size);
+
+// Main thread only. Decodes everything the loader has finished reading.
+void assets_update(AssetManager &manager);
+bool assets_are_loading(const AssetManager &manager);
+
+TTF_Font *assets_font(const AssetManager &manager, FontHandle handle);
@@ -0,0 +1,46 @@
+#include <SDL2/SDL.h>
+
+#include "audio.h"
+
+static void audio_callback(void* userdata, Uint8* stream, int length) {
+  auto mixer = (Mixer*) userdata;
+  mixer_render(mixer, (f32*) stream, (usize) length / (sizeof(f32) * mixer_channels));
+}
+
+Result<AudioDevice, AudioError> audio_open(Mixer* mixer) {
+  AudioError error;
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    error.message = SDL_GetError();
+    return Err(error);
+  }
+
+  SDL_AudioSpec wanted = {};
+  wanted.freq = (int) mixer_sample_rate;
+  wanted.format = AUDIO_F32SYS;
+  wanted.channels = (Uint8) mixer_channels;
+  wanted.samples = audio_buffer_frames;
+  wanted.callback = audio_callback;
+  wanted.userdata = mixer;
+
+  // No changes allowed: SDL converts to whatever the hardware wants, so the
+  // mixer only ever renders one format.
+  SDL_AudioSpec obtained = {};
+  AudioDevice device;
+  device.id = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+  if (device.id == 0) {
+    error.message = SDL_GetError();
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    return Err(error);
+  }
+
+  SDL_PauseAudioDevice(device.id, 0);
+  return Ok(device);
+}
+
+void audio_close(AudioDevice* device) {
+  if (device->id == 0) return;
+
+  SDL_CloseAudioDevice(device->id);
+  SDL_QuitSubSystem(SDL_INIT_AUDIO);
+  device->id = 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "core.h"
+#include "mixer.h"
+
+// Audio output
+//
+// Opens the default device in the mixer's format and mixes straight into the
+// buffers SDL asks for, on SDL's audio thread. The audio subsystem is brought
+// up here rather than in SDL_Init, so the game still starts without a device.
+
+constexpr u16 audio_buffer_frames = 512; // About 11 ms at 48 kHz.
+
+struct AudioDevice {
+  u32 id = 0; // SDL_AudioDeviceID, 0 when closed.
+};
+
+struct AudioError {
+  String message = {}; // From SDL_GetError.
+};
+
+// The mixer has to outlive the device, and its sounds can't change once it's open.
+Result<AudioDevice, AudioError> audio_open(Mixer* mixer);
+void audio_close(AudioDevice* device);
@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include "board.h"
+
+static usize board_index(const Board &board, Coordinate coordinate) {
+    return (usize)coordinate.y * (usize)board.width + (usize)coordinate.x;
+}
+
+static i32 column_top(const Board &board, i32 x) {
+    return board.height - board.column_heights[(usize)x];
+}
+
+static u16 &row_mask(Board &board, i32 y) {
+    return board.row_masks[(usize)(y + board_mask_margin)];
+}
+
+static u16 column_bit(i32 x) {
+    return (u16)(1u << (x + board_mask_wall));
+}
+
+static void reset_row_masks(Board &board) {
+    auto walls = (u16)~(((1u << board.width) - 1) << board_mask_wall);
+    std::fill(std::begin(board.row_masks), std::end(board.row_masks), (u16)0xFFFF);
+    for (auto y = 0; y < board.height; ++y) row_mask(board, y) = walls;
+}
+
+Board make_board(i32 width, i32 height) {
+    // The cells are a fixed array, so a size past the limit is clamped to it
+    // here, where every game and match gets its board, rather than trusted.
+    Board board;
+    board.width = std::clamp(width, 1, board_max_width);
+    board.height = std::clamp(height, 1, board_max_height);
+    if (board.width != width || board.height != height) {
+        log_warning("A {} x {} board is outside 1 x 1 to {} x {}, making it {} x {}", width, height,
+                    board_max_width, board_max_height, board.width, board.height);
+    }
+
+    reset_row_masks(board);
+    return board;
+}
+
+bool board_is_in_bounds(const Board &board, Coordinate coordinate) {
+    return coordinate.x >= 0 && coordinate.x < board.width && coordinate.y >= 0 &&
+           coordinate.y < board.height;
+}
+
+bool board_is_occupied(const Board &board, Coordinate coordinate) {
+    return board.cells[board_index(board, coordinate)] != 0;
+}
+
+bool board_is_row_full(const Board &board, i32 y) {
+    auto row = board.cells + board_index(board, make_vector2(0, y));
+    return std::all_of(row, row + board.width, [](u8 cell) { return cell != 0; });
+}
+
+void board_add(Board &board, Coordinate coordinate) {
+    log_assert(board_is_in_bounds(board, coordinate), "Adding a cell outside the board at ({}, {})", coordinate.x, coordinate.y);
+
+    board.cells[board_index(board, coordinate)] += 1;
+    row_mask(board, coordinate.y) |= column_bit(coordinate.x);
+
+    auto &height = board.column_heights[(usize)coordinate.x];
+    height = std::max(height, board.height - coordinate.y);
+}
+
+void board_remove(Board &board, Coordinate coordinate) {
+    log_assert(board_is_in_bounds(board, coordinate), "Removing a cell outside the board at ({}, {})", coordinate.x, coordinate.y);
+
+    auto &cell = board.cells[board_index(board, coordinate)];
+    log_assert(cell != 0, "Removing an empty cell at ({}, {})", coordinate.x, coordinate.y);
+    cell -= 1;
+    if (cell == 0) row_mask(board, coordinate.y) &= (u16)~column_bit(coordinate.x);
+
+    // Only removing the top-most cell of a column can lower its height.
+    if (cell != 0 || coordinate.y != column_top(board, coordinate.x)) return;
+
+    auto y = coordinate.y;
+    while (y < board.height && !board_is_occupied(board, make_vector2(coordinate.x, y))) {
+        y += 1;
+    }
+    board.column_heights[(usize)coordinate.x] = board.height - y;
+}
+
+void board_clear(Board &board) {
+    std::fill(std::begin(board.cells), std::end(board.cells), 0);
+    std::fill(std::begin(board.column_heights), std::end(board.column_heights), 0);
+    reset_row_masks(board);
+}
+
+bool board_fits(const Board &board, Coordinate origin, const TetrominoPieces &pieces) {
+    for (auto &piece : pieces) {
+        auto coordinate = origin + piece;
+        if (!board_is_in_bounds(board, coordinate) || board_is_occupied(board, coordinate)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+u64 board_piece_mask(const TetrominoPieces &pieces) {
+    u64 mask = 0;
+    for (auto &piece : pieces) {
+        log_assert(piece.x >= 0 && piece.x < 4 && piece.y >= 0 && piece.y < 4, "Piece at ({}, {}) is outside its 4 x 4 box", piece.x, piece.y);
+        mask |= 1ull << (piece.y * 16 + piece.x);
+    }
+    return mask;
+}
+
+bool board_fits_mask(const Board &board, Coordinate box, u64 mask) {
+    // Past these the margins run out, and past the right edge the whole box is
+    // off the board anyway.
+    if (box.x < -board_mask_wall || box.x >= board.width || box.y < -board_mask_margin || box.y + 4 > board.height + board_mask_margin) {
+        return false;
+    }
+
+    auto rows = board.row_masks + box.y + board_mask_margin;
+    auto lanes = (u64)rows[0] | (u64)rows[1] << 16 | (u64)rows[2] << 32 | (u64)rows[3] << 48;
+    return (lanes & mask << (box.x + board_mask_wall)) == 0;
+}
+
+i32 board_drop_distance(const Board &board, Coordinate origin, const TetrominoPieces &pieces) {
+    auto distance = board.height;
+    auto is_under_overhang = false;
+
+    for (auto &piece : pieces) {
+        auto coordinate = origin + piece;
+        auto top = column_top(board, coordinate.x);
+
+        if (coordinate.y >= top) {
+            is_under_overhang = true;
+            break;
+        }
+
+        distance = std::min(distance, top - 1 - coordinate.y);
+    }
+
+    if (!is_under_overhang) {
+        return distance;
+    }
+
+    distance = 0;
+    while (board_fits(board, make_vector2(origin.x, origin.y + distance + 1), pieces)) {
+        distance += 1;
+    }
+    return distance;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "core.h"
+
+using Coordinate = Vector2<i32>;
+
+// Boards are fixed-size so a whole game is one trivially copyable block, see
+// Game. The limits cover a standard 10 x 20 field with a few rows to spare;
+// make_board clamps anything bigger to them.
+constexpr i32 board_max_width = 10;
+constexpr i32 board_max_height = 24;
+constexpr usize board_max_cells = (usize)board_max_width * (usize)board_max_height;
+
+constexpr usize tetromino_max_pieces = 4;
+using TetrominoPieces = FixedVec<Coordinate, tetromino_max_pieces>;
+
+// Occupancy is also kept as one u16 per row, column x at bit x +
+// board_mask_wall, with the bits either side of the board set as walls and
+// board_mask_margin full rows above and below it. Four rows read as one u64
+// cover a piece's whole 4 x 4 box, so testing whether it fits is one AND.
+constexpr i32 board_mask_wall = 3;
+constexpr i32 board_mask_margin = 4;
+constexpr usize board_mask_rows = (usize)(board_max_height + 2 * board_mask_margin);
+
+static_assert(board_max_width + board_mask_wall <= 16);
+
+// Occupancy grid mirroring the locked in pieces, plus a per-column height
+// cache so landing positions don't need to step the piece down row by row.
+//
+// Cells hold a count rather than a flag: while the drop animation runs, a
+// piece can briefly move onto a cell another piece hasn't left yet.
+struct Board {
+    i32 width = 0;
+    i32 height = 0;
+
+    u8  cells[board_max_cells] = {};          // Row-major, `width` cells per row.
+    i32 column_heights[board_max_width] = {}; // Rows from the floor up to and including the top-most occupied cell.
+    u16 row_masks[board_mask_rows] = {};      // From board_mask_margin rows above the top.
+};
+
+Board make_board(i32 width, i32 height);
+
+bool board_is_in_bounds(const Board &board, Coordinate coordinate);
+bool board_is_occupied(const Board &board, Coordinate coordinate);
+bool board_is_row_full(const Board &board, i32 y);
+
+void board_add(Board &board, Coordinate coordinate);
+void board_remove(Board &board, Coordinate coordinate);
+void board_clear(Board &board);
+
+bool board_fits(const Board &board, Coordinate origin, const TetrominoPieces &pieces);
+
+// Pieces within a 4 x 4 box as four 16-bit lanes, lane y holding bit x for
+// the piece at (x, y).
+u64 board_piece_mask(const TetrominoPieces &pieces);
+
+// Same as board_fits for the pieces of `mask` in the box with its top left
+// at `box`.
+bool board_fits_mask(const Board &board, Coordinate box, u64 mask);
+
+// How many rows the pieces can fall from `origin` before they collide.
+// Uses the column heights when every piece is above its column's stack, and
+// only falls back to stepping down when a piece is tucked under an overhang.
+i32 board_drop_distance(const Board &board, Coordinate origin, const TetrominoPieces &pieces);
@@ -0,0 +1,183 @@
+#include <algorithm>
+
+#include "broadcast.h"
+
+BroadcastState broadcast_capture(const Versus &versus) {
+    BroadcastState state;
+    if (versus.players.empty()) return state;
+
+    auto &first = versus.players[0].game.board;
+    state.width = first.width;
+    state.height = first.height;
+
+    state.players.resize(versus.players.size());
+    for (usize i = 0; i < versus.players.size(); ++i) {
+        auto &game = versus.players[i].game;
+        auto &player = state.players[i];
+
+        for (i32 y = 0; y < game.board.height; ++y) {
+            u16 row = 0;
+            for (i32 x = 0; x < game.board.width; ++x) {
+                if (board_is_occupied(game.board, make_vector2(x, y))) row |= (u16)(1 << x);
+            }
+            player.rows[y] = row;
+        }
+
+        if (game.state == GameState::playing) {
+            for (auto piece : game.tetromino.pieces) player.piece.push_back(game.tetromino.coordinate + piece);
+        }
+
+        player.score = game.score;
+        player.state = game.state;
+    }
+
+    return state;
+}
+
+static void write_u8(String &out, u8 value) {
+    out.push_back((char)value);
+}
+
+static void write_u16(String &out, u16 value) {
+    for (usize i = 0; i < 2; ++i) write_u8(out, (u8)(value >> (i * 8)));
+}
+
+static void write_u32(String &out, u32 value) {
+    for (usize i = 0; i < 4; ++i) write_u8(out, (u8)(value >> (i * 8)));
+}
+
+static void write_u64(String &out, u64 value) {
+    for (usize i = 0; i < 8; ++i) write_u8(out, (u8)(value >> (i * 8)));
+}
+
+static bool same_piece(const BroadcastPlayer &a, const BroadcastPlayer &b) {
+    return a.piece.size() == b.piece.size() && std::equal(a.piece.begin(), a.piece.end(), b.piece.begin());
+}
+
+void broadcast_encode(const BroadcastState *previous, const BroadcastState &current, u32 tick, u64 sent_at, String &out) {
+    auto is_keyframe = !previous || previous->width != current.width || previous->height != current.height ||
+                       previous->players.size() != current.players.size();
+
+    write_u8(out, broadcast_magic);
+    write_u8(out, is_keyframe ? broadcast_keyframe : 0);
+    write_u32(out, tick);
+    write_u64(out, sent_at);
+    write_u8(out, (u8)current.width);
+    write_u8(out, (u8)current.height);
+    write_u8(out, (u8)current.players.size());
+
+    for (usize i = 0; i < current.players.size(); ++i) {
+        auto &player = current.players[i];
+
+        u32 changed_rows = 0;
+        for (i32 y = 0; y < current.height; ++y) {
+            if (is_keyframe || player.rows[y] != previous->players[i].rows[y]) changed_rows |= 1u << y;
+        }
+
+        u8 changes = 0;
+        if (changed_rows != 0) changes |= broadcast_changed_rows;
+        if (is_keyframe || !same_piece(player, previous->players[i])) changes |= broadcast_changed_piece;
+        if (is_keyframe || player.score != previous->players[i].score || player.state != previous->players[i].state) {
+            changes |= broadcast_changed_score;
+        }
+        write_u8(out, changes);
+
+        if (changes & broadcast_changed_rows) {
+            write_u32(out, changed_rows);
+            for (i32 y = 0; y < current.height; ++y) {
+                if (changed_rows & (1u << y)) write_u16(out, player.rows[y]);
+            }
+        }
+
+        if (changes & broadcast_changed_piece) {
+            write_u8(out, (u8)player.piece.size());
+            for (auto cell : player.piece) {
+                write_u8(out, (u8)(i8)cell.x);
+                write_u8(out, (u8)(i8)cell.y);
+            }
+        }
+
+        if (changes & broadcast_changed_score) {
+            write_u32(out, player.score);
+            write_u8(out, (u8)player.state);
+        }
+    }
+}
+
+struct BroadcastReader {
+    const u8 *data = nullptr;
+    usize size = 0;
+    usize offset = 0;
+    bool is_valid = true;
+
+    u64 read(usize bytes) {
+        if (offset + bytes > size) {
+            is_valid = false;
+            return 0;
+        }
+
+        u64 value = 0;
+        for (usize i = 0; i < bytes; ++i) value |= (u64)data[offset + i] << (i * 8);
+        offset += bytes;
+        return value;
+    }
+};
+
+bool broadcast_decode(StringView frame, BroadcastState &state, BroadcastFrameHeader &header) {
+    BroadcastReader reader;
+    reader.data = (const u8 *)frame.data();
+    reader.size = frame.size();
+
+    if (reader.read(1) != broadcast_magic) return false;
+    header.flags = (u8)reader.read(1);
+    header.tick = (u32)reader.read(4);
+    header.sent_at = reader.read(8);
+
+    auto width = (i32)reader.read(1);
+    auto height = (i32)reader.read(1);
+    auto player_count = (usize)reader.read(1);
+    if (!reader.is_valid || width > board_max_width || height > board_max_height || player_count > versus_max_players) return false;
+
+    if (header.flags & broadcast_keyframe) {
+        state = {};
+        state.width = width;
+        state.height = height;
+        state.players.resize(player_count);
+    } else if (state.width != width || state.height != height || state.players.size() != player_count) {
+        return false;
+    }
+
+    for (auto &player : state.players) {
+        auto changes = (u8)reader.read(1);
+
+        if (changes & broadcast_changed_rows) {
+            auto changed_rows = (u32)reader.read(4);
+            if (height < 32 && (changed_rows >> height) != 0) return false;
+
+            for (i32 y = 0; y < height; ++y) {
+                if (changed_rows & (1u << y)) player.rows[y] = (u16)reader.read(2);
+            }
+        }
+
+        if (changes & broadcast_changed_piece) {
+            auto count = (usize)reader.read(1);
+            if (count > player.piece.capacity()) return false;
+
+            player.piece.clear();
+            for (usize i = 0; i < count; ++i) {
+                auto x = (i8)reader.read(1);
+                auto y = (i8)reader.read(1);
+                player.piece.push_back(make_vector2((i32)x, (i32)y));
+            }
+        }
+
+        if (changes & broadcast_changed_score) {
+            player.score = (u32)reader.read(4);
+            auto game_state = (u8)reader.read(1);
+            if (game_state > (u8)GameState::game_over) return false;
+            player.state = (GameState)game_state;
+        }
+    }
+
+    return reader.is_valid && reader.offset == reader.size;
+}
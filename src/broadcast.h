@@ -0,0 +1,69 @@
+#pragma once
+
+#include "core.h"
+#include "versus.h"
+
+// Broadcast
+//
+// What spectators see of a versus match, and the frames that carry it. A
+// frame is either a keyframe, holding everything, or a delta against the
+// frame of the tick before: only the rows whose occupancy changed (as a
+// bitmask of rows, then one bitmask of cells per changed row), the falling
+// piece if it moved, and the score if it changed. A quiet tick is a few
+// bytes per player.
+//
+//   u8  broadcast_magic
+//   u8  flags          broadcast_keyframe
+//   u32 tick
+//   u64 sent_at        us, on the sender's steady clock
+//   u8  width, height, player_count
+//   per player:
+//     u8  changes      broadcast_changed_* bits
+//     rows:  u32 changed_rows, u16 cells[popcount(changed_rows)]
+//     piece: u8 count, i8 x and y per cell
+//     score: u32 score, u8 state
+//
+// Multi-byte fields are little-endian. Colours and animations are left out;
+// a spectator's client draws cells in its own style.
+
+constexpr u8 broadcast_magic = 0x42; // 'B'
+constexpr u8 broadcast_keyframe = 1 << 0;
+
+constexpr u8 broadcast_changed_rows = 1 << 0;
+constexpr u8 broadcast_changed_piece = 1 << 1;
+constexpr u8 broadcast_changed_score = 1 << 2;
+
+constexpr usize broadcast_header_size = 17;
+
+static_assert(board_max_width <= 16 && board_max_height <= 32, "Broadcast rows and row masks are u16 and u32");
+
+struct BroadcastPlayer {
+    u16 rows[board_max_height] = {}; // Bit x is set where the cell is occupied.
+    FixedVec<Coordinate, tetromino_max_pieces> piece = {}; // Cells of the falling piece.
+
+    u32 score = 0;
+    GameState state = GameState::playing;
+};
+
+struct BroadcastState {
+    i32 width = 0;
+    i32 height = 0;
+    FixedVec<BroadcastPlayer, versus_max_players> players = {};
+};
+
+struct BroadcastFrameHeader {
+    u8 flags = 0;
+    u32 tick = 0;
+    u64 sent_at = 0;
+};
+
+BroadcastState broadcast_capture(const Versus &versus);
+
+// Appends the frame taking `previous` to `current`, or a keyframe when
+// `previous` is null or a different shape.
+void broadcast_encode(const BroadcastState *previous, const BroadcastState &current, u32 tick, u64 sent_at, String &out);
+
+// Applies a frame to `state`. A delta needs `state` to hold the frame
+// before it. Returns false, leaving `state` unspecified, if the frame is
+// malformed or doesn't fit `state`.
+bool broadcast_decode(StringView frame, BroadcastState &state, BroadcastFrameHeader &header);
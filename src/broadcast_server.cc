@@ -0,0 +1,417 @@
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+
+#include "broadcast_server.h"
+
+constexpr usize broadcast_max_events = 256;
+constexpr usize broadcast_max_iovecs = 64;
+
+// Source: RFC 3174. Only used on WebSocket keys, so it favours being short.
+static void sha1(StringView input, u8 digest[20]) {
+  u32 h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+  String message(input);
+  message.push_back((char) 0x80);
+  while (message.size() % 64 != 56) message.push_back(0);
+  auto bits = (u64) input.size() * 8;
+  for (i32 i = 7; i >= 0; --i) message.push_back((char) (u8) (bits >> (i * 8)));
+
+  auto rotate = [](u32 value, u32 count) { return (value << count) | (value >> (32 - count)); };
+
+  for (usize chunk = 0; chunk < message.size(); chunk += 64) {
+    u32 w[80];
+    for (usize i = 0; i < 16; ++i) {
+      auto p = (const u8*) message.data() + chunk + i * 4;
+      w[i] = (u32) p[0] << 24 | (u32) p[1] << 16 | (u32) p[2] << 8 | (u32) p[3];
+    }
+    for (usize i = 16; i < 80; ++i) w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    auto a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (usize i = 0; i < 80; ++i) {
+      u32 f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+
+      auto t = rotate(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotate(b, 30);
+      b = a;
+      a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (usize i = 0; i < 20; ++i) digest[i] = (u8) (h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+static String base64(const u8* data, usize size) {
+  constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  String out;
+  for (usize i = 0; i < size; i += 3) {
+    u32 group = (u32) data[i] << 16;
+    if (i + 1 < size) group |= (u32) data[i + 1] << 8;
+    if (i + 2 < size) group |= (u32) data[i + 2];
+
+    out.push_back(alphabet[(group >> 18) & 63]);
+    out.push_back(alphabet[(group >> 12) & 63]);
+    out.push_back(i + 1 < size ? alphabet[(group >> 6) & 63] : '=');
+    out.push_back(i + 2 < size ? alphabet[group & 63] : '=');
+  }
+  return out;
+}
+
+static int open_listener(u16 port) {
+  auto fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, (const sockaddr*) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -2;
+  }
+
+  return fd;
+}
+
+static void watch(BroadcastServer* server, int fd, u32 events, int operation) {
+  epoll_event event = {};
+  event.events = events;
+  event.data.fd = fd;
+  epoll_ctl(server->epoll_fd, operation, fd, &event);
+}
+
+Result<BroadcastServer, BroadcastServerError> broadcast_server_open(u16 port, const BroadcastServerConfig& config) {
+  BroadcastServerError error;
+
+  BroadcastServer server;
+  server.port = port;
+  server.config = config;
+  server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (server.epoll_fd < 0) {
+    error.error_kind = BroadcastServerError::Kind::epoll_failed;
+    return Err(error);
+  }
+
+  int* listeners[] = {&server.tcp_fd, &server.websocket_fd};
+  for (usize i = 0; i < 2; ++i) {
+    auto listener_port = (u16) (port + i);
+    auto fd = open_listener(listener_port);
+    if (fd < 0) {
+      error.error_kind = fd == -1 ? BroadcastServerError::Kind::socket_failed : BroadcastServerError::Kind::bind_failed;
+      error.port = listener_port;
+      broadcast_server_close(&server);
+      return Err(error);
+    }
+
+    *listeners[i] = fd;
+    watch(&server, fd, EPOLLIN, EPOLL_CTL_ADD);
+  }
+
+  return Ok(std::move(server));
+}
+
+void broadcast_server_close(BroadcastServer* server) {
+  for (auto& entry : server->clients) close(entry.key);
+  for (auto fd : {server->tcp_fd, server->websocket_fd, server->epoll_fd}) {
+    if (fd >= 0) close(fd);
+  }
+
+  *server = {};
+}
+
+static void disconnect(BroadcastServer* server, int fd) {
+  close(fd); // Also takes it out of the epoll set.
+  server->clients.erase(fd);
+  server->stats.disconnected += 1;
+}
+
+static void accept_clients(BroadcastServer* server, int listener, BroadcastProtocol protocol) {
+  while (true) {
+    auto fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    // Frames are small and should go out as soon as they are queued.
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    auto send_buffer = server->config.send_buffer_bytes;
+    if (send_buffer > 0) setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+
+    BroadcastClient client;
+    client.fd = fd;
+    client.protocol = protocol;
+    client.is_handshaking = protocol == BroadcastProtocol::websocket;
+    server->clients.insert(fd, std::move(client));
+    server->stats.accepted += 1;
+
+    watch(server, fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+  }
+}
+
+// Sends as much of the queue as the kernel takes. Returns false if the
+// connection is gone.
+static bool flush_client(BroadcastServer* server, BroadcastClient* client, u64 now) {
+  usize sent_frames = 0;
+  auto progressed = false;
+
+  while (sent_frames < client->queue.size()) {
+    iovec iovecs[broadcast_max_iovecs];
+    usize count = 0;
+    for (auto i = sent_frames; i < client->queue.size() && count < broadcast_max_iovecs; ++i, ++count) {
+      auto& bytes = *client->queue[i];
+      auto skip = i == sent_frames ? client->queue_sent : 0;
+      iovecs[count].iov_base = (void*) (bytes.data() + skip);
+      iovecs[count].iov_len = bytes.size() - skip;
+    }
+
+    msghdr message = {};
+    message.msg_iov = iovecs;
+    message.msg_iovlen = count;
+    auto sent = sendmsg(client->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+    server->stats.send_calls += 1;
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    progressed = progressed || sent > 0;
+    server->stats.bytes_sent += (u64) sent;
+    client->queued_bytes -= (usize) sent;
+
+    auto remaining = (usize) sent;
+    while (remaining > 0) {
+      auto left_in_frame = client->queue[sent_frames]->size() - client->queue_sent;
+      if (remaining < left_in_frame) {
+        client->queue_sent += remaining;
+        break;
+      }
+
+      remaining -= left_in_frame;
+      client->queue_sent = 0;
+      sent_frames += 1;
+    }
+
+    if (client->queue_sent != 0) break; // The kernel buffer is full.
+  }
+
+  client->queue.erase(client->queue.begin(), client->queue.begin() + (i64) sent_frames);
+
+  // Only wake up for writing while there is something to write.
+  auto is_waiting = !client->queue.empty();
+  if (is_waiting != client->is_waiting_to_write) {
+    watch(server, client->fd, EPOLLIN | EPOLLRDHUP | (is_waiting ? (u32) EPOLLOUT : 0u), EPOLL_CTL_MOD);
+    client->is_waiting_to_write = is_waiting;
+  }
+
+  if (!is_waiting || progressed) client->stalled_since = is_waiting ? now : 0;
+  else if (client->stalled_since == 0) client->stalled_since = now;
+  return true;
+}
+
+static void enqueue(BroadcastClient* client, const BroadcastBytes& bytes) {
+  client->queue.push_back(bytes);
+  client->queued_bytes += bytes->size();
+}
+
+static bool answer_handshake(BroadcastClient* client) {
+  auto end = client->request.find("\r\n\r\n");
+  if (end == String::npos) return client->request.size() <= broadcast_max_request_size;
+
+  // Header names are case-insensitive.
+  String key;
+  StringView request = StringView(client->request).substr(0, end);
+  constexpr StringView key_header = "sec-websocket-key:";
+  for (usize line_start = 0; line_start < request.size();) {
+    auto line_end = std::min(request.find("\r\n", line_start), request.size());
+    auto line = request.substr(line_start, line_end - line_start);
+    line_start = line_end + 2;
+
+    if (line.size() < key_header.size()) continue;
+    auto is_key = std::equal(key_header.begin(), key_header.end(), line.begin(),
+                             [](char a, char b) { return a == (char) std::tolower((unsigned char) b); });
+    if (!is_key) continue;
+
+    auto value = line.substr(key_header.size());
+    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+    while (!value.empty() && value.back() == ' ') value.remove_suffix(1);
+    key = String(value);
+  }
+
+  if (key.empty()) return false;
+
+  u8 digest[20];
+  sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+
+  auto reply = std::make_shared<String>(
+      "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: ");
+  *reply += base64(digest, sizeof(digest));
+  *reply += "\r\n\r\n";
+
+  enqueue(client, reply);
+  client->is_handshaking = false;
+  client->request = {};
+  return true;
+}
+
+// Returns false if the connection is gone or broke the protocol.
+static bool read_client(BroadcastClient* client) {
+  char buffer[4096];
+  while (true) {
+    auto got = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (got == 0) return false;
+    if (got < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    if (client->is_handshaking) {
+      client->request.append(buffer, (usize) got);
+      if (!answer_handshake(client)) return false;
+    }
+  }
+}
+
+void broadcast_server_poll(BroadcastServer* server, i32 timeout, u64 now) {
+  epoll_event events[broadcast_max_events];
+  auto count = epoll_wait(server->epoll_fd, events, (int) broadcast_max_events, timeout);
+
+  for (int i = 0; i < count; ++i) {
+    auto fd = events[i].data.fd;
+    if (fd == server->tcp_fd) {
+      accept_clients(server, fd, BroadcastProtocol::tcp);
+      continue;
+    }
+    if (fd == server->websocket_fd) {
+      accept_clients(server, fd, BroadcastProtocol::websocket);
+      continue;
+    }
+
+    auto client = server->clients.find(fd);
+    if (!client) continue;
+
+    auto is_alive = (events[i].events & (EPOLLERR | EPOLLHUP)) == 0;
+    if (is_alive && (events[i].events & (EPOLLIN | EPOLLRDHUP))) is_alive = read_client(client);
+    if (is_alive && ((events[i].events & EPOLLOUT) || !client->queue.empty())) is_alive = flush_client(server, client, now);
+    if (!is_alive) disconnect(server, fd);
+  }
+
+  // Clients that have taken nothing for too long are let go.
+  Vec<int> stalled;
+  for (auto& entry : server->clients) {
+    auto& client = entry.value;
+    if (client.stalled_since != 0 && now - client.stalled_since >= server->config.stall_timeout) stalled.push_back(entry.key);
+  }
+  for (auto fd : stalled) {
+    disconnect(server, fd);
+    server->stats.slow_disconnects += 1;
+  }
+}
+
+bool broadcast_server_wants_keyframe(const BroadcastServer& server) {
+  for (auto& entry : server.clients) {
+    if (entry.value.needs_keyframe && !entry.value.is_handshaking) return true;
+  }
+  return false;
+}
+
+static BroadcastBytes wrap_frame(StringView frame, BroadcastProtocol protocol) {
+  auto bytes = std::make_shared<String>();
+  auto size = (u64) frame.size();
+
+  if (protocol == BroadcastProtocol::tcp) {
+    for (usize i = 0; i < 4; ++i) bytes->push_back((char) (u8) (size >> (i * 8)));
+  } else {
+    // One final binary message, unmasked as servers send them. The length
+    // is big-endian here, as WebSocket has it.
+    bytes->push_back((char) 0x82);
+    if (size < 126) {
+      bytes->push_back((char) size);
+    } else if (size <= 0xFFFF) {
+      bytes->push_back((char) 126);
+      for (i32 i = 1; i >= 0; --i) bytes->push_back((char) (u8) (size >> (i * 8)));
+    } else {
+      bytes->push_back((char) 127);
+      for (i32 i = 7; i >= 0; --i) bytes->push_back((char) (u8) (size >> (i * 8)));
+    }
+  }
+
+  bytes->append(frame);
+  return bytes;
+}
+
+void broadcast_server_send(BroadcastServer* server, StringView delta, StringView keyframe, u64 now) {
+  // Each frame is wrapped at most once per protocol, the first time a client
+  // needs it, and shared by every client after that.
+  BroadcastBytes wrapped[2][2] = {}; // [is_keyframe][protocol]
+
+  Vec<int> gone;
+  for (auto& entry : server->clients) {
+    auto& client = entry.value;
+    if (client.is_handshaking) continue;
+
+    auto is_keyframe = client.needs_keyframe;
+    if (is_keyframe && keyframe.empty()) continue;
+
+    auto& bytes = wrapped[is_keyframe][(usize) client.protocol];
+    if (!bytes) bytes = wrap_frame(is_keyframe ? keyframe : delta, client.protocol);
+
+    if (client.queued_bytes + bytes->size() > server->config.max_queued_bytes) {
+      // Behind by too much: drop everything but a frame that is partly sent
+      // already, and start again from the next keyframe.
+      auto kept = client.queue_sent > 0 ? 1 : 0;
+      server->stats.frames_dropped += client.queue.size() - (usize) kept;
+      client.queue.resize((usize) kept);
+      client.queued_bytes = kept ? client.queue[0]->size() - client.queue_sent : 0;
+      client.needs_keyframe = true;
+      client.is_catching_up = true;
+      continue;
+    }
+
+    if (client.is_catching_up) server->stats.resyncs += 1;
+    client.needs_keyframe = false;
+    client.is_catching_up = false;
+    enqueue(&client, bytes);
+    server->stats.frames_queued += 1;
+
+    if (!client.is_waiting_to_write && !flush_client(server, &client, now)) gone.push_back(entry.key);
+  }
+
+  for (auto fd : gone) disconnect(server, fd);
+}
+
+usize broadcast_server_client_count(const BroadcastServer& server) {
+  return server.clients.size();
+}
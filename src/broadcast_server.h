@@ -0,0 +1,108 @@
+#pragma once
+
+#include "core.h"
+#include "hash_table.h"
+
+// Broadcast server
+//
+// Sends the same stream of frames to any number of spectators over TCP, on
+// one thread with non-blocking sockets and epoll. Plain TCP clients connect
+// to `port` and get each frame behind a u32 length; browsers connect to
+// `port + 1` with a WebSocket handshake and get each frame as one binary
+// message. Anything a client sends after that is read and ignored.
+//
+// A frame is wrapped once per protocol and every client's queue holds a
+// reference to the same bytes, which go from there to the kernel with no
+// copy per client.
+//
+// A client that can't keep up isn't allowed to hold the rest back: once more
+// than max_queued_bytes wait for it, its queue is dropped and it is sent
+// nothing more until the next keyframe, from which it can pick up again. One
+// that accepts nothing at all for stall_timeout ms is disconnected.
+
+constexpr usize broadcast_max_request_size = 4096;
+
+struct BroadcastServerConfig {
+  usize max_queued_bytes = 256 * 1024;
+  u32 stall_timeout = 5000; // ms
+
+  // SO_SNDBUF for each client, or 0 to leave it to the kernel. Smaller keeps
+  // memory per client down and notices slow clients sooner.
+  int send_buffer_bytes = 0;
+};
+
+enum class BroadcastProtocol : u8 {
+  tcp,
+  websocket,
+};
+
+using BroadcastBytes = RefPtr<const String>;
+
+struct BroadcastClient {
+  int fd = -1;
+  BroadcastProtocol protocol = BroadcastProtocol::tcp;
+
+  bool is_handshaking = false; // WebSocket request not read yet.
+  String request = {};
+
+  Vec<BroadcastBytes> queue = {};
+  usize queue_sent = 0;   // Bytes of queue[0] already sent.
+  usize queued_bytes = 0; // Not yet sent, across the queue.
+
+  bool needs_keyframe = true;
+  bool is_catching_up = false;      // Had its queue dropped, waiting for a keyframe.
+  bool is_waiting_to_write = false; // Registered for EPOLLOUT.
+  u64 stalled_since = 0;            // ms, or 0 while the queue moves.
+};
+
+struct BroadcastServerStats {
+  u64 accepted = 0;
+  u64 disconnected = 0;
+  u64 slow_disconnects = 0;
+  u64 frames_queued = 0;
+  u64 frames_dropped = 0; // Queued, then dropped to catch a client up.
+  u64 resyncs = 0;        // Keyframes sent to catch a client up.
+  u64 bytes_sent = 0;
+  u64 send_calls = 0;
+};
+
+struct BroadcastServer {
+  int epoll_fd = -1;
+  int tcp_fd = -1;
+  int websocket_fd = -1;
+  u16 port = 0;
+  BroadcastServerConfig config = {};
+
+  HashTable<int, BroadcastClient> clients = {};
+  BroadcastServerStats stats = {};
+};
+
+struct BroadcastServerError {
+  enum class Kind {
+    none,
+    epoll_failed,
+    socket_failed,
+    bind_failed,
+  };
+
+  BroadcastServerError::Kind error_kind = BroadcastServerError::Kind::none;
+  u16                        port       = 0;
+};
+
+Result<BroadcastServer, BroadcastServerError> broadcast_server_open(u16 port, const BroadcastServerConfig& config);
+void broadcast_server_close(BroadcastServer* server);
+
+// Accepts new clients, reads handshakes and sends whatever the kernel will
+// take, waiting up to `timeout` ms for something to happen.
+void broadcast_server_poll(BroadcastServer* server, i32 timeout, u64 now);
+
+// Whether any client is waiting for a keyframe, so the next
+// broadcast_server_send should be given one.
+bool broadcast_server_wants_keyframe(const BroadcastServer& server);
+
+// Queues a frame for every client: `delta` for those that are following
+// along, `keyframe` for those that need one. `keyframe` may be empty, in
+// which case those clients keep waiting.
+void broadcast_server_send(BroadcastServer* server, StringView delta, StringView keyframe, u64 now);
+
+usize broadcast_server_client_count(const BroadcastServer& server);
@@ -0,0 +1,381 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "core.h"
+
+// Files
+
+static ReadFileError::Kind open_error_kind(int error) {
+    if (error == ENOENT || error == ENOTDIR) return ReadFileError::Kind::file_not_found;
+    if (error == EISDIR) return ReadFileError::Kind::is_directory;
+    return ReadFileError::Kind::file_not_readable;
+}
+
+// Reading opens directories, FIFOs and devices happily on Linux, so check
+// what was opened. O_NONBLOCK keeps a FIFO with no writer from hanging the
+// open before it can be turned down; it changes nothing for regular files.
+static ReadFileError::Kind open_regular_file(const Path& path, int* fd, usize* size) {
+    *fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (*fd < 0) return open_error_kind(errno);
+
+    auto error_kind = ReadFileError::Kind::none;
+    struct stat status;
+    if (fstat(*fd, &status) != 0) {
+        error_kind = ReadFileError::Kind::file_not_readable;
+    } else if (S_ISDIR(status.st_mode)) {
+        error_kind = ReadFileError::Kind::is_directory;
+    } else if (!S_ISREG(status.st_mode)) {
+        error_kind = ReadFileError::Kind::not_a_file;
+    }
+
+    if (error_kind != ReadFileError::Kind::none) {
+        close(*fd);
+        *fd = -1;
+        return error_kind;
+    }
+
+    *size = (usize) status.st_size;
+    return ReadFileError::Kind::none;
+}
+
+// A stdio handle on a regular file, or nullptr with `error_kind` set.
+static FILE* open_regular_file_handle(const Path& path, usize* size, ReadFileError::Kind* error_kind) {
+    int fd = -1;
+    *error_kind = open_regular_file(path, &fd, size);
+    if (*error_kind != ReadFileError::Kind::none) return nullptr;
+
+    auto handle = fdopen(fd, "rb");
+    if (!handle) {
+        close(fd);
+        *error_kind = ReadFileError::Kind::file_not_readable;
+    }
+    return handle;
+}
+
+Result<File, ReadFileError> read_file(const Path& path) {
+    File file;
+    file.path = path;
+
+    ReadFileError error;
+    error.path = path;
+
+    usize size = 0;
+    auto handle = open_regular_file_handle(path, &size, &error.error_kind);
+    if (!handle) return Err(error);
+    defer(std::fclose(handle));
+
+    file.contents.resize(size);
+    if (std::fread(file.contents.data(), 1, file.contents.size(), handle) != file.contents.size()) {
+        error.error_kind = ReadFileError::Kind::read_failed;
+        return Err(error);
+    }
+
+    return Ok(std::move(file));
+}
+
+Result<MappedFile, ReadFileError> map_file(const Path& path) {
+    ReadFileError error;
+    error.path = path;
+
+    int fd = -1;
+    usize size = 0;
+    error.error_kind = open_regular_file(path, &fd, &size);
+    if (error.error_kind != ReadFileError::Kind::none) return Err(error);
+    defer(close(fd));
+
+    MappedFile file;
+    file.path = path;
+
+    // mmap rejects empty mappings; an empty file is just an empty view.
+    if (size == 0) return Ok(std::move(file));
+
+    auto memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (memory == MAP_FAILED) {
+        error.error_kind = ReadFileError::Kind::map_failed;
+        return Err(error);
+    }
+
+    file.contents = StringView((const char*) memory, size);
+    return Ok(std::move(file));
+}
+
+void unmap_file(MappedFile* file) {
+    if (!file->contents.empty()) {
+        munmap((void*) file->contents.data(), file->contents.size());
+    }
+
+    *file = {};
+}
+
+Result<FileReader, ReadFileError> open_file_reader(const Path& path, usize chunk_size) {
+    ReadFileError error;
+    error.path = path;
+
+    usize size = 0;
+    auto handle = open_regular_file_handle(path, &size, &error.error_kind);
+    if (!handle) return Err(error);
+
+    // Chunks are already large; stdio buffering would only copy them again.
+    std::setvbuf(handle, nullptr, _IONBF, 0);
+
+    FileReader reader;
+    reader.path = path;
+    reader.handle = handle;
+    reader.buffer.resize(chunk_size);
+    return Ok(std::move(reader));
+}
+
+Result<void, ReadFileError> read_file_chunk(FileReader* reader, StringView* chunk) {
+    *chunk = {};
+    if (!reader->handle) return Ok();
+
+    auto read = std::fread(reader->buffer.data(), 1, reader->buffer.size(), reader->handle);
+    if (read < reader->buffer.size() && std::ferror(reader->handle)) {
+        ReadFileError error;
+        error.error_kind = ReadFileError::Kind::read_failed;
+        error.path = reader->path;
+        return Err(error);
+    }
+
+    reader->offset += read;
+    *chunk = StringView(reader->buffer.data(), read);
+    return Ok();
+}
+
+void close_file_reader(FileReader* reader) {
+    if (reader->handle) {
+        std::fclose(reader->handle);
+    }
+
+    *reader = {};
+}
+
+Result<void, WriteFileError> write_file(const File& file) {
+    WriteFileError error;
+    error.error_kind = WriteFileError::Kind::file_not_writable;
+    error.path = file.path;
+
+    auto temporary_path = file.path;
+    temporary_path += ".tmp";
+
+    auto handle = std::fopen(temporary_path.c_str(), "wb");
+    if (!handle) return Err(error);
+
+    auto written = std::fwrite(file.contents.data(), 1, file.contents.size(), handle);
+    auto closed = std::fclose(handle) == 0;
+
+    std::error_code ignored;
+    if (written != file.contents.size() || !closed) {
+        std::filesystem::remove(temporary_path, ignored);
+        return Err(error);
+    }
+
+    std::error_code rename_error;
+    std::filesystem::rename(temporary_path, file.path, rename_error);
+    if (rename_error) {
+        std::filesystem::remove(temporary_path, ignored);
+        return Err(error);
+    }
+
+    return Ok();
+}
+
+
+
+
+bool is_power_of_two(usize n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+u64 random_next(u64* state) {
+    *state += 0x9E3779B97F4A7C15ull;
+
+    auto z = *state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uintptr_t align_forward(uintptr_t pointer, usize alignment) {
+    log_assert(is_power_of_two(alignment), "Alignment {} is not a power of two", alignment);
+
+    auto modulo = pointer & (uintptr_t) (alignment - 1);
+    if (modulo != 0) pointer += alignment - modulo;
+    return pointer;
+}
+
+
+
+// Memory arena
+
+MemoryArena make_memory_arena(void* memory, usize memory_size) {
+    MemoryArena arena;
+    arena.memory = (u8*) memory;
+    arena.size = memory_size;
+    return arena;
+}
+
+void* memory_arena_allocate_aligned(MemoryArena* arena, usize size, usize alignment) {
+    auto current = (uintptr_t) arena->memory + (uintptr_t) arena->current_offset;
+    auto offset = (usize) (align_forward(current, alignment) - (uintptr_t) arena->memory);
+
+    if (offset > arena->size || size > arena->size - offset) return nullptr;
+
+    auto pointer = arena->memory + offset;
+    arena->previous_offset = offset;
+    arena->current_offset = offset + size;
+
+    std::memset(pointer, 0, size);
+    return pointer;
+}
+
+void* memory_arena_allocate(MemoryArena* arena, usize size) {
+    return memory_arena_allocate_aligned(arena, size, default_memory_alignment);
+}
+
+void memory_arena_free(MemoryArena* arena, void* pointer) {
+    // Arenas only free everything at once, in memory_arena_reset.
+    (void) arena;
+    (void) pointer;
+}
+
+void* memory_arena_resize_aligned(MemoryArena* arena, void* pointer, usize old_size, usize new_size, usize alignment) {
+    auto old_memory = (u8*) pointer;
+
+    if (!old_memory || old_size == 0) {
+        return memory_arena_allocate_aligned(arena, new_size, alignment);
+    }
+
+    log_assert(old_memory >= arena->memory && old_memory < arena->memory + arena->size, "Resizing memory outside the arena");
+
+    // The most recent allocation can grow or shrink in place.
+    if (old_memory == arena->memory + arena->previous_offset && new_size <= arena->size - arena->previous_offset) {
+        arena->current_offset = arena->previous_offset + new_size;
+        if (new_size > old_size) {
+            std::memset(old_memory + old_size, 0, new_size - old_size);
+        }
+        return old_memory;
+    }
+
+    auto new_memory = memory_arena_allocate_aligned(arena, new_size, alignment);
+    if (new_memory) {
+        std::memmove(new_memory, old_memory, old_size < new_size ? old_size : new_size);
+    }
+    return new_memory;
+}
+
+void* memory_arena_resize(MemoryArena* arena, void* pointer, usize old_size, usize new_size) {
+    return memory_arena_resize_aligned(arena, pointer, old_size, new_size, default_memory_alignment);
+}
+
+void memory_arena_reset(MemoryArena* arena) {
+    arena->previous_offset = 0;
+    arena->current_offset = 0;
+}
+
+
+
+// Memory pool
+
+MemoryPool make_memory_pool(void* memory, usize memory_size, usize chunk_size, usize chunk_alignment) {
+    auto start = (uintptr_t) memory;
+    auto aligned_start = align_forward(start, chunk_alignment);
+    memory_size -= (usize) (aligned_start - start);
+
+    chunk_size = (usize) align_forward(chunk_size, chunk_alignment);
+    log_assert(chunk_size >= sizeof(MemoryPoolFreeNode), "Pool chunks of {} bytes are too small", chunk_size);
+    log_assert(memory_size >= chunk_size, "Pool memory is smaller than one chunk");
+
+    MemoryPool pool;
+    pool.memory = (u8*) aligned_start;
+    pool.size = memory_size;
+    pool.chunk_size = chunk_size;
+    pool.chunk_alignment = chunk_alignment;
+
+    memory_pool_free_all(&pool);
+    return pool;
+}
+
+void* memory_pool_allocate(MemoryPool* pool) {
+    auto node = pool->free_list;
+    if (!node) return nullptr;
+
+    pool->free_list = node->next;
+
+    std::memset((void*) node, 0, pool->chunk_size);
+    return node;
+}
+
+void memory_pool_free(MemoryPool* pool, void* pointer) {
+    if (!pointer) return;
+
+    auto chunk = (u8*) pointer;
+    log_assert(chunk >= pool->memory && chunk < pool->memory + pool->size, "Freeing memory outside the pool");
+    log_assert((usize) (chunk - pool->memory) % pool->chunk_size == 0, "Freeing a pointer into the middle of a chunk");
+
+    auto node = new (pointer) MemoryPoolFreeNode;
+    node->next = pool->free_list;
+    pool->free_list = node;
+}
+
+void memory_pool_free_all(MemoryPool* pool) {
+    pool->free_list = nullptr;
+
+    // Pushed back to front, so chunks are handed out in address order.
+    auto chunk_count = pool->size / pool->chunk_size;
+    for (usize i = chunk_count; i > 0; --i) {
+        auto node = new (pool->memory + (i - 1) * pool->chunk_size) MemoryPoolFreeNode;
+        node->next = pool->free_list;
+        pool->free_list = node;
+    }
+}
+
+
+
+// Allocator adaptors
+
+void* MemoryArenaResource::do_allocate(usize size, usize alignment) {
+    auto pointer = memory_arena_allocate_aligned(arena, size, alignment);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void MemoryArenaResource::do_deallocate(void* pointer, usize size, usize alignment) {
+    (void) size;
+    (void) alignment;
+    memory_arena_free(arena, pointer);
+}
+
+bool MemoryArenaResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+void* MemoryPoolResource::do_allocate(usize size, usize alignment) {
+    if (size > pool->chunk_size || alignment > pool->chunk_alignment) {
+        return upstream->allocate(size, alignment);
+    }
+
+    auto pointer = memory_pool_allocate(pool);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void MemoryPoolResource::do_deallocate(void* pointer, usize size, usize alignment) {
+    if (size > pool->chunk_size || alignment > pool->chunk_alignment) {
+        upstream->deallocate(pointer, size, alignment);
+        return;
+    }
+
+    memory_pool_free(pool, pointer);
+}
+
+bool MemoryPoolResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -32,6 +32,51 @@ using Path = std::filesystem::path;
 template <typename T>
 using Vec = std::vector<T>;
 
+// A vector with its storage inline. A struct holding one stays trivially
+// copyable, so it can be saved and restored with a plain copy.
+template <typename T, std::size_t N>
+struct FixedVec {
+  T items[N] = {};
+  std::size_t count = 0;
+
+  static constexpr std::size_t capacity() { return N; }
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T* data() { return items; }
+  const T* data() const { return items; }
+
+  T* begin() { return items; }
+  T* end() { return items + count; }
+  const T* begin() const { return items; }
+  const T* end() const { return items + count; }
+
+  T& operator[](std::size_t index) { return items[index]; }
+  const T& operator[](std::size_t index) const { return items[index]; }
+
+  T& back() { return items[count - 1]; }
+
+  void push_back(const T& value) {
+    log_assert(count < N, "FixedVec is full at {} items", N);
+    items[count++] = value;
+  }
+
+  void resize(std::size_t new_count) {
+    log_assert(new_count <= N, "FixedVec can't hold {} items, only {}", new_count, N);
+    for (auto i = count; i < new_count; ++i) items[i] = T{};
+    count = new_count;
+  }
+
+  void clear() { count = 0; }
+
+  // Keeps the order of the remaining items, like Vec::erase.
+  T* erase(T* position) {
+    for (auto it = position; it + 1 < end(); ++it) *it = *(it + 1);
+    count -= 1;
+    return position;
+  }
+};
+
 #include <map>
 template <typename K, typename V>
 using Table = std::map<K, V>;
@@ -78,6 +123,9 @@ bool is_digit(char c);
 
 bool is_power_of_two(usize n);
 
+// SplitMix64. Any state is valid, so a state can be saved and restored verbatim.
+u64 random_next(u64* state);
+
 // Defer statement
 // https://www.gingerbill.org/article/2015/08/19/defer-in-cpp/
 template <typename F>
@@ -110,13 +158,64 @@ struct ReadFileError {
     none,
     file_not_found,
     file_not_readable,
+    is_directory,
+    not_a_file,   // A FIFO, socket or device.
+    read_failed,  // Opened, but reading stopped partway through.
+    map_failed,
   };
 
   ReadFileError::Kind error_kind = ReadFileError::Kind::none;
   Path                path       = {};
 };
 
-Result<File, ReadFileError> read_file(String input_filepath);
+Result<File, ReadFileError> read_file(const Path& path);
+
+
+// A read-only memory mapping of a whole file. `contents` points straight into
+// the mapping, so nothing is copied and pages are only read as they are
+// touched. It stays valid until unmap_file.
+struct MappedFile {
+  Path       path = {};
+  StringView contents = {};
+};
+
+Result<MappedFile, ReadFileError> map_file(const Path& path);
+void unmap_file(MappedFile* file);
+
+
+#include <cstdio>
+
+// Reads a file front to back in fixed-size chunks, for files too large to
+// want in memory at once. Each chunk is only valid until the next read.
+struct FileReader {
+  Path       path = {};
+  std::FILE* handle = nullptr;
+  String     buffer = "";
+  u64        offset = 0; // Of the next chunk in the file.
+};
+
+constexpr usize default_file_chunk_size = 64 * 1024;
+
+Result<FileReader, ReadFileError> open_file_reader(const Path& path, usize chunk_size = default_file_chunk_size);
+
+// Sets `chunk` to the next part of the file; an empty chunk means the end of
+// the file was reached.
+Result<void, ReadFileError> read_file_chunk(FileReader* reader, StringView* chunk);
+void close_file_reader(FileReader* reader);
+
+struct WriteFileError {
+  enum class Kind {
+    none,
+    file_not_writable,
+  };
+
+  WriteFileError::Kind error_kind = WriteFileError::Kind::none;
+  Path                 path       = {};
+};
+
+// Writes to a temporary file next to the target and renames it over the
+// target, so a crash mid-write never leaves a truncated file behind.
+Result<void, WriteFileError> write_file(const File& file);
 
 
 
@@ -153,7 +252,131 @@ void* memory_arena_allocate(MemoryArena* arena, usize size);
 
 
 
+// Memory pool
+// @Source: https://www.gingerbill.org/article/2019/02/16/memory-allocation-strategies-004/
+//
+// Fixed-size chunks carved out of one block, with free chunks threaded into a
+// list through their own memory. Allocating and freeing are O(1) and any chunk
+// can be freed on its own, unlike an arena.
+struct MemoryPoolFreeNode {
+  MemoryPoolFreeNode* next = nullptr;
+};
+
+struct MemoryPool {
+  u8* memory = nullptr;
+  usize size = 0;
+  usize chunk_size = 0;
+  usize chunk_alignment = 0;
+
+  MemoryPoolFreeNode* free_list = nullptr;
+};
+
+MemoryPool make_memory_pool(void* memory, usize memory_size, usize chunk_size, usize chunk_alignment);
+
+// Returns zeroed memory, or nullptr once every chunk is in use.
+void* memory_pool_allocate(MemoryPool* pool);
+void  memory_pool_free(MemoryPool* pool, void* pointer);
+void  memory_pool_free_all(MemoryPool* pool);
+
+
+// A pool of T that owns its storage. Objects still alive when the pool goes
+// away are not destroyed, as with an arena.
+template <typename T>
+struct Pool {
+  MemoryPool            pool = {};
+  std::unique_ptr<u8[]> storage = {};
+  usize                 capacity = 0;
+};
+
+template <typename T>
+Pool<T> make_pool(usize capacity) {
+  constexpr auto chunk_alignment = alignof(T) > alignof(MemoryPoolFreeNode) ? alignof(T) : alignof(MemoryPoolFreeNode);
+  constexpr auto chunk_size = (sizeof(T) > sizeof(MemoryPoolFreeNode) ? sizeof(T) : sizeof(MemoryPoolFreeNode));
+  constexpr auto aligned_chunk_size = (chunk_size + chunk_alignment - 1) & ~(chunk_alignment - 1);
+
+  // Room to align the start, in case T wants more than new[] guarantees. Less
+  // than a chunk, so the pool holds exactly `capacity` chunks however much of
+  // it aligning takes.
+  auto memory_size = capacity * aligned_chunk_size + chunk_alignment - 1;
+
+  Pool<T> result;
+  result.storage.reset(new u8[memory_size]);
+  result.pool = make_memory_pool(result.storage.get(), memory_size, chunk_size, chunk_alignment);
+  result.capacity = capacity;
+  return result;
+}
+
+// Returns nullptr when the pool is full.
+template <typename T, typename... Args>
+T* pool_create(Pool<T>* pool, Args&&... args) {
+  auto memory = memory_pool_allocate(&pool->pool);
+  if (!memory) return nullptr;
+
+  return new (memory) T{std::forward<Args>(args)...};
+}
+
+template <typename T>
+void pool_destroy(Pool<T>* pool, T* object) {
+  if (!object) return;
+
+  object->~T();
+  memory_pool_free(&pool->pool, object);
+}
+
+
+
+
+// Standard containers on arena or pool storage, through std::pmr:
+//
+//   MemoryArenaResource resource(&arena);
+//   PmrVec<Coordinate> cells(&resource);
+//
+// Arena memory is only given back by memory_arena_reset, so a growing vector
+// leaves its old buffers behind until then. Pools hand out one chunk size, so
+// MemoryPoolResource suits node-based containers; anything bigger than a
+// chunk goes to `upstream`.
+#include <memory_resource>
+template <typename T>
+using PmrVec = std::pmr::vector<T>;
+
+struct MemoryArenaResource : std::pmr::memory_resource {
+  MemoryArena* arena = nullptr;
+
+  explicit MemoryArenaResource(MemoryArena* arena) : arena(arena) {}
+
+  void* do_allocate(usize size, usize alignment) override;
+  void  do_deallocate(void* pointer, usize size, usize alignment) override;
+  bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+struct MemoryPoolResource : std::pmr::memory_resource {
+  MemoryPool* pool = nullptr;
+  std::pmr::memory_resource* upstream = nullptr;
+
+  explicit MemoryPoolResource(MemoryPool* pool, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : pool(pool), upstream(upstream) {}
+
+  void* do_allocate(usize size, usize alignment) override;
+  void  do_deallocate(void* pointer, usize size, usize alignment) override;
+  bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+
+
+
 // Linear algebra
+//
+// Small value types with constexpr operators, so constants like colours and
+// offsets fold at compile time. The vector2_* functions predate the operators
+// and forward to them. Vector4<f32> is 16-byte aligned and does its arithmetic
+// in SSE registers outside constant evaluation.
+
+#include <type_traits>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 template<typename T>
 struct Vector2 {
   T x = {};
@@ -161,7 +384,7 @@ struct Vector2 {
 };
 
 template<typename T>
-Vector2<T> make_vector2(T x, T y) {
+constexpr Vector2<T> make_vector2(T x, T y) {
   Vector2<T> result;
   result.x = x;
   result.y = y;
@@ -169,28 +392,51 @@ Vector2<T> make_vector2(T x, T y) {
 }
 
 template<typename T>
-bool vector2_equal(Vector2<T> a, Vector2<T> b) {
-  return a.x == b.x && a.y == b.y;
-}
+constexpr bool operator==(Vector2<T> a, Vector2<T> b) { return a.x == b.x && a.y == b.y; }
 
 template<typename T>
-Vector2<T> vector2_add(Vector2<T> a, Vector2<T> b) {
-  return make_vector2(a.x + b.x, a.y + b.y);
-}
+constexpr Vector2<T> operator-(Vector2<T> a) { return make_vector2<T>(-a.x, -a.y); }
 
 template<typename T>
-Vector2<T> vector2_mul(Vector2<T> a, Vector2<T> b) {
-  return make_vector2(a.x * b.x, a.y * b.y);
-}
+constexpr Vector2<T> operator+(Vector2<T> a, Vector2<T> b) { return make_vector2<T>(a.x + b.x, a.y + b.y); }
 
 template<typename T>
-Vector2<T> vector2_mul(Vector2<T> a, T b) {
-  return make_vector2(a.x * b, a.y * b);
-}
+constexpr Vector2<T> operator-(Vector2<T> a, Vector2<T> b) { return make_vector2<T>(a.x - b.x, a.y - b.y); }
+
+template<typename T>
+constexpr Vector2<T> operator*(Vector2<T> a, Vector2<T> b) { return make_vector2<T>(a.x * b.x, a.y * b.y); }
 
 template<typename T>
-Vector2<T> vector2_div(Vector2<T> a, T b) {
-  return make_vector2(a.x / b, a.y / b);
+constexpr Vector2<T> operator*(Vector2<T> a, T b) { return make_vector2<T>(a.x * b, a.y * b); }
+
+template<typename T>
+constexpr Vector2<T> operator/(Vector2<T> a, T b) { return make_vector2<T>(a.x / b, a.y / b); }
+
+template<typename T>
+constexpr Vector2<T>& operator+=(Vector2<T>& a, Vector2<T> b) { return a = a + b; }
+
+template<typename T>
+constexpr Vector2<T>& operator-=(Vector2<T>& a, Vector2<T> b) { return a = a - b; }
+
+template<typename T>
+constexpr bool vector2_equal(Vector2<T> a, Vector2<T> b) { return a == b; }
+
+template<typename T>
+constexpr Vector2<T> vector2_add(Vector2<T> a, Vector2<T> b) { return a + b; }
+
+template<typename T>
+constexpr Vector2<T> vector2_mul(Vector2<T> a, Vector2<T> b) { return a * b; }
+
+template<typename T>
+constexpr Vector2<T> vector2_mul(Vector2<T> a, T b) { return a * b; }
+
+template<typename T>
+constexpr Vector2<T> vector2_div(Vector2<T> a, T b) { return a / b; }
+
+// out[i] = in[i] + offset. `out` may be `in`.
+template<typename T>
+constexpr void vector2_add_n(Vector2<T>* out, const Vector2<T>* in, usize count, Vector2<T> offset) {
+  for (usize i = 0; i < count; ++i) out[i] = in[i] + offset;
 }
 
 
@@ -203,7 +449,7 @@ struct Vector3 {
 };
 
 template<typename T>
-Vector3<T> make_vector3(T x, T y, T z) {
+constexpr Vector3<T> make_vector3(T x, T y, T z) {
   Vector3<T> result;
   result.x = x;
   result.y = y;
@@ -211,6 +457,33 @@ Vector3<T> make_vector3(T x, T y, T z) {
   return result;
 }
 
+template<typename T>
+constexpr bool operator==(Vector3<T> a, Vector3<T> b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+template<typename T>
+constexpr Vector3<T> operator-(Vector3<T> a) { return make_vector3<T>(-a.x, -a.y, -a.z); }
+
+template<typename T>
+constexpr Vector3<T> operator+(Vector3<T> a, Vector3<T> b) { return make_vector3<T>(a.x + b.x, a.y + b.y, a.z + b.z); }
+
+template<typename T>
+constexpr Vector3<T> operator-(Vector3<T> a, Vector3<T> b) { return make_vector3<T>(a.x - b.x, a.y - b.y, a.z - b.z); }
+
+template<typename T>
+constexpr Vector3<T> operator*(Vector3<T> a, Vector3<T> b) { return make_vector3<T>(a.x * b.x, a.y * b.y, a.z * b.z); }
+
+template<typename T>
+constexpr Vector3<T> operator*(Vector3<T> a, T b) { return make_vector3<T>(a.x * b, a.y * b, a.z * b); }
+
+template<typename T>
+constexpr Vector3<T> operator/(Vector3<T> a, T b) { return make_vector3<T>(a.x / b, a.y / b, a.z / b); }
+
+template<typename T>
+constexpr Vector3<T>& operator+=(Vector3<T>& a, Vector3<T> b) { return a = a + b; }
+
+template<typename T>
+constexpr Vector3<T>& operator-=(Vector3<T>& a, Vector3<T> b) { return a = a - b; }
+
 
 
 template<typename T>
@@ -221,8 +494,19 @@ struct Vector4 {
   T w = {};
 };
 
+// Aligned so it loads straight into one SSE register.
+template<>
+struct alignas(16) Vector4<f32> {
+  f32 x = 0.0f;
+  f32 y = 0.0f;
+  f32 z = 0.0f;
+  f32 w = 0.0f;
+};
+
+static_assert(sizeof(Vector4<f32>) == 16);
+
 template<typename T>
-Vector4<T> make_vector4(T x, T y, T z, T w) {
+constexpr Vector4<T> make_vector4(T x, T y, T z, T w) {
   Vector4<T> result;
   result.x = x;
   result.y = y;
@@ -231,3 +515,86 @@ Vector4<T> make_vector4(T x, T y, T z, T w) {
   return result;
 }
 
+template<typename T>
+constexpr bool operator==(Vector4<T> a, Vector4<T> b) { return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w; }
+
+template<typename T>
+constexpr Vector4<T> operator-(Vector4<T> a) { return make_vector4<T>(-a.x, -a.y, -a.z, -a.w); }
+
+template<typename T>
+constexpr Vector4<T> operator+(Vector4<T> a, Vector4<T> b) { return make_vector4<T>(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+
+template<typename T>
+constexpr Vector4<T> operator-(Vector4<T> a, Vector4<T> b) { return make_vector4<T>(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+
+template<typename T>
+constexpr Vector4<T> operator*(Vector4<T> a, Vector4<T> b) { return make_vector4<T>(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w); }
+
+template<typename T>
+constexpr Vector4<T> operator*(Vector4<T> a, T b) { return make_vector4<T>(a.x * b, a.y * b, a.z * b, a.w * b); }
+
+template<typename T>
+constexpr Vector4<T> operator/(Vector4<T> a, T b) { return make_vector4<T>(a.x / b, a.y / b, a.z / b, a.w / b); }
+
+#if defined(__SSE__)
+inline __m128 vector4_load(const Vector4<f32>& v) { return _mm_load_ps(&v.x); }
+
+inline Vector4<f32> vector4_store(__m128 v) {
+  Vector4<f32> result;
+  _mm_store_ps(&result.x, v);
+  return result;
+}
+
+// Exact overloads win over the templates above for Vector4<f32>.
+constexpr Vector4<f32> operator+(Vector4<f32> a, Vector4<f32> b) {
+  if (std::is_constant_evaluated()) return make_vector4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+  return vector4_store(_mm_add_ps(vector4_load(a), vector4_load(b)));
+}
+
+constexpr Vector4<f32> operator-(Vector4<f32> a, Vector4<f32> b) {
+  if (std::is_constant_evaluated()) return make_vector4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+  return vector4_store(_mm_sub_ps(vector4_load(a), vector4_load(b)));
+}
+
+constexpr Vector4<f32> operator*(Vector4<f32> a, Vector4<f32> b) {
+  if (std::is_constant_evaluated()) return make_vector4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
+  return vector4_store(_mm_mul_ps(vector4_load(a), vector4_load(b)));
+}
+
+constexpr Vector4<f32> operator*(Vector4<f32> a, f32 b) {
+  if (std::is_constant_evaluated()) return make_vector4(a.x * b, a.y * b, a.z * b, a.w * b);
+  return vector4_store(_mm_mul_ps(vector4_load(a), _mm_set1_ps(b)));
+}
+
+constexpr Vector4<f32> operator/(Vector4<f32> a, f32 b) {
+  if (std::is_constant_evaluated()) return make_vector4(a.x / b, a.y / b, a.z / b, a.w / b);
+  return vector4_store(_mm_div_ps(vector4_load(a), _mm_set1_ps(b)));
+}
+#endif
+
+template<typename T>
+constexpr Vector4<T>& operator+=(Vector4<T>& a, Vector4<T> b) { return a = a + b; }
+
+template<typename T>
+constexpr Vector4<T>& operator-=(Vector4<T>& a, Vector4<T> b) { return a = a - b; }
+
+template<typename T>
+constexpr Vector4<T> vector4_lerp(Vector4<T> a, Vector4<T> b, T t) { return a + (b - a) * t; }
+
+// out[i] = a[i] + b[i]. `out` may alias either input.
+template<typename T>
+constexpr void vector4_add_n(Vector4<T>* out, const Vector4<T>* a, const Vector4<T>* b, usize count) {
+  for (usize i = 0; i < count; ++i) out[i] = a[i] + b[i];
+}
+
+// out[i] = in[i] * scale. `out` may be `in`.
+template<typename T>
+constexpr void vector4_mul_n(Vector4<T>* out, const Vector4<T>* in, usize count, T scale) {
+  for (usize i = 0; i < count; ++i) out[i] = in[i] * scale;
+}
+
+// out[i] = lerp(a[i], b[i], t). `out` may alias either input.
+template<typename T>
+constexpr void vector4_lerp_n(Vector4<T>* out, const Vector4<T>* a, const Vector4<T>* b, usize count, T t) {
+  for (usize i = 0; i < count; ++i) out[i] = vector4_lerp(a[i], b[i], t);
+}
@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "game.h"
+
+constexpr Colour garbage_colour = make_colour(0.35f, 0.35f, 0.35f, 1.0f);
+
+Game make_game(i32 width, i32 height, u64 seed) {
+    Game game;
+    game.board = make_board(std::max(width, game_min_width), std::max(height, game_min_height));
+    game.random_state = seed;
+
+    for (auto &kind : game.next_kinds.kinds) kind = (u8)(game_random(game) % tetromino_kinds);
+    next_tetromino(game);
+
+    return game;
+}
+
+void copy_game(Game &to, const Game &from) {
+    constexpr auto items_begin = offsetof(Game, locked_in) + offsetof(decltype(Game::locked_in), items);
+    constexpr auto items_end = items_begin + sizeof(Game::locked_in.items);
+
+    auto to_bytes = (u8 *)&to;
+    auto from_bytes = (const u8 *)&from;
+    std::memcpy(to_bytes, from_bytes, items_begin);
+    std::memcpy(to_bytes + items_begin, from_bytes + items_begin, from.locked_in.size() * sizeof(LockedIn));
+    std::memcpy(to_bytes + items_end, from_bytes + items_end, sizeof(Game) - items_end);
+}
+
+// Any state is valid, so a snapshot can restore it verbatim.
+u32 game_random(Game &game) {
+    return (u32)(random_next(&game.random_state) >> 32);
+}
+
+// Super Rotation System
+
+enum class KickTable : u8 {
+    jlstz,
+    i,
+};
+
+struct TetrominoDefinition {
+    i32 box_size = 3;
+    Coordinate pieces[tetromino_max_pieces] = {}; // As spawned, y down.
+    KickTable kicks = KickTable::jlstz;
+};
+
+// Kinds 5 and 6 repeat T and Z, as they always have.
+constexpr TetrominoDefinition tetromino_definitions[tetromino_kinds] = {
+    {4, {{0, 1}, {1, 1}, {2, 1}, {3, 1}}, KickTable::i}, // I
+    {3, {{1, 0}, {0, 1}, {1, 1}, {2, 1}}, KickTable::jlstz}, // T
+    {3, {{2, 0}, {0, 1}, {1, 1}, {2, 1}}, KickTable::jlstz}, // L
+    {3, {{0, 0}, {1, 0}, {1, 1}, {2, 1}}, KickTable::jlstz}, // Z
+    {3, {{1, 0}, {2, 0}, {0, 1}, {1, 1}}, KickTable::jlstz}, // S
+    {3, {{1, 0}, {0, 1}, {1, 1}, {2, 1}}, KickTable::jlstz}, // T
+    {3, {{0, 0}, {1, 0}, {1, 1}, {2, 1}}, KickTable::jlstz}, // Z
+};
+
+// [table][from rotation][direction][test], y up as the tables are usually
+// published.
+constexpr Coordinate tetromino_kick_tables[2][tetromino_rotations][2][tetromino_kick_tests] = {
+    {
+        {{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},  // 0 -> R, 0 -> L
+        {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},       // R -> 2, R -> 0
+        {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},  // 2 -> L, 2 -> R
+        {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}, // L -> 0, L -> 2
+    },
+    {
+        {{{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}, {{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}}}, // 0 -> R, 0 -> L
+        {{{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}}, {{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}}}, // R -> 2, R -> 0
+        {{{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}}, {{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}}}, // 2 -> L, 2 -> R
+        {{{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}}, {{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}}, // L -> 0, L -> 2
+    },
+};
+
+TetrominoPieces tetromino_pieces(u32 kind, u32 rotation) {
+    log_assert(kind < tetromino_kinds && rotation < tetromino_rotations, "No tetromino of kind {} in rotation {}", kind, rotation);
+
+    auto &definition = tetromino_definitions[kind];
+    TetrominoPieces pieces;
+    for (auto piece : definition.pieces) {
+        // A clockwise turn within the box, with y down.
+        for (u32 i = 0; i < rotation; ++i) piece = make_vector2(definition.box_size - 1 - piece.y, piece.x);
+        pieces.push_back(piece);
+    }
+
+    return pieces;
+}
+
+u32 tetromino_turned(u32 rotation, RotationDirection direction) {
+    return (rotation + (direction == RotationDirection::clockwise ? 1 : tetromino_rotations - 1)) % tetromino_rotations;
+}
+
+TetrominoKicks tetromino_kicks(u32 kind, u32 rotation, RotationDirection direction) {
+    auto &tests = tetromino_kick_tables[(usize)tetromino_definitions[kind].kicks][rotation][(usize)direction];
+
+    TetrominoKicks kicks;
+    for (auto test : tests) kicks.push_back(make_vector2(test.x, -test.y));
+    return kicks;
+}
+
+static void spawn_tetromino(Tetromino &tetromino, u32 kind) {
+    tetromino.coordinate = tetromino_spawn;
+    tetromino.last_tick = 0;
+    tetromino.kind = (u8)kind;
+    tetromino.rotation = 0;
+    tetromino.pieces = tetromino_pieces(kind, 0);
+}
+
+u32 peek_next_kind(const Game &game, usize i) {
+    return game.next_kinds.kinds[(game.next_kinds.head + i) % piece_queue_capacity];
+}
+
+void next_tetromino(Game &game) {
+    auto &queue = game.next_kinds;
+    auto &slot = queue.kinds[queue.head];
+    spawn_tetromino(game.tetromino, slot);
+
+    slot = (u8)(game_random(game) % tetromino_kinds);
+    queue.head = (u8)((queue.head + 1) % piece_queue_capacity);
+}
+
+bool hold_tetromino(Game &game) {
+    if (game.state != GameState::playing || game.is_hold_used) return false;
+
+    // The gravity timer carries on rather than restarting.
+    auto kind = game.tetromino.kind;
+    auto last_tick = game.tetromino.last_tick;
+    if (game.has_held) {
+        spawn_tetromino(game.tetromino, game.held_kind);
+    } else {
+        next_tetromino(game);
+    }
+    game.tetromino.last_tick = last_tick;
+
+    game.held_kind = kind;
+    game.has_held = true;
+    game.is_hold_used = true;
+    return true;
+}
+
+bool tetromino_fits(Tetromino &tetromino, Coordinate target, Board &board) {
+    auto tetromino_target = tetromino.coordinate + target;
+    return board_fits(board, tetromino_target, tetromino.pieces);
+}
+
+i32 tetromino_drop_distance(Tetromino &tetromino, Board &board) {
+    return board_drop_distance(board, tetromino.coordinate, tetromino.pieces);
+}
+
+bool rotate_tetromino(Tetromino &tetromino, Board &board, RotationDirection direction) {
+    auto rotation = tetromino_turned(tetromino.rotation, direction);
+    auto pieces = tetromino_pieces(tetromino.kind, rotation);
+    auto mask = board_piece_mask(pieces);
+
+    for (auto kick : tetromino_kicks(tetromino.kind, tetromino.rotation, direction)) {
+        auto box = tetromino.coordinate + kick;
+        if (board_fits_mask(board, box, mask)) {
+            tetromino.coordinate = box;
+            tetromino.pieces = pieces;
+            tetromino.rotation = (u8)rotation;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void lock_tetromino(Game &game) {
+    for (auto &piece : game.tetromino.pieces) {
+        LockedIn locked;
+        locked.coordinate = game.tetromino.coordinate + piece;
+        locked.colour = make_colour(0.2f, 0.1f, 0.3f, 1.0f);
+        game.locked_in.push_back(locked);
+        board_add(game.board, locked.coordinate);
+        game.score += 1; // +1 score for every piece locked in.
+    }
+
+    game.events.pieces_locked += 1;
+    game.is_hold_used = false;
+
+    next_tetromino(game);
+}
+
+void check_lines(Game &game) {
+    // Check if you can clear any lines
+    auto lines_cleared_so_far = 0;
+    for (int y = game.board.height - 1; y >= 0; --y) {
+        if (board_is_row_full(game.board, y)) {
+            auto is_new = false;
+            for (auto &locked : game.locked_in) {
+                if (locked.coordinate.y == y && !locked.is_clearing) {
+                    locked.is_clearing = true;
+                    locked.clear_t = 0.0f;
+                    is_new = true;
+                    game.events.clearing_rows |= 1u << y;
+                }
+            }
+
+            // A row stays full until its clear animation ends; count it once.
+            if (!is_new) continue;
+
+            lines_cleared_so_far += 1;
+            game.score += (u32)(game.board.width * 10 * lines_cleared_so_far);
+        }
+    }
+
+    game.events.lines_cleared += (u32)lines_cleared_so_far;
+
+    // Check if the game is over
+    for (auto &locked : game.locked_in) {
+        if (locked.coordinate.y == 0) {
+            if (game.state != GameState::game_over) game.events.is_game_over = true;
+            game.state = GameState::game_over;
+        }
+    }
+}
+
+void add_garbage_lines(Game &game, u32 lines, i32 hole_x) {
+    if (lines == 0 || game.state != GameState::playing) return;
+
+    auto &board = game.board;
+    auto rows = std::min((i32)lines, board.height);
+
+    // Anything pushed off the top is gone, and the game with it.
+    auto is_pushed_out = false;
+    for (auto it = game.locked_in.begin(); it != game.locked_in.end();) {
+        it->coordinate.y -= rows;
+        if (it->coordinate.y < 0) {
+            is_pushed_out = true;
+            it = game.locked_in.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto y = board.height - rows; y < board.height; ++y) {
+        for (auto x = 0; x < board.width; ++x) {
+            if (x == hole_x) continue;
+
+            LockedIn locked;
+            locked.coordinate = make_vector2(x, y);
+            locked.colour = garbage_colour;
+            game.locked_in.push_back(locked);
+        }
+    }
+
+    board_clear(board);
+    for (auto &locked : game.locked_in) {
+        if (locked.coordinate.y <= 0) is_pushed_out = true;
+        if (board_is_in_bounds(board, locked.coordinate)) board_add(board, locked.coordinate);
+    }
+
+    // The falling piece rides up with the stack rather than being buried in it.
+    auto &tetromino = game.tetromino;
+    for (auto i = 0; i < rows && !tetromino_fits(tetromino, make_vector2(0, 0), board); ++i) {
+        tetromino.coordinate.y -= 1;
+    }
+    if (!tetromino_fits(tetromino, make_vector2(0, 0), board)) is_pushed_out = true;
+
+    if (is_pushed_out) {
+        game.events.is_game_over = true;
+        game.state = GameState::game_over;
+    }
+}
+
+void try_to_move_tetromino(Game &game, u32 now) {
+    auto &tetromino = game.tetromino;
+    auto drop_offset = make_vector2(0, 1);
+    auto can_drop = tetromino_fits(tetromino, drop_offset, game.board);
+
+    game.time = now;
+
+    if ((float)(now - tetromino.last_tick) > game.frame_time * 1000.0f) {
+        log_trace("Gravity tick at {} ms: piece at ({}, {}), can drop: {}", now, tetromino.coordinate.x, tetromino.coordinate.y, can_drop);
+
+        if (!can_drop) {
+            lock_tetromino(game);
+        } else {
+            tetromino.coordinate += drop_offset;
+            game.score += 1; // +1 score for every time the tetromino moves down.
+        }
+
+        tetromino.last_tick = now;
+
+        check_lines(game);
+    }
+}
+
+bool apply_input_command(Game &game, const InputCommand &command) {
+    auto &tetromino = game.tetromino;
+
+    if (command.action == InputAction::soft_drop) {
+        game.frame_time = command.is_pressed ? default_frame_time / speed_up_factor : default_frame_time;
+        return false;
+    }
+
+    if (!command.is_pressed || game.state != GameState::playing) {
+        return false;
+    }
+
+    switch (command.action) {
+    case InputAction::move_left: {
+        tetromino.coordinate.x -= 1;
+        if (!tetromino_fits(tetromino, make_vector2(0, 0), game.board)) {
+            tetromino.coordinate.x += 1;
+            return false;
+        }
+        return true;
+    } break;
+
+    case InputAction::move_right: {
+        tetromino.coordinate.x += 1;
+        if (!tetromino_fits(tetromino, make_vector2(0, 0), game.board)) {
+            tetromino.coordinate.x -= 1;
+            return false;
+        }
+        return true;
+    } break;
+
+    case InputAction::rotate: {
+        // The one rotate key has always turned pieces counter-clockwise.
+        return rotate_tetromino(tetromino, game.board, RotationDirection::counter_clockwise);
+    } break;
+
+    case InputAction::hard_drop: {
+        auto distance = tetromino_drop_distance(tetromino, game.board);
+        tetromino.coordinate.y += distance;
+        game.score += (u32)distance; // +1 score for every row dropped, same as gravity.
+
+        game.events.hard_drops += 1;
+        game.events.hard_dropped = tetromino;
+        game.events.hard_drop_distance = distance;
+
+        lock_tetromino(game);
+        tetromino.last_tick = command.timestamp;
+        check_lines(game);
+        return true;
+    } break;
+
+    case InputAction::hold: {
+        return hold_tetromino(game);
+    } break;
+
+    case InputAction::soft_drop:
+    case InputAction::count: {
+    } break;
+    }
+
+    return false;
+}
+
+void update_animations(Game &game, f32 delta_time) {
+    auto &locked_in = game.locked_in;
+    auto &board = game.board;
+
+    // Update the clear time
+    // clear_t += delta_time;
+    FixedVec<i32, board_max_height> lines_cleared = {};
+    for (auto it = locked_in.begin(); it != locked_in.end();) {
+        if (it->is_clearing) {
+            if (it->clear_t < clear_animation_time) {
+                it->clear_t += delta_time;
+                ++it;
+            } else {
+                if (lines_cleared.end() == std::find(lines_cleared.begin(), lines_cleared.end(), it->coordinate.y)) {
+                    lines_cleared.push_back(it->coordinate.y);
+                }
+
+                board_remove(board, it->coordinate);
+                it = locked_in.erase(it);
+            }
+        }
+        else if (it->is_dropping) {
+            if (it->drop_t < drop_animation_time) {
+                it->drop_t += delta_time;
+                ++it;
+            }
+            else {
+                board_remove(board, it->coordinate);
+                it->coordinate.y += 1;
+                board_add(board, it->coordinate);
+
+                // One row per animation, so a multi-line clear drops in steps.
+                it->drop_rows = (u8)(it->drop_rows - 1);
+                it->drop_t = 0.0f;
+                it->is_dropping = it->drop_rows > 0;
+
+                ++it;
+            }
+        }
+        else {
+            ++it;
+        }
+    }
+
+    // Move the lines down, a row for every line cleared below.
+    for (auto &line : lines_cleared) {
+        for (auto &locked : locked_in) {
+            if (locked.coordinate.y < line) {
+                locked.drop_rows = (u8)(locked.drop_rows + 1);
+                if (!locked.is_dropping) {
+                    locked.is_dropping = true;
+                    locked.drop_t = 0.0f;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "board.h"
+#include "core.h"
+#include "input.h"
+
+// 8-bit RGBA packed as 0xRRGGBBAA, the form SDL draws with. make_colour is
+// constexpr, so colour constants are converted once at compile time instead
+// of on every tile drawn.
+struct Colour {
+    u32 rgba = 0;
+
+    friend constexpr bool operator==(Colour, Colour) = default;
+};
+
+constexpr u8 colour_channel(f32 value) {
+    if (!(value > 0.0f)) return 0;
+    if (value >= 1.0f) return 255;
+    return (u8)(value * 255.0f + 0.5f);
+}
+
+constexpr Colour make_colour(u8 r, u8 g, u8 b, u8 a) {
+    Colour colour;
+    colour.rgba = (u32)r << 24 | (u32)g << 16 | (u32)b << 8 | (u32)a;
+    return colour;
+}
+
+constexpr Colour make_colour(f32 r, f32 g, f32 b, f32 a) {
+    return make_colour(colour_channel(r), colour_channel(g), colour_channel(b), colour_channel(a));
+}
+
+constexpr Colour make_colour(Vector4<f32> rgba) {
+    return make_colour(rgba.x, rgba.y, rgba.z, rgba.w);
+}
+
+constexpr u8 colour_r(Colour colour) { return (u8)(colour.rgba >> 24); }
+constexpr u8 colour_g(Colour colour) { return (u8)(colour.rgba >> 16); }
+constexpr u8 colour_b(Colour colour) { return (u8)(colour.rgba >> 8); }
+constexpr u8 colour_a(Colour colour) { return (u8)colour.rgba; }
+
+// For blending, where 8 bits per channel is too coarse.
+constexpr Vector4<f32> colour_to_vector4(Colour colour) {
+    return make_vector4(colour_r(colour) / 255.0f, colour_g(colour) / 255.0f, colour_b(colour) / 255.0f, colour_a(colour) / 255.0f);
+}
+
+static_assert(make_colour(1.0f, 0.5f, 0.0f, 1.0f).rgba == 0xFF8000FF);
+
+struct Tetromino {
+    Coordinate coordinate = {}; // Top left of the box the piece turns in.
+    TetrominoPieces pieces = {};
+
+    u8 kind = 0;
+    u8 rotation = 0; // 0 as spawned, then 1 to 3 a clockwise turn each (SRS 0, R, 2, L).
+
+    u32 last_tick = 0;
+};
+
+enum class RotationDirection : u8 {
+    clockwise,
+    counter_clockwise,
+};
+
+struct LockedIn {
+    Coordinate coordinate = {};
+    Colour colour = {};
+
+    f32 clear_t = 0.0f;
+    f32 drop_t = 0.0f;
+    u8 drop_rows = 0; // Still to fall while dropping, one per drop animation.
+
+    bool is_clearing = false;
+    bool is_dropping = false;
+};
+
+// Every cell, plus a row for pieces that have moved onto a cell another
+// piece hasn't left yet during the drop animation.
+constexpr usize game_max_locked_in = board_max_cells + board_max_width;
+
+enum class GameState : u8 {
+  playing,
+  game_over,
+};
+
+constexpr f32 default_frame_time = 1.0f;
+constexpr f32 speed_up_factor = 4.0f;
+
+constexpr f32 clear_animation_time = default_frame_time * 0.5f;
+constexpr f32 drop_animation_time = clear_animation_time * 0.5f;
+
+// The kinds coming up after the falling piece, in a ring that is always
+// full, so taking the next kind replaces it in place with a new one from the
+// generator. How many of them are shown is up to the caller, so it doesn't
+// change the sequence.
+constexpr usize piece_queue_capacity = 6;
+
+struct PieceQueue {
+    u8 kinds[piece_queue_capacity] = {};
+    u8 head = 0; // The next kind out.
+};
+
+// What happened since the caller last reset them, for telemetry, sounds and
+// effects. Not saved in snapshots.
+struct GameEvents {
+    u32 pieces_locked = 0;
+    u32 lines_cleared = 0;
+    bool is_game_over = false;
+
+    u32 clearing_rows = 0; // Bit y for each row that started its clear animation.
+
+    // The last hard drop, where it landed and how far it fell.
+    u32 hard_drops = 0;
+    Tetromino hard_dropped = {};
+    i32 hard_drop_distance = 0;
+};
+
+static_assert(board_max_height <= 32, "GameEvents::clearing_rows has a bit per row");
+
+// Everything needed to resume a game. Times are in ms of simulated time, so a
+// game can be saved in one session and continued in another.
+//
+// A Game owns no memory outside itself, so saving and restoring one is a
+// plain copy; rollback.h does that every tick.
+struct Game {
+    Board board = {};
+    FixedVec<LockedIn, game_max_locked_in> locked_in = {};
+    Tetromino tetromino = {};
+    PieceQueue next_kinds = {};
+
+    u8 held_kind = 0;
+    bool has_held = false;
+    bool is_hold_used = false; // Once per piece, until it locks.
+
+    GameState state = GameState::playing;
+    u32 score = 0;
+
+    u64 random_state = 0;
+
+    u32 time = 0;
+    f32 frame_time = default_frame_time; // Seconds between gravity steps.
+
+    GameEvents events = {};
+};
+
+static_assert(std::is_trivially_copyable_v<Game> && std::is_standard_layout_v<Game>);
+
+// Pieces spawn with their 4 x 4 box at x 3, y 0, so a game's board is at
+// least this big. make_game widens anything smaller, and make_board clamps
+// anything over board_max_width x board_max_height.
+constexpr i32 game_min_width = 7;
+constexpr i32 game_min_height = 4;
+
+Game make_game(i32 width, i32 height, u64 seed);
+
+// Same as `to = from`, but skips the unused end of locked_in, which is most
+// of a Game until the board fills up.
+void copy_game(Game &to, const Game &from);
+
+u32 game_random(Game &game);
+
+// New pieces are picked by kind, from 0 to tetromino_kinds - 1, and start in
+// rotation 0 with their box at tetromino_spawn. Pieces turn by the Super
+// Rotation System: each rotation is the spawn shape turned within its box,
+// and a turn that collides tries the kick offsets for its piece and
+// transition in order, taking the first that fits.
+constexpr u32 tetromino_kinds = 7;
+constexpr u32 tetromino_rotations = 4;
+constexpr usize tetromino_kick_tests = 5;
+constexpr Coordinate tetromino_spawn = make_vector2(3, 0);
+
+using TetrominoKicks = FixedVec<Coordinate, tetromino_kick_tests>;
+
+TetrominoPieces tetromino_pieces(u32 kind, u32 rotation);
+u32 tetromino_turned(u32 rotation, RotationDirection direction);
+
+// Offsets of the box, y down, for turning from `rotation` in `direction`.
+TetrominoKicks tetromino_kicks(u32 kind, u32 rotation, RotationDirection direction);
+
+// `i` 0 is the kind the next piece will be.
+u32 peek_next_kind(const Game &game, usize i);
+
+void next_tetromino(Game &game);
+
+// Swaps the falling piece for the held one, or for the next piece if nothing
+// is held yet; either comes in as if just spawned. Returns false if a hold
+// was already used on this piece.
+bool hold_tetromino(Game &game);
+bool tetromino_fits(Tetromino &tetromino, Coordinate target, Board &board);
+i32  tetromino_drop_distance(Tetromino &tetromino, Board &board);
+bool rotate_tetromino(Tetromino &tetromino, Board &board, RotationDirection direction);
+
+void lock_tetromino(Game &game);
+void check_lines(Game &game);
+void try_to_move_tetromino(Game &game, u32 now);
+
+// Pushes the stack up and fills the bottom `lines` rows with garbage, leaving
+// a gap at `hole_x`. Anything pushed to the top row ends the game.
+void add_garbage_lines(Game &game, u32 lines, i32 hole_x);
+
+// Returns true if the command changed what will be drawn. The command's
+// timestamp must already be in simulated time.
+bool apply_input_command(Game &game, const InputCommand &command);
+
+void update_animations(Game &game, f32 delta_time);
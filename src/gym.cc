@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "gym.h"
+#include "versus.h"
+
+constexpr u32 gym_info_size = 3;
+
+struct GymGame {
+    Game game = {};
+    u32 tick = 0;
+    u64 random_state = 0; // Seeds for the games after this one.
+};
+
+// The arguments of the step being run, shared with the workers.
+struct GymStep {
+    const u8 *actions = nullptr;
+    f32 *observations = nullptr;
+    f32 *rewards = nullptr;
+    u8 *dones = nullptr;
+};
+
+struct MetrisGym {
+    Vec<GymGame> games = {};
+    i32 width = 0;
+    i32 height = 0;
+    u32 observation_size = 0;
+
+    GymStep step = {};
+
+    // Worker w steps slice w + 1; the caller steps slice 0.
+    Vec<std::thread> workers = {};
+    std::mutex mutex = {};
+    std::condition_variable wake = {};
+    std::condition_variable finished = {};
+    u64 generation = 0; // Bumped for every step.
+    u32 busy = 0;       // Workers still on the current step.
+    bool is_stopping = false;
+};
+
+constexpr VersusInput gym_action_inputs[METRIS_GYM_ACTION_COUNT] = {
+    0,
+    1 << (u8)InputAction::move_left,
+    1 << (u8)InputAction::move_right,
+    1 << (u8)InputAction::rotate,
+    versus_soft_drop_bit,
+    1 << (u8)InputAction::hard_drop,
+};
+
+static void start_game(const MetrisGym &gym, GymGame &game) {
+    game.game = make_game(gym.width, gym.height, random_next(&game.random_state));
+    game.tick = 0;
+}
+
+static void write_observation(const MetrisGym &gym, const Game &game, f32 *out) {
+    auto cells = out;
+    auto piece = out + gym.width * gym.height;
+    auto info = piece + gym.width * gym.height;
+
+    for (i32 y = 0; y < gym.height; ++y) {
+        for (i32 x = 0; x < gym.width; ++x) {
+            cells[y * gym.width + x] = board_is_occupied(game.board, make_vector2(x, y)) ? 1.0f : 0.0f;
+        }
+    }
+
+    std::fill(piece, piece + gym.width * gym.height, 0.0f);
+    auto &tetromino = game.tetromino;
+    for (auto offset : tetromino.pieces) {
+        auto cell = tetromino.coordinate + offset;
+        if (board_is_in_bounds(game.board, cell)) piece[cell.y * gym.width + cell.x] = 1.0f;
+    }
+
+    info[0] = (f32)tetromino.coordinate.x;
+    info[1] = (f32)tetromino.coordinate.y;
+    info[2] = (f32)board_drop_distance(game.board, tetromino.coordinate, tetromino.pieces);
+}
+
+static usize slice_begin(const MetrisGym &gym, usize slice) {
+    return gym.games.size() * slice / (gym.workers.size() + 1);
+}
+
+static void step_slice(MetrisGym &gym, usize slice) {
+    auto &step = gym.step;
+    for (auto i = slice_begin(gym, slice); i < slice_begin(gym, slice + 1); ++i) {
+        auto &game = gym.games[i];
+        auto score = game.game.score;
+
+        auto action = step.actions[i];
+        game.tick += 1;
+        versus_step_game(game.game, action < METRIS_GYM_ACTION_COUNT ? gym_action_inputs[action] : 0, game.tick * versus_tick_ms);
+
+        step.rewards[i] = (f32)(game.game.score - score);
+        step.dones[i] = game.game.state != GameState::playing;
+        if (step.dones[i]) start_game(gym, game);
+
+        write_observation(gym, game.game, step.observations + i * gym.observation_size);
+    }
+}
+
+static void worker_thread(MetrisGym *gym, usize slice) {
+    u64 generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(gym->mutex);
+            gym->wake.wait(lock, [&] { return gym->is_stopping || gym->generation != generation; });
+            if (gym->is_stopping) return;
+            generation = gym->generation;
+        }
+
+        step_slice(*gym, slice);
+
+        std::lock_guard lock(gym->mutex);
+        gym->busy -= 1;
+        if (gym->busy == 0) gym->finished.notify_one();
+    }
+}
+
+MetrisGym *metris_gym_create(uint32_t count, int32_t width, int32_t height, uint32_t thread_count) {
+    if (count == 0 || width < game_min_width || width > board_max_width || height < game_min_height || height > board_max_height) return nullptr;
+
+    if (thread_count == 0) thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    thread_count = std::min(thread_count, count);
+
+    auto gym = new MetrisGym();
+    gym->games.resize(count);
+    gym->width = width;
+    gym->height = height;
+    gym->observation_size = (u32)(2 * width * height) + gym_info_size;
+
+    for (usize slice = 1; slice < thread_count; ++slice) {
+        gym->workers.push_back(std::thread(worker_thread, gym, slice));
+    }
+
+    metris_gym_reset(gym, 0, nullptr);
+    return gym;
+}
+
+void metris_gym_destroy(MetrisGym *gym) {
+    if (!gym) return;
+
+    {
+        std::lock_guard lock(gym->mutex);
+        gym->is_stopping = true;
+    }
+    gym->wake.notify_all();
+    for (auto &worker : gym->workers) worker.join();
+
+    delete gym;
+}
+
+uint32_t metris_gym_count(const MetrisGym *gym) {
+    return (u32)gym->games.size();
+}
+
+uint32_t metris_gym_observation_size(const MetrisGym *gym) {
+    return gym->observation_size;
+}
+
+void metris_gym_reset(MetrisGym *gym, uint64_t seed, float *observations) {
+    for (usize i = 0; i < gym->games.size(); ++i) {
+        auto &game = gym->games[i];
+        game.random_state = seed * 0x9E3779B97F4A7C15ull + i;
+        start_game(*gym, game);
+        if (observations) write_observation(*gym, game.game, observations + i * gym->observation_size);
+    }
+}
+
+void metris_gym_step(MetrisGym *gym, const uint8_t *actions, float *observations, float *rewards, uint8_t *dones) {
+    gym->step.actions = actions;
+    gym->step.observations = observations;
+    gym->step.rewards = rewards;
+    gym->step.dones = dones;
+
+    {
+        std::lock_guard lock(gym->mutex);
+        gym->generation += 1;
+        gym->busy = (u32)gym->workers.size();
+    }
+    gym->wake.notify_all();
+
+    step_slice(*gym, 0);
+
+    std::unique_lock lock(gym->mutex);
+    gym->finished.wait(lock, [&] { return gym->busy == 0; });
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+// Gym
+//
+// A batch of single player games behind a C API, for training agents (see
+// python/metris_gym.py for the Python side). Every step takes one action per
+// game and runs one fixed tick of each: the action, then gravity, then
+// animations, the same as a versus match does per player (versus_step_game).
+// Games are split across worker threads for the step; the calling thread
+// takes a share too.
+//
+// Observations are written straight into a buffer the caller owns, one row
+// of metris_gym_observation_size floats per game, nothing allocated per step:
+//
+//   f32 cells[height][width]   1 where the board is occupied
+//   f32 piece[height][width]   1 under the falling piece
+//   f32 piece_x, piece_y       of the falling piece's origin
+//   f32 drop_distance          rows the piece can still fall
+//
+// The reward is the score gained on the step, which counts locks, gravity,
+// drops and cleared lines as the game does. A game that tops out reports
+// done and starts over straight away with the next seed from its own
+// sequence, so the observation returned with done = 1 is already the first
+// one of the new game.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    METRIS_GYM_ACTION_NONE,
+    METRIS_GYM_ACTION_MOVE_LEFT,
+    METRIS_GYM_ACTION_MOVE_RIGHT,
+    METRIS_GYM_ACTION_ROTATE,
+    METRIS_GYM_ACTION_SOFT_DROP, // Held for this tick only.
+    METRIS_GYM_ACTION_HARD_DROP,
+
+    METRIS_GYM_ACTION_COUNT,
+};
+
+typedef struct MetrisGym MetrisGym;
+
+// `thread_count` 0 picks one per hardware thread. Returns NULL if `count` is
+// 0, or the board is narrower than the 7 columns pieces spawn across or
+// larger than the game supports.
+MetrisGym *metris_gym_create(uint32_t count, int32_t width, int32_t height, uint32_t thread_count);
+void metris_gym_destroy(MetrisGym *gym);
+
+uint32_t metris_gym_count(const MetrisGym *gym);
+uint32_t metris_gym_observation_size(const MetrisGym *gym);
+
+// Starts every game over. Game i's piece sequence, and those of the games
+// it goes on to play, follow from `seed` and i.
+void metris_gym_reset(MetrisGym *gym, uint64_t seed, float *observations);
+
+// `actions` holds one METRIS_GYM_ACTION_* per game; anything else is treated
+// as none. `rewards` and `dones` get one entry per game.
+void metris_gym_step(MetrisGym *gym, const uint8_t *actions, float *observations, float *rewards, uint8_t *dones);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "core.h"
+
+// Hash table
+//
+// An open-addressing hash map in the style of Swiss tables. Entries live in
+// one flat array next to an array of one-byte control codes: empty, deleted,
+// or the low 7 bits of the entry's hash. Lookups scan the control bytes of a
+// 16-slot group at a time (one SSE2 compare where available) and only touch
+// entries whose 7 hash bits match, so a lookup is usually one or two cache
+// lines and no pointer chasing.
+//
+// Unlike Table (std::map) iteration order is unspecified, and inserting or
+// erasing invalidates pointers to entries. Memory comes from a std::pmr
+// memory resource, so a table can live in an arena (see MemoryArenaResource).
+
+constexpr usize hash_table_group_size = 16;
+
+constexpr i8 hash_table_empty = -128;  // 0b10000000
+constexpr i8 hash_table_deleted = -2;  // 0b11111110
+
+template <typename K, typename V>
+struct HashTableEntry {
+  K key;
+  V value;
+};
+
+template <typename K, typename V, typename Hash = std::hash<K>>
+struct HashTable {
+  using Entry = HashTableEntry<K, V>;
+
+  HashTable() = default;
+  explicit HashTable(std::pmr::memory_resource* resource) : resource(resource) {}
+
+  HashTable(const HashTable& other) : resource(other.resource) {
+    reserve(other.count);
+    for (auto& entry : other) insert(entry.key, entry.value);
+  }
+
+  HashTable(HashTable&& other) noexcept { swap(other); }
+
+  HashTable& operator=(HashTable other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~HashTable() {
+    destroy_entries();
+    release();
+  }
+
+  usize size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  V* find(const K& key) {
+    auto index = find_index(key);
+    return index == capacity ? nullptr : &entries[index].value;
+  }
+
+  const V* find(const K& key) const {
+    return const_cast<HashTable*>(this)->find(key);
+  }
+
+  bool contains(const K& key) const { return find(key) != nullptr; }
+
+  // Returns true if the key was new; an existing value is overwritten.
+  template <typename KeyArg, typename ValueArg>
+  bool insert(KeyArg&& key, ValueArg&& value) {
+    auto [index, is_new] = find_or_prepare(key);
+    if (is_new) {
+      new (&entries[index]) Entry{K(std::forward<KeyArg>(key)), V(std::forward<ValueArg>(value))};
+    } else {
+      entries[index].value = std::forward<ValueArg>(value);
+    }
+    return is_new;
+  }
+
+  // Value-initialises the value if the key is new.
+  V& operator[](const K& key) {
+    auto [index, is_new] = find_or_prepare(key);
+    if (is_new) {
+      new (&entries[index]) Entry{key, V{}};
+    }
+    return entries[index].value;
+  }
+
+  bool erase(const K& key) {
+    auto index = find_index(key);
+    if (index == capacity) return false;
+
+    entries[index].~Entry();
+    count -= 1;
+
+    // A probe only moves past a group that has no empty slot. If this group
+    // already has one, no probe can be relying on this slot being full, so it
+    // can go straight back to empty instead of leaving a tombstone.
+    auto group = index & ~(hash_table_group_size - 1);
+    if (match_byte(group, hash_table_empty) != 0) {
+      control[index] = hash_table_empty;
+    } else {
+      control[index] = hash_table_deleted;
+      tombstones += 1;
+    }
+    return true;
+  }
+
+  void clear() {
+    destroy_entries();
+    for (usize i = 0; i < capacity; ++i) control[i] = hash_table_empty;
+    count = 0;
+    tombstones = 0;
+  }
+
+  // Makes room for `n` entries without rehashing.
+  void reserve(usize n) {
+    auto needed = hash_table_group_size;
+    while (needed * 7 / 8 < n) needed *= 2;
+    if (needed > capacity) rehash(needed);
+  }
+
+  struct Iterator {
+    const HashTable* table = nullptr;
+    usize index = 0;
+
+    Entry& operator*() const { return table->entries[index]; }
+    Entry* operator->() const { return &table->entries[index]; }
+
+    Iterator& operator++() {
+      index = table->next_full(index + 1);
+      return *this;
+    }
+
+    bool operator==(const Iterator& other) const { return index == other.index; }
+  };
+
+  Iterator begin() const { return Iterator{this, next_full(0)}; }
+  Iterator end() const { return Iterator{this, capacity}; }
+
+private:
+  std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+  i8*    control = nullptr;
+  Entry* entries = nullptr;
+  usize  capacity = 0; // 0 or a power of two, at least one group.
+  usize  count = 0;
+  usize  tombstones = 0;
+
+  void swap(HashTable& other) {
+    std::swap(resource, other.resource);
+    std::swap(control, other.control);
+    std::swap(entries, other.entries);
+    std::swap(capacity, other.capacity);
+    std::swap(count, other.count);
+    std::swap(tombstones, other.tombstones);
+  }
+
+  static u64 hash_of(const K& key) {
+    // std::hash is the identity for integers on common standard libraries;
+    // mix it so both the group index and the 7 control bits see every bit.
+    auto hash = (u64) Hash{}(key) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+  }
+
+  static i8 control_bits(u64 hash) { return (i8) (hash & 0x7F); }
+
+  // Bit i is set if control byte i of the group at `group` equals `byte`.
+  u32 match_byte(usize group, i8 byte) const {
+#if defined(__SSE2__)
+    auto bytes = _mm_loadu_si128((const __m128i*) (control + group));
+    return (u32) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte)));
+#else
+    u32 mask = 0;
+    for (usize i = 0; i < hash_table_group_size; ++i) {
+      if (control[group + i] == byte) mask |= 1u << i;
+    }
+    return mask;
+#endif
+  }
+
+  // Empty and deleted bytes are the only ones with the top bit set.
+  u32 match_free(usize group) const {
+#if defined(__SSE2__)
+    auto bytes = _mm_loadu_si128((const __m128i*) (control + group));
+    return (u32) _mm_movemask_epi8(bytes);
+#else
+    u32 mask = 0;
+    for (usize i = 0; i < hash_table_group_size; ++i) {
+      if (control[group + i] < 0) mask |= 1u << i;
+    }
+    return mask;
+#endif
+  }
+
+  usize next_full(usize index) const {
+    while (index < capacity && control[index] < 0) ++index;
+    return index;
+  }
+
+  // Groups are probed in triangular steps (+1, +2, +3, ...), which visits every
+  // group exactly once when the group count is a power of two.
+  struct Probe {
+    usize group_mask = 0;
+    usize group_index = 0;
+    usize step = 0;
+
+    usize group() const { return group_index * hash_table_group_size; }
+
+    void next() {
+      step += 1;
+      group_index = (group_index + step) & group_mask;
+    }
+  };
+
+  Probe probe(u64 hash) const {
+    Probe probe;
+    probe.group_mask = capacity / hash_table_group_size - 1;
+    probe.group_index = (usize) (hash >> 7) & probe.group_mask;
+    return probe;
+  }
+
+  // Index of the entry holding `key`, or capacity if there is none.
+  usize find_index(const K& key) const {
+    if (count == 0) return capacity;
+
+    auto hash = hash_of(key);
+    auto bits = control_bits(hash);
+    for (auto p = probe(hash);; p.next()) {
+      auto group = p.group();
+      auto matches = match_byte(group, bits);
+      while (matches) {
+        auto index = group + (usize) __builtin_ctz(matches);
+        if (entries[index].key == key) return index;
+        matches &= matches - 1;
+      }
+
+      // An empty slot ends the probe: an insert would have stopped here.
+      if (match_byte(group, hash_table_empty) != 0) return capacity;
+    }
+  }
+
+  // First empty or deleted slot on the probe sequence for `hash`. The load
+  // factor guarantees there is one.
+  usize find_free(u64 hash) const {
+    for (auto p = probe(hash);; p.next()) {
+      auto free = match_free(p.group());
+      if (free) return p.group() + (usize) __builtin_ctz(free);
+    }
+  }
+
+  // Returns the slot holding `key`, or a free slot claimed for it.
+  std::pair<usize, bool> find_or_prepare(const K& key) {
+    auto existing = find_index(key);
+    if (existing != capacity) return {existing, false};
+
+    // At most 7/8 full, counting tombstones. If live entries are under half of
+    // that the table is mostly tombstones, so rebuild at the same size.
+    if (count + tombstones + 1 > capacity * 7 / 8) {
+      auto grow = count + 1 > capacity * 7 / 16;
+      rehash(capacity == 0 ? hash_table_group_size : grow ? capacity * 2 : capacity);
+    }
+
+    auto hash = hash_of(key);
+    auto index = find_free(hash);
+
+    if (control[index] == hash_table_deleted) tombstones -= 1;
+    control[index] = control_bits(hash);
+    count += 1;
+    return {index, true};
+  }
+
+  // Control bytes and entries share one allocation: control bytes first, then
+  // the entries at their own alignment.
+  static constexpr usize allocation_alignment = alignof(Entry) > 16 ? alignof(Entry) : 16;
+
+  static usize entries_offset(usize capacity) {
+    return (capacity + alignof(Entry) - 1) & ~(alignof(Entry) - 1);
+  }
+
+  static usize allocation_size(usize capacity) {
+    return entries_offset(capacity) + capacity * sizeof(Entry);
+  }
+
+  void rehash(usize new_capacity) {
+    auto old_control = control;
+    auto old_entries = entries;
+    auto old_capacity = capacity;
+
+    auto memory = (u8*) resource->allocate(allocation_size(new_capacity), allocation_alignment);
+    control = (i8*) memory;
+    entries = (Entry*) (memory + entries_offset(new_capacity));
+    capacity = new_capacity;
+    tombstones = 0;
+    for (usize i = 0; i < capacity; ++i) control[i] = hash_table_empty;
+
+    for (usize i = 0; i < old_capacity; ++i) {
+      if (old_control[i] < 0) continue;
+
+      auto& entry = old_entries[i];
+      auto hash = hash_of(entry.key);
+      auto index = find_free(hash);
+
+      control[index] = control_bits(hash);
+      new (&entries[index]) Entry{std::move(entry)};
+      entry.~Entry();
+    }
+
+    if (old_control) {
+      resource->deallocate(old_control, allocation_size(old_capacity), allocation_alignment);
+    }
+  }
+
+  void destroy_entries() {
+    for (usize i = 0; i < capacity; ++i) {
+      if (control[i] >= 0) entries[i].~Entry();
+    }
+  }
+
+  void release() {
+    if (!control) return;
+
+    resource->deallocate(control, allocation_size(capacity), allocation_alignment);
+    control = nullptr;
+    entries = nullptr;
+    capacity = 0;
+  }
+};
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <bit>
+
+#include "histogram.h"
+
+u32 histogram_bucket_index(u32 value) {
+  if (value < histogram_sub_bucket_count) return value;
+
+  // Keep the top sub_bucket_bits + 1 bits: the leading one picks the power of
+  // two, the rest pick the sub-bucket within it.
+  auto shift = (u32) std::bit_width(value) - 1 - histogram_sub_bucket_bits;
+  auto sub_bucket = (value >> shift) - histogram_sub_bucket_count;
+  return (shift + 1) * histogram_sub_bucket_count + sub_bucket;
+}
+
+u32 histogram_bucket_lowest(u32 index) {
+  if (index < histogram_sub_bucket_count) return index;
+
+  auto shift = index / histogram_sub_bucket_count - 1;
+  auto sub_bucket = index % histogram_sub_bucket_count;
+  return (histogram_sub_bucket_count + sub_bucket) << shift;
+}
+
+u32 histogram_bucket_highest(u32 index) {
+  if (index < histogram_sub_bucket_count) return index;
+
+  auto shift = index / histogram_sub_bucket_count - 1;
+  return histogram_bucket_lowest(index) + ((1u << shift) - 1);
+}
+
+void histogram_record(Histogram* histogram, u32 value) {
+  histogram->counts[histogram_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  histogram->total_count.fetch_add(1, std::memory_order_relaxed);
+  histogram->total.fetch_add(value, std::memory_order_relaxed);
+
+  auto min = histogram->min.load(std::memory_order_relaxed);
+  while (value < min && !histogram->min.compare_exchange_weak(min, value, std::memory_order_relaxed)) {}
+
+  auto max = histogram->max.load(std::memory_order_relaxed);
+  while (value > max && !histogram->max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+void histogram_reset(Histogram* histogram) {
+  for (auto& count : histogram->counts) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  histogram->total_count.store(0, std::memory_order_relaxed);
+  histogram->total.store(0, std::memory_order_relaxed);
+  histogram->min.store(UINT32_MAX, std::memory_order_relaxed);
+  histogram->max.store(0, std::memory_order_relaxed);
+}
+
+u64 histogram_count(const Histogram& histogram) {
+  return histogram.total_count.load(std::memory_order_relaxed);
+}
+
+f64 histogram_mean(const Histogram& histogram) {
+  auto count = histogram_count(histogram);
+  if (count == 0) return 0.0;
+  return (f64) histogram.total.load(std::memory_order_relaxed) / (f64) count;
+}
+
+u32 histogram_percentile(const Histogram& histogram, f64 percentile) {
+  // Sum the buckets rather than trusting total_count, which a concurrent
+  // writer may have bumped before the bucket itself.
+  u64 count = 0;
+  for (auto& bucket : histogram.counts) {
+    count += bucket.load(std::memory_order_relaxed);
+  }
+  if (count == 0) return 0;
+
+  auto max = histogram.max.load(std::memory_order_relaxed);
+  auto target = (u64) ((f64) count * std::clamp(percentile, 0.0, 100.0) / 100.0 + 0.5);
+  target = std::clamp(target, (u64) 1, count);
+
+  u64 seen = 0;
+  for (u32 i = 0; i < histogram_bucket_count; ++i) {
+    seen += histogram.counts[i].load(std::memory_order_relaxed);
+    if (seen >= target) return std::min(histogram_bucket_highest(i), max);
+  }
+
+  return max;
+}
+
+void histogram_dump(const Histogram& histogram, StringView name, StringView unit, String* out) {
+  auto appender = std::back_inserter(*out);
+  auto count = histogram_count(histogram);
+
+  fmt::format_to(appender, "histogram {} ({})\n", name, unit);
+  fmt::format_to(appender, "count {}\n", count);
+  fmt::format_to(appender, "mean {:.3f}\n", histogram_mean(histogram));
+  fmt::format_to(appender, "min {}\n", count ? histogram.min.load(std::memory_order_relaxed) : 0);
+
+  const f64 percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+  for (auto percentile : percentiles) {
+    fmt::format_to(appender, "p{} {}\n", percentile, histogram_percentile(histogram, percentile));
+  }
+  fmt::format_to(appender, "max {}\n", histogram.max.load(std::memory_order_relaxed));
+
+  for (u32 i = 0; i < histogram_bucket_count; ++i) {
+    auto bucket = histogram.counts[i].load(std::memory_order_relaxed);
+    if (bucket == 0) continue;
+    fmt::format_to(appender, "bucket {} {} {}\n", histogram_bucket_lowest(i), histogram_bucket_highest(i), bucket);
+  }
+
+  out->push_back('\n');
+}
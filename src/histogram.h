@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+
+#include "core.h"
+
+// Histogram
+//
+// A log-linear histogram of u32 values in the style of HdrHistogram. Values
+// below histogram_sub_bucket_count get a bucket each; above that every power
+// of two is split into histogram_sub_bucket_count equal buckets, so any
+// recorded value is reported within 1 / histogram_sub_bucket_count (about 3%)
+// of where it really was, from microseconds up to hours.
+//
+// Recording is a relaxed atomic increment and never blocks, so any thread can
+// record into a histogram that another thread is reading. Readers see a
+// consistent-enough view for display; exact totals need the writers stopped.
+
+constexpr u32 histogram_sub_bucket_bits = 5;
+constexpr u32 histogram_sub_bucket_count = 1u << histogram_sub_bucket_bits;
+constexpr u32 histogram_bucket_count = (32 - histogram_sub_bucket_bits + 1) * histogram_sub_bucket_count;
+
+struct Histogram {
+  std::atomic<u64> counts[histogram_bucket_count] = {};
+
+  std::atomic<u64> total_count = 0;
+  std::atomic<u64> total = 0;
+  std::atomic<u32> min = UINT32_MAX;
+  std::atomic<u32> max = 0;
+};
+
+u32 histogram_bucket_index(u32 value);
+u32 histogram_bucket_lowest(u32 index);
+u32 histogram_bucket_highest(u32 index);
+
+void histogram_record(Histogram* histogram, u32 value);
+void histogram_reset(Histogram* histogram);
+
+u64 histogram_count(const Histogram& histogram);
+f64 histogram_mean(const Histogram& histogram);
+
+// Highest value the given percentage (0 to 100) of recorded values are at or
+// below, clamped to the largest value recorded. 0 if nothing was recorded.
+u32 histogram_percentile(const Histogram& histogram, f64 percentile);
+
+// Appends a text summary and every non-empty bucket. The layout is stable and
+// one fact per line, so dumps from two runs can be diffed or parsed directly.
+void histogram_dump(const Histogram& histogram, StringView name, StringView unit, String* out);
@@ -0,0 +1,153 @@
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+
+#include "input.h"
+
+static bool is_movement(InputAction action) {
+    return action == InputAction::move_left || action == InputAction::move_right;
+}
+
+static InputAction opposite_movement(InputAction action) {
+    return action == InputAction::move_left ? InputAction::move_right : InputAction::move_left;
+}
+
+bool input_handle_event(Input &input, const SDL_Event &event) {
+    if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) {
+        return false;
+    }
+
+    InputAction action;
+    switch (event.key.keysym.sym) {
+    case SDLK_a: action = InputAction::move_left; break;
+    case SDLK_d: action = InputAction::move_right; break;
+    case SDLK_SPACE: action = InputAction::rotate; break;
+    case SDLK_s: action = InputAction::soft_drop; break;
+    case SDLK_w: action = InputAction::hard_drop; break;
+    case SDLK_c: action = InputAction::hold; break;
+    default: return false;
+    }
+
+    // Auto-repeat is generated in input_update, so the OS repeat rate never
+    // decides how fast a piece moves.
+    if (event.key.repeat) {
+        return true;
+    }
+
+    input_push(input, action, event.type == SDL_KEYDOWN, event.key.timestamp);
+    return true;
+}
+
+void input_push(Input &input, InputAction action, bool is_pressed, u32 timestamp) {
+    if (input.queue_count == input_queue_capacity) {
+        log_warning("Input queue is full, dropping the oldest event");
+        std::copy(input.queue + 1, input.queue + input.queue_count, input.queue);
+        input.queue_count -= 1;
+    }
+
+    InputCommand command;
+    command.action = action;
+    command.is_pressed = is_pressed;
+    command.is_repeat = false;
+    command.timestamp = timestamp;
+    input.queue[input.queue_count++] = command;
+}
+
+usize input_update(Input &input, u32 now, InputCommand *commands, usize capacity) {
+    usize count = 0;
+    auto repeat_step = std::max<u32>(input.config.auto_repeat_rate, 1);
+
+    // Only the most recently pressed direction repeats, so holding both keys
+    // doesn't make the piece jitter.
+    auto repeat_until = [&](u32 until) {
+        auto &left = input.keys[(usize)InputAction::move_left];
+        auto &right = input.keys[(usize)InputAction::move_right];
+
+        InputAction action;
+        if (left.is_held && (!right.is_held || left.pressed_at > right.pressed_at)) {
+            action = InputAction::move_left;
+        } else if (right.is_held) {
+            action = InputAction::move_right;
+        } else {
+            return;
+        }
+
+        auto &key = input.keys[(usize)action];
+        while (key.next_repeat_at <= until) {
+            if (count == capacity) {
+                key.next_repeat_at = until + repeat_step;
+                break;
+            }
+
+            InputCommand command;
+            command.action = action;
+            command.is_pressed = true;
+            command.is_repeat = true;
+            command.timestamp = key.next_repeat_at;
+            commands[count++] = command;
+
+            key.next_repeat_at += repeat_step;
+        }
+    };
+
+    std::stable_sort(input.queue, input.queue + input.queue_count,
+                     [](const InputCommand &a, const InputCommand &b) { return a.timestamp < b.timestamp; });
+
+    for (usize i = 0; i < input.queue_count; ++i) {
+        auto command = input.queue[i];
+
+        // Events can carry a timestamp from before the previous update if they
+        // were queued while it ran; never step the simulation backwards.
+        command.timestamp = std::clamp(command.timestamp, input.last_update, now);
+
+        repeat_until(command.timestamp);
+
+        auto &key = input.keys[(usize)command.action];
+        if (command.is_pressed) {
+            if (key.is_held) continue;
+
+            key.is_held = true;
+            key.pressed_at = command.timestamp;
+            key.next_repeat_at = command.timestamp + input.config.delayed_auto_shift;
+        } else {
+            if (!key.is_held) continue;
+
+            key.is_held = false;
+
+            // The other direction takes over again, but has to charge its
+            // delay from scratch instead of firing every repeat it missed.
+            if (is_movement(command.action)) {
+                auto &other = input.keys[(usize)opposite_movement(command.action)];
+                other.next_repeat_at = command.timestamp + input.config.delayed_auto_shift;
+            }
+        }
+
+        if (count < capacity) {
+            commands[count++] = command;
+        }
+    }
+    input.queue_count = 0;
+
+    repeat_until(now);
+    input.last_update = now;
+
+    return count;
+}
+
+void input_mark_applied(Input &input, const InputCommand &command) {
+    if (command.is_repeat || input.latency.is_pending) return;
+
+    input.latency.is_pending = true;
+    input.latency.pending_since = command.timestamp;
+}
+
+void input_mark_presented(Input &input, u32 presented_at) {
+    auto &latency = input.latency;
+    if (!latency.is_pending) return;
+
+    latency.is_pending = false;
+    latency.last = presented_at - latency.pending_since;
+    latency.max = std::max(latency.max, latency.last);
+    latency.samples += 1;
+    latency.average += ((f32)latency.last - latency.average) / (f32)latency.samples;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "core.h"
+
+union SDL_Event;
+
+// Input
+//
+// Key events are queued with their SDL timestamp and turned into commands in
+// timestamp order, so the simulation can apply them at the moment they happened
+// rather than at the start of whichever frame polled them. Held movement keys
+// are repeated internally (DAS/ARR); OS key repeat is ignored.
+
+enum class InputAction : u8 {
+    move_left,
+    move_right,
+    rotate,
+    soft_drop,
+    hard_drop,
+    hold,
+
+    count,
+};
+
+constexpr usize input_action_count = (usize)InputAction::count;
+constexpr usize input_queue_capacity = 64;
+
+struct InputConfig {
+    u32 delayed_auto_shift = 133; // ms a movement key is held before it starts repeating.
+    u32 auto_repeat_rate = 33;    // ms between repeats once the delay has elapsed.
+};
+
+struct InputCommand {
+    InputAction action = InputAction::move_left;
+    bool is_pressed = false;
+    bool is_repeat = false;
+    u32 timestamp = 0; // ms, same timebase as SDL_GetTicks().
+};
+
+struct InputKeyState {
+    bool is_held = false;
+    u32 pressed_at = 0;
+    u32 next_repeat_at = 0;
+};
+
+struct InputLatency {
+    bool is_pending = false;
+    u32 pending_since = 0; // Timestamp of the oldest input not yet on screen.
+
+    u32 last = 0;
+    u32 max = 0;
+    f32 average = 0.0f;
+    u64 samples = 0;
+};
+
+struct Input {
+    InputConfig config = {};
+    InputKeyState keys[input_action_count] = {};
+
+    InputCommand queue[input_queue_capacity] = {};
+    usize queue_count = 0;
+
+    u32 last_update = 0;
+
+    InputLatency latency = {};
+};
+
+// Returns true if the event was a key event this module consumed.
+bool input_handle_event(Input &input, const SDL_Event &event);
+
+void input_push(Input &input, InputAction action, bool is_pressed, u32 timestamp);
+
+// Drains queued key events and generates auto-repeats up to `now`, writing
+// them to `commands` in timestamp order. Returns the number of commands written.
+usize input_update(Input &input, u32 now, InputCommand *commands, usize capacity);
+
+// Call when a command has changed what will be drawn, and once the frame
+// showing it has been presented.
+void input_mark_applied(Input &input, const InputCommand &command);
+void input_mark_presented(Input &input, u32 presented_at);
@@ -0,0 +1,205 @@
+#include <algorithm>
+
+#include "lockstep.h"
+
+static void write_u32(u8* out, u32 value) {
+  for (usize i = 0; i < 4; ++i) out[i] = (u8) (value >> (i * 8));
+}
+
+static u32 read_u32(const u8* in) {
+  u32 value = 0;
+  for (usize i = 0; i < 4; ++i) value |= (u32) in[i] << (i * 8);
+  return value;
+}
+
+Result<LockstepSession, NetError> lockstep_start(const LockstepConfig& config, u64 seed) {
+  NetError error;
+  error.error_kind = NetError::Kind::invalid_config;
+  error.port = config.base_port;
+
+  if (config.player_count < 2 || config.player_count > lockstep_max_players) {
+    log_error("Lockstep needs 2 to {} players, not {}", lockstep_max_players, config.player_count);
+    return Err(error);
+  }
+  if (config.local_player >= config.player_count) {
+    log_error("Local player {} is not one of the {} players", config.local_player, config.player_count);
+    return Err(error);
+  }
+  if (config.input_delay > lockstep_max_input_delay) {
+    log_error("Input delay of {} ticks is longer than the {} the input window allows", config.input_delay, lockstep_max_input_delay);
+    return Err(error);
+  }
+  if ((u32) config.base_port + config.player_count - 1 > UINT16_MAX) {
+    log_error("Base port {} leaves no room for {} players' ports", config.base_port, config.player_count);
+    return Err(error);
+  }
+
+  auto socket = net_open((u16) (config.base_port + config.local_player), config.conditions, seed);
+  if (socket.isErr()) return Err(socket.unwrapErr());
+
+  LockstepSession session;
+  session.config = config;
+  session.socket = std::move(socket).unwrap();
+
+  // Nobody has input for the first input_delay ticks, so they are empty for
+  // everyone and known from the start.
+  for (u32 player = 0; player < config.player_count; ++player) {
+    auto& peer = session.peers[player];
+    auto ip = player == config.local_player ? net_loopback_ip : config.peer_ip;
+    peer.address = make_net_address(ip, (u16) (config.base_port + player));
+    peer.received_until = config.input_delay;
+    peer.acked_until = config.input_delay;
+    peer.ack_sent = config.input_delay;
+    peer.inputs_sent_until = config.input_delay;
+  }
+
+  return Ok(std::move(session));
+}
+
+void lockstep_stop(LockstepSession* session) {
+  net_close(&session->socket);
+  *session = {};
+}
+
+bool lockstep_needs_local_input(const LockstepSession& session) {
+  return session.peers[session.config.local_player].received_until <= session.tick + session.config.input_delay;
+}
+
+void lockstep_add_local_input(LockstepSession* session, u8 input) {
+  if (!lockstep_needs_local_input(*session)) return;
+
+  auto& local = session->peers[session->config.local_player];
+  auto target = session->tick + session->config.input_delay;
+
+  session->inputs[target % lockstep_window][session->config.local_player] = input;
+  local.received_until = target + 1;
+}
+
+static void handle_packet(LockstepSession* session, StringView bytes, NetAddress from) {
+  auto data = (const u8*) bytes.data();
+  if (bytes.size() < lockstep_packet_header_size || data[0] != lockstep_magic) {
+    session->invalid_packets += 1;
+    return;
+  }
+
+  auto player = (u32) data[1];
+  auto ack = read_u32(data + 2);
+  auto first_tick = read_u32(data + 6);
+  auto count = (u32) data[10];
+
+  if (player >= session->config.player_count || player == session->config.local_player ||
+      bytes.size() != lockstep_packet_header_size + count || first_tick + count > session->tick + lockstep_window) {
+    session->invalid_packets += 1;
+    return;
+  }
+
+  // Anyone can send to our port and claim to be any player, so only take
+  // a player's inputs from the address that player listens on.
+  auto& peer = session->peers[player];
+  if (from != peer.address) {
+    session->invalid_packets += 1;
+    return;
+  }
+  peer.acked_until = std::max(peer.acked_until, ack);
+
+  // Inputs only ever extend the run we already have; a packet that starts
+  // past it was overtaken by a loss and the next one will fill the gap.
+  auto end = first_tick + count;
+  if (first_tick > peer.received_until || end <= peer.received_until) return;
+
+  for (auto tick = peer.received_until; tick < end; ++tick) {
+    session->inputs[tick % lockstep_window][player] = data[lockstep_packet_header_size + (tick - first_tick)];
+  }
+  peer.received_until = end;
+}
+
+static void send_inputs(LockstepSession* session, LockstepPeer* peer, u32 received_until, u32 now) {
+  auto local_player = session->config.local_player;
+  auto& local = session->peers[local_player];
+
+  auto first_tick = peer->acked_until;
+  auto count = std::min(local.received_until - first_tick, lockstep_max_inputs_per_packet);
+
+  u8 packet[lockstep_packet_header_size + lockstep_max_inputs_per_packet];
+  packet[0] = lockstep_magic;
+  packet[1] = (u8) local_player;
+  write_u32(packet + 2, received_until);
+  write_u32(packet + 6, first_tick);
+  packet[10] = (u8) count;
+  for (u32 i = 0; i < count; ++i) {
+    packet[lockstep_packet_header_size + i] = session->inputs[(first_tick + i) % lockstep_window][local_player];
+  }
+
+  net_send(&session->socket, peer->address, StringView((const char*) packet, lockstep_packet_header_size + count), now);
+
+  peer->ack_sent = received_until;
+  peer->inputs_sent_until = first_tick + count;
+  peer->last_sent = now;
+}
+
+void lockstep_poll(LockstepSession* session, u32 now) {
+  net_flush(&session->socket, now);
+
+  String bytes;
+  NetAddress from;
+  while (net_receive(&session->socket, &bytes, &from)) {
+    handle_packet(session, bytes, from);
+  }
+
+  auto& local = session->peers[session->config.local_player];
+  for (u32 player = 0; player < session->config.player_count; ++player) {
+    if (player == session->config.local_player) continue;
+
+    // New inputs go out right away. Acks and repeats of unacknowledged
+    // inputs wait to ride along with them, unless that takes too long.
+    auto& peer = session->peers[player];
+    auto has_new_inputs = local.received_until > peer.inputs_sent_until;
+    auto has_anything = peer.received_until != peer.ack_sent || peer.acked_until < local.received_until;
+    auto is_due = now - peer.last_sent >= session->config.resend_interval;
+
+    if (has_new_inputs || (has_anything && is_due)) {
+      send_inputs(session, &peer, peer.received_until, now);
+    }
+  }
+}
+
+bool lockstep_advance(LockstepSession* session, u8* inputs) {
+  if (lockstep_waiting_for(*session) != session->config.player_count) {
+    session->stalled_polls += 1;
+    return false;
+  }
+
+  auto slot = session->tick % lockstep_window;
+  for (u32 player = 0; player < session->config.player_count; ++player) {
+    inputs[player] = session->inputs[slot][player];
+  }
+
+  session->tick += 1;
+  return true;
+}
+
+u32 lockstep_confirmed_until(const LockstepSession& session) {
+  auto confirmed = session.peers[0].received_until;
+  for (u32 player = 1; player < session.config.player_count; ++player) {
+    confirmed = std::min(confirmed, session.peers[player].received_until);
+  }
+
+  return confirmed;
+}
+
+u8 lockstep_input(const LockstepSession& session, u32 tick, u32 player) {
+  log_assert(tick < session.peers[player].received_until && tick + lockstep_window > session.tick, "Input for tick {} of player {} is not known", tick, player);
+  return session.inputs[tick % lockstep_window][player];
+}
+
+void lockstep_step(LockstepSession* session) {
+  session->tick += 1;
+}
+
+u32 lockstep_waiting_for(const LockstepSession& session) {
+  for (u32 player = 0; player < session.config.player_count; ++player) {
+    if (session.peers[player].received_until <= session.tick) return player;
+  }
+
+  return session.config.player_count;
+}
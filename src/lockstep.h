@@ -0,0 +1,112 @@
+#pragma once
+
+#include "core.h"
+#include "net.h"
+
+// Lockstep
+//
+// Keeps several copies of a deterministic simulation in step by exchanging
+// only their inputs. Every player sends one input byte per tick and nobody
+// simulates tick t until they have everyone's input for it. The local input
+// read on tick t is scheduled for tick t + input_delay, which gives it that
+// many ticks to reach the other players before they need it, so on a link
+// faster than the delay nobody ever waits.
+//
+// Peers talk over UDP in a full mesh. Every packet repeats all the inputs the
+// receiver hasn't acknowledged yet and acknowledges what the sender has, so a
+// lost packet is covered by the next one instead of a resend timer:
+//
+//   u8  lockstep_magic
+//   u8  sending player
+//   u32 ack          first tick of the receiver's inputs the sender is missing
+//   u32 first_tick   of the inputs that follow
+//   u8  count
+//   u8  inputs[count]
+//
+// Multi-byte fields are little-endian.
+
+constexpr u8  lockstep_magic = 0x4C; // 'L'
+constexpr u32 lockstep_max_players = 4;
+constexpr u32 lockstep_window = 256;            // Ticks of input kept per player.
+constexpr u32 lockstep_max_inputs_per_packet = 64;
+constexpr u16 lockstep_default_port = 27500;
+constexpr usize lockstep_packet_header_size = 11;
+
+// Peers can be up to twice the delay apart, and the window has to hold every
+// input that may still need resending.
+constexpr u32 lockstep_max_input_delay = (lockstep_window - 3) / 2;
+
+struct LockstepConfig {
+  u32 player_count = 2;
+  u32 local_player = 0;
+  u32 input_delay = 3; // Ticks.
+
+  // Player i listens on base_port + i, at peer_ip for everyone but us.
+  u16 base_port = lockstep_default_port;
+  u32 peer_ip = net_loopback_ip;
+
+  NetConditions conditions = {};
+  u32 resend_interval = 40; // ms before an ack or unacknowledged inputs go out on their own.
+};
+
+struct LockstepPeer {
+  NetAddress address = {};
+
+  u32 received_until = 0; // Their inputs are known for every tick before this.
+  u32 acked_until = 0;    // They have said they know ours before this.
+
+  u32 ack_sent = 0;        // The last received_until we told them about.
+  u32 inputs_sent_until = 0;
+  u32 last_sent = 0;       // ms
+};
+
+struct LockstepSession {
+  LockstepConfig config = {};
+  NetSocket socket = {};
+
+  LockstepPeer peers[lockstep_max_players] = {};
+  u8 inputs[lockstep_window][lockstep_max_players] = {};
+
+  u32 tick = 0; // Next tick to simulate.
+
+  // Counters for the overlay and for tools/versus_sim.cc.
+  u64 stalled_polls = 0;
+  u64 invalid_packets = 0;
+};
+
+// Fails with NetError::Kind::invalid_config, after logging why, if the player
+// count, local player or input delay is out of range or the players' ports
+// run past 65535.
+Result<LockstepSession, NetError> lockstep_start(const LockstepConfig& config, u64 seed);
+void lockstep_stop(LockstepSession* session);
+
+// Whether the tick `tick + input_delay` still needs the local player's input.
+// False while stalled, when the previous input is still waiting to be used.
+bool lockstep_needs_local_input(const LockstepSession& session);
+
+// The local player's input for tick `tick + input_delay`. Does nothing if
+// that tick already has it.
+void lockstep_add_local_input(LockstepSession* session, u8 input);
+
+// Reads every waiting packet and sends peers whatever they are missing. Call
+// at least once per tick, and more often while stalled.
+void lockstep_poll(LockstepSession* session, u32 now);
+
+// If every player's input for the current tick has arrived, copies them to
+// `inputs` (player_count bytes), moves on to the next tick and returns true.
+bool lockstep_advance(LockstepSession* session, u8* inputs);
+
+// The player whose input the current tick is waiting for, or player_count.
+u32 lockstep_waiting_for(const LockstepSession& session);
+
+// Every player's input is known for the ticks before this one.
+u32 lockstep_confirmed_until(const LockstepSession& session);
+
+// A player's input for `tick`, which must be below their received_until and
+// less than a window behind the current tick.
+u8 lockstep_input(const LockstepSession& session, u32 tick, u32 player);
+
+// Moves on to the next tick whether or not its inputs have arrived, for
+// callers that predict the missing ones (rollback.h). The inputs keep
+// arriving and can be read with lockstep_input as they do.
+void lockstep_step(LockstepSession* session);
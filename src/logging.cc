@@ -0,0 +1,311 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+
+constexpr std::size_t log_ring_capacity = 1 << 16;
+
+static_assert(log_ring_capacity % alignof(LogRecord) == 0);
+
+// Single producer (the owning thread), single consumer (the logger thread).
+// Positions only ever grow; the offset into `data` is position % capacity.
+struct LogRing {
+  alignas(64) std::atomic<std::uint64_t> head = 0; // Published by the producer.
+  alignas(64) std::atomic<std::uint64_t> tail = 0; // Published by the logger thread.
+
+  alignas(64) std::uint64_t pending_head = 0; // Producer only, between reserve and commit.
+  std::atomic<std::uint64_t> dropped = 0;
+  std::atomic<bool> is_retired = false; // Its thread has exited; freed once drained.
+  std::uint64_t reported_dropped = 0; // Whoever holds Logger::drain_mutex.
+
+  alignas(alignof(LogRecord)) unsigned char data[log_ring_capacity];
+};
+
+struct Logger {
+  std::once_flag started = {};
+  std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+  // Only taken when a thread logs for the first time and by the logger
+  // thread when it walks the rings, never on the logging path itself.
+  std::mutex mutex = {};
+  std::vector<std::shared_ptr<LogRing>> rings = {};
+
+  // Held while reading rings, so the logger thread and the last-chance
+  // drains during shutdown never consume the same records.
+  std::mutex drain_mutex = {};
+
+  std::thread thread = {};
+  std::atomic<bool> is_running = false;
+  std::atomic<bool> is_stopping = false;
+  std::atomic<bool> is_stopped = false;
+};
+
+static Logger& logger() {
+  static Logger instance;
+  return instance;
+}
+
+static thread_local LogRing* thread_ring = nullptr;
+static thread_local bool thread_ring_is_retired = false;
+
+// Retires the thread's ring when the thread exits, so threads that come and
+// go don't leave 64 KB behind each. Anything the thread logs after this, from
+// other thread_local destructors, is written synchronously. Shares the ring
+// with Logger::rings, so whichever lets go last frees it.
+struct LogRingOwner {
+  std::shared_ptr<LogRing> ring = nullptr;
+
+  ~LogRingOwner() {
+    if (!ring) return;
+
+    ring->is_retired.store(true, std::memory_order_release);
+    thread_ring = nullptr;
+    thread_ring_is_retired = true;
+  }
+};
+
+static thread_local LogRingOwner thread_ring_owner;
+
+static void write_line(LogLevel level, std::uint64_t timestamp, fmt::string_view message) {
+  fmt::memory_buffer line;
+  auto out = std::back_inserter(line);
+
+  auto tag = [&](fmt::color colour, const char* text) {
+    fmt::format_to(out, fmt::emphasis::bold | fmt::fg(colour), "{}", text);
+  };
+
+  switch (level) {
+  case LogLevel::trace:     tag(log_note_color, "  [trace] "); break;
+  case LogLevel::note:      tag(log_note_color, "   [note] "); break;
+  case LogLevel::info:      tag(log_info_color, "   [info] "); break;
+  case LogLevel::plain:     break;
+  case LogLevel::command:   tag(log_info_color, " [system] "); break;
+  case LogLevel::warning:   tag(log_warning_color, "[warning] "); break;
+  case LogLevel::error:     tag(log_error_color, "  [error] "); break;
+  case LogLevel::fatal:     tag(log_error_color, "[FATAL ERROR] "); break;
+  case LogLevel::assertion: tag(log_error_color, " [assert] "); break;
+  }
+
+  if (level != LogLevel::plain) {
+    fmt::format_to(out, fmt::emphasis::faint, "{:9.3f} ", (double) timestamp / 1e9);
+  }
+
+  line.append(message);
+  line.push_back('\n');
+
+  std::fwrite(line.data(), 1, line.size(), stdout);
+}
+
+static bool drain(LogRing& ring) {
+  auto tail = ring.tail.load(std::memory_order_relaxed);
+  auto head = ring.head.load(std::memory_order_acquire);
+  auto did_work = tail != head;
+
+  fmt::memory_buffer message;
+  while (tail != head) {
+    auto record = reinterpret_cast<LogRecord*>(ring.data + tail % log_ring_capacity);
+    if (record->format_arguments) {
+      message.clear();
+      record->format_arguments(message, record->format, record + 1);
+      write_line(record->level, record->timestamp, fmt::string_view(message.data(), message.size()));
+    }
+
+    tail += record->size;
+  }
+  ring.tail.store(tail, std::memory_order_release);
+
+  auto dropped = ring.dropped.load(std::memory_order_relaxed);
+  if (dropped != ring.reported_dropped) {
+    auto text = fmt::format("Log ring was full, dropped {} messages", dropped - ring.reported_dropped);
+    write_line(LogLevel::warning, log_timestamp(), text);
+    ring.reported_dropped = dropped;
+    did_work = true;
+  }
+
+  return did_work;
+}
+
+static bool drain_all() {
+  auto& state = logger();
+
+  std::vector<std::shared_ptr<LogRing>> rings;
+  {
+    std::lock_guard lock(state.mutex);
+    rings = state.rings;
+  }
+
+  std::lock_guard drain_lock(state.drain_mutex);
+  auto did_work = false;
+  auto has_retired = false;
+  for (auto& ring : rings) {
+    did_work |= drain(*ring);
+    has_retired |= ring->is_retired.load(std::memory_order_acquire);
+  }
+
+  // A retired ring's head can't move again, so once the drain above caught
+  // up with it, nothing is left to read. log_flush may still hold it.
+  if (has_retired) {
+    std::lock_guard lock(state.mutex);
+    std::erase_if(state.rings, [](const std::shared_ptr<LogRing>& ring) {
+      return ring->is_retired.load(std::memory_order_acquire) &&
+             ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+    });
+  }
+
+  if (did_work) std::fflush(stdout);
+  return did_work;
+}
+
+static void logger_thread() {
+  auto& state = logger();
+
+  while (true) {
+    auto is_stopping = state.is_stopping.load(std::memory_order_acquire);
+    auto did_work = drain_all();
+
+    if (is_stopping) break;
+    if (!did_work) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+static void log_stop() {
+  auto& state = logger();
+  if (!state.is_running.load()) return;
+
+  // Anything logged from here on is written synchronously.
+  state.is_stopped.store(true);
+  state.is_stopping.store(true, std::memory_order_release);
+  state.thread.join();
+  state.is_running.store(false);
+
+  // A thread that reserved before is_stopped was set may have committed
+  // after the logger thread's last pass. Pairs with the fence in log_commit:
+  // either this drain sees the record or that thread sees is_stopped.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  drain_all();
+}
+
+static void log_start() {
+  auto& state = logger();
+  state.is_running.store(true);
+  state.thread = std::thread(logger_thread);
+  std::atexit(log_stop);
+}
+
+static LogRing* register_thread() {
+  auto& state = logger();
+  std::call_once(state.started, log_start);
+
+  auto ring = std::make_shared<LogRing>();
+  thread_ring = ring.get();
+  thread_ring_owner.ring = ring;
+
+  std::lock_guard lock(state.mutex);
+  state.rings.push_back(std::move(ring));
+
+  return thread_ring;
+}
+
+void* log_reserve(std::size_t size) {
+  if (thread_ring_is_retired || logger().is_stopped.load(std::memory_order_relaxed)) return nullptr;
+  auto ring = thread_ring ? thread_ring : register_thread();
+
+  auto head = ring->head.load(std::memory_order_relaxed);
+  auto tail = ring->tail.load(std::memory_order_acquire);
+
+  // Records never straddle the end of the ring; pad to the start instead.
+  auto offset = head % log_ring_capacity;
+  std::uint64_t padding = offset + size > log_ring_capacity ? log_ring_capacity - offset : 0;
+
+  if (size > log_ring_capacity || head + padding + size - tail > log_ring_capacity) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  if (padding) {
+    auto marker = new (ring->data + offset) LogRecord();
+    marker->size = (std::uint32_t) padding;
+  }
+
+  ring->pending_head = head + padding + size;
+  return ring->data + (head + padding) % log_ring_capacity;
+}
+
+void log_commit() {
+  thread_ring->head.store(thread_ring->pending_head, std::memory_order_release);
+
+  // If the logger stopped between reserve and here, its last drain may have
+  // missed this record; see log_stop.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto& state = logger();
+  if (state.is_stopped.load(std::memory_order_relaxed)) {
+    std::lock_guard drain_lock(state.drain_mutex);
+    if (drain(*thread_ring)) std::fflush(stdout);
+  }
+}
+
+bool log_is_synchronous() {
+  return thread_ring_is_retired || logger().is_stopped.load(std::memory_order_relaxed);
+}
+
+std::uint64_t log_timestamp() {
+  auto elapsed = std::chrono::steady_clock::now() - logger().start_time;
+  return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void log_write(LogLevel level, std::uint64_t timestamp, fmt::string_view message) {
+  write_line(level, timestamp, message);
+  std::fflush(stdout);
+}
+
+void log_print(const char* file, int line, fmt::string_view format, fmt::format_args args) {
+  auto message = fmt::format("{}:{}: {}", file, line, fmt::vformat(format, args));
+  log_write(LogLevel::plain, log_timestamp(), message);
+}
+
+void vlog_print(fmt::string_view format, fmt::format_args args) {
+  log_write(LogLevel::plain, log_timestamp(), fmt::vformat(format, args));
+}
+
+void log_flush() {
+  auto& state = logger();
+  if (!state.is_running.load() || state.is_stopped.load()) {
+    std::fflush(stdout);
+    return;
+  }
+
+  std::vector<std::pair<std::shared_ptr<LogRing>, std::uint64_t>> targets;
+  {
+    std::lock_guard lock(state.mutex);
+    for (auto& ring : state.rings) {
+      targets.emplace_back(ring, ring->head.load(std::memory_order_acquire));
+    }
+  }
+
+  for (auto& [ring, head] : targets) {
+    while (ring->tail.load(std::memory_order_acquire) < head) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+}
+
+bool log_rate_limit_allow(LogRateLimit* limit, std::uint64_t interval_milliseconds) {
+  auto now = log_timestamp();
+  if (now < limit->next_allowed) {
+    limit->suppressed += 1;
+    return false;
+  }
+
+  if (limit->suppressed) {
+    log_note("{} similar messages suppressed", limit->suppressed);
+    limit->suppressed = 0;
+  }
+
+  limit->next_allowed = now + interval_milliseconds * 1000000;
+  return true;
+}
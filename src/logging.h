@@ -3,6 +3,16 @@
 
 
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
 #include <fmt/core.h>
 #include <fmt/format.h>
 #include <fmt/color.h>
@@ -12,87 +22,282 @@ const auto log_warning_color = fmt::color::orange;
 const auto log_note_color = fmt::color::light_steel_blue;
 const auto log_info_color = fmt::color::plum;
 
+
+
+// Logging
+//
+// Calls copy their arguments into a ring buffer owned by the calling thread
+// and return; a background thread formats and prints them. Each thread has
+// its own single-producer ring, so logging never takes a lock. When a ring is
+// full the message is dropped and counted rather than blocking the caller.
+//
+// Format strings are compile-time constants checked against their arguments,
+// so they can be stored by reference. `const char*` and string arguments are
+// copied into the record itself, up to log_string_capacity bytes, so
+// temporaries are safe to pass and logging never allocates. Longer strings
+// are cut short and end in "...".
+
+enum class LogLevel : unsigned char {
+  trace,
+  note,
+  info,
+  plain,
+  command,
+  warning,
+  error,
+  fatal,
+  assertion,
+};
+
+// Levels below this are compiled out, arguments and all. Override with
+// -DLOG_MIN_LEVEL=LogLevel::..., e.g. LogLevel::trace to see hot-loop tracing.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LogLevel::note
+#endif
+
+// log_assert is compiled out, condition included, when this is 0.
+#ifndef LOG_ASSERTS
+#ifdef NDEBUG
+#define LOG_ASSERTS 0
+#else
+#define LOG_ASSERTS 1
+#endif
+#endif
+
+using LogFormatFunction = void (*)(fmt::memory_buffer& out, fmt::string_view format, void* arguments);
+
+struct alignas(16) LogRecord {
+  std::uint32_t      size = 0; // Including the arguments that follow and any padding.
+  LogLevel           level = LogLevel::info;
+  std::uint64_t      timestamp = 0; // ns since the logger started.
+  fmt::string_view   format = {};
+  LogFormatFunction  format_arguments = nullptr; // nullptr marks padding at the end of the ring.
+};
+
+// Returns nullptr if the calling thread's ring is full, the logger has
+// already shut down or the thread is exiting.
+void* log_reserve(std::size_t size);
+void  log_commit();
+
+// Once the logger has stopped, or the calling thread's ring has been retired
+// as it exits, messages are written on the spot instead of queued.
+bool          log_is_synchronous();
+std::uint64_t log_timestamp();
+
+// Synchronous path, used once the logger has stopped and for fatal errors.
+// Writes the whole line with a single call.
+void log_write(LogLevel level, std::uint64_t timestamp, fmt::string_view message);
 void log_print(const char* file, int line, fmt::string_view format, fmt::format_args args);
 void vlog_print(fmt::string_view format, fmt::format_args args);
 
-template <typename S, typename... Args>
-void log(const char* file, int line, const S& format, Args&&... args) {
-  vlog_print(file, line, format, fmt::make_format_args(args...));
+// Blocks until everything logged so far has been written out.
+void log_flush();
+
+
+
+constexpr std::size_t log_string_capacity = 127;
+
+// A string argument, copied into the ring with its record.
+struct LogString {
+  unsigned char size = 0;
+  char          data[log_string_capacity];
+
+  LogString(const char* text) : LogString(std::string_view(text)) {}
+  LogString(const std::string& text) : LogString(std::string_view(text)) {}
+  LogString(fmt::string_view text) : LogString(std::string_view(text.data(), text.size())) {}
+
+  LogString(std::string_view text) {
+    if (text.size() <= log_string_capacity) {
+      size = (unsigned char) text.size();
+      text.copy(data, text.size());
+      return;
+    }
+
+    size = (unsigned char) log_string_capacity;
+    text.copy(data, log_string_capacity - 3);
+    std::string_view("...").copy(data + log_string_capacity - 3, 3);
+  }
+};
+
+template <>
+struct fmt::formatter<LogString> : fmt::formatter<fmt::string_view> {
+  template <typename FormatContext>
+  auto format(const LogString& text, FormatContext& context) const {
+    return fmt::formatter<fmt::string_view>::format(fmt::string_view(text.data, text.size), context);
+  }
+};
+
+// Where a log(file, line, ...) call came from. `file` is __FILE__, which
+// outlives the record, so only the pointer is kept.
+struct LogLocation {
+  const char* file = nullptr;
+  int         line = 0;
+};
+
+template <typename T>
+struct LogStored { using type = std::decay_t<T>; };
+
+template <> struct LogStored<const char*> { using type = LogString; };
+template <> struct LogStored<char*> { using type = LogString; };
+template <> struct LogStored<std::string> { using type = LogString; };
+template <> struct LogStored<std::string_view> { using type = LogString; };
+template <> struct LogStored<fmt::string_view> { using type = LogString; };
+
+template <typename T>
+using log_stored_t = typename LogStored<std::decay_t<T>>::type;
+
+template <typename... Values>
+void log_format_values(fmt::memory_buffer& out, fmt::string_view format, Values&... values) {
+  fmt::vformat_to(std::back_inserter(out), format, fmt::make_format_args(values...));
 }
 
+template <typename... Values>
+void log_format_values(fmt::memory_buffer& out, fmt::string_view format, LogLocation& location, Values&... values) {
+  fmt::format_to(std::back_inserter(out), "{}:{}: ", location.file, location.line);
+  log_format_values(out, format, values...);
+}
 
+template <typename Stored>
+void log_format_tuple(fmt::memory_buffer& out, fmt::string_view format, Stored& stored) {
+  std::apply([&](auto&... values) { log_format_values(out, format, values...); }, stored);
+}
 
-template <typename S, typename... Args>
-void log(const S& format, Args&&... args) {
-  vlog_print(format, fmt::make_format_args(args...));
+// Runs on the logger thread: formats the arguments copied into the ring and
+// destroys them.
+template <typename Stored>
+void log_format_stored(fmt::memory_buffer& out, fmt::string_view format, void* arguments) {
+  auto& stored = *static_cast<Stored*>(arguments);
+  try {
+    log_format_tuple(out, format, stored);
+  } catch (const fmt::format_error& error) {
+    out.clear();
+    fmt::format_to(std::back_inserter(out), "<bad log format \"{}\": {}>", format, error.what());
+  }
+  stored.~Stored();
 }
 
+template <typename... Args>
+void log_enqueue(LogLevel level, fmt::string_view format, Args&&... args) {
+  using Stored = std::tuple<log_stored_t<Args>...>;
+  static_assert(alignof(Stored) <= alignof(LogRecord), "Log argument is over-aligned");
+
+  constexpr auto record_size = (sizeof(LogRecord) + sizeof(Stored) + alignof(LogRecord) - 1) & ~(alignof(LogRecord) - 1);
+
+  auto memory = static_cast<unsigned char*>(log_reserve(record_size));
+  if (!memory) {
+    if (log_is_synchronous()) {
+      Stored stored(std::forward<Args>(args)...);
+      fmt::memory_buffer message;
+      log_format_tuple(message, format, stored);
+      log_write(level, log_timestamp(), fmt::string_view(message.data(), message.size()));
+    }
+    return;
+  }
+
+  auto record = new (memory) LogRecord();
+  record->size = (std::uint32_t) record_size;
+  record->level = level;
+  record->timestamp = log_timestamp();
+  record->format = format;
+  record->format_arguments = &log_format_stored<Stored>;
+  new (memory + sizeof(LogRecord)) Stored(std::forward<Args>(args)...);
+
+  log_commit();
+}
 
+template <LogLevel level, typename... Args>
+void log_at(fmt::format_string<Args...> format, Args&&... args) {
+  log_enqueue(level, fmt::string_view(format), std::forward<Args>(args)...);
+}
 
-template <typename S, typename... Args>
-void log_fatal(const S& message, Args &&...args) {
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_error_color),    "[FATAL ERROR] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
-  exit(1);
+// Writes everything already queued and then this message before returning,
+// for messages that must not be dropped or left in a ring when the process ends.
+template <LogLevel level, typename... Args>
+void log_now(fmt::format_string<Args...> format, Args&&... args) {
+  log_flush();
+  log_write(level, log_timestamp(), fmt::format(format, std::forward<Args>(args)...));
 }
 
 
 
-template <typename S, typename... Args>
-void log_assert(bool condition, const S& message, Args &&...args) {
-  if (condition)  return;
+// Rate limiting: log_every(250, log_warning("Frame took {} ms", ms));
+// lets the call through at most once per interval per call site.
+struct LogRateLimit {
+  std::uint64_t next_allowed = 0;
+  std::uint32_t suppressed = 0;
+};
 
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_error_color),  " [assert] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
-  exit(1);
-}
+bool log_rate_limit_allow(LogRateLimit* limit, std::uint64_t interval_milliseconds);
 
+#define log_every(milliseconds, call)                                            \
+  do {                                                                           \
+    static thread_local LogRateLimit log_rate_limit_;                            \
+    if (log_rate_limit_allow(&log_rate_limit_, (milliseconds))) { call; }        \
+  } while (0)
 
 
 
-template <typename S, typename... Args>
-void log_error(const S& message, Args &&...args) {
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_error_color),    "  [error] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
-}
+// Format strings are checked against their arguments at compile time. A
+// disabled level leaves only a discarded `if constexpr` branch behind: the
+// call still has to type-check, but its arguments are never evaluated and no
+// code is emitted, so tracing can stay in hot loops.
+#define LOG_AT_LEVEL(level, ...)                                                 \
+  do {                                                                           \
+    if constexpr (LogLevel::level >= LOG_MIN_LEVEL) {                            \
+      log_at<LogLevel::level>(__VA_ARGS__);                                      \
+    }                                                                            \
+  } while (0)
+
+#define log_trace(...)    LOG_AT_LEVEL(trace, __VA_ARGS__)
+#define log_note(...)     LOG_AT_LEVEL(note, __VA_ARGS__)
+#define log_info(...)     LOG_AT_LEVEL(info, __VA_ARGS__)
+#define log_command(...)  LOG_AT_LEVEL(command, __VA_ARGS__)
+#define log_warning(...)  LOG_AT_LEVEL(warning, __VA_ARGS__)
+#define log_error(...)    LOG_AT_LEVEL(error, __VA_ARGS__)
 
 
 
-template <typename S, typename... Args>
-void log_note(const S& message, Args &&...args) {
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_note_color), "   [note] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
+// Prefixes the message with "file:line: ". Taking a LogLocation rather than
+// a file and a line keeps it from being confused with log("{} {}", 1, "x").
+template <typename... Args>
+void log(LogLocation location, fmt::format_string<Args...> format, Args&&... args) {
+  if constexpr (LogLevel::plain >= LOG_MIN_LEVEL) {
+    log_enqueue(LogLevel::plain, fmt::string_view(format), location, std::forward<Args>(args)...);
+  }
 }
 
+#define log_here(...) log(LogLocation{__FILE__, __LINE__}, __VA_ARGS__)
 
 
-template <typename S, typename... Args>
-void log_warning(const S& message, Args &&...args) {
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_warning_color), "[warning] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
+
+template <typename... Args>
+void log(fmt::format_string<Args...> format, Args&&... args) {
+  if constexpr (LogLevel::plain >= LOG_MIN_LEVEL) {
+    log_at<LogLevel::plain>(format, std::forward<Args>(args)...);
+  }
 }
 
 
 
-template <typename S, typename... Args>
-void log_info(const S& message, Args &&...args) {
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_info_color),  "   [info] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
+template <typename... Args>
+[[noreturn]] void log_fatal(fmt::format_string<Args...> message, Args &&...args) {
+  log_now<LogLevel::fatal>(message, std::forward<Args>(args)...);
+  exit(1);
 }
 
 
 
-template <typename S, typename... Args>
-void log_command(const S& message, Args &&...args) {
-  fmt::print(fmt::emphasis::bold | fmt::fg(log_info_color),  " [system] ");
-  fmt::vprint(message, fmt::make_format_args(args...));
-  fmt::print("\n");
+template <typename... Args>
+[[noreturn]] void log_assert_failed(const char* file, int line, const char* condition, fmt::format_string<Args...> message, Args &&...args) {
+  log_now<LogLevel::assertion>("{}:{}: {}: {}", file, line, condition, fmt::format(message, std::forward<Args>(args)...));
+  exit(1);
 }
 
+#define log_assert(condition, ...)                                               \
+  do {                                                                           \
+    if constexpr (LOG_ASSERTS != 0) {                                            \
+      if (!(condition)) log_assert_failed(__FILE__, __LINE__, #condition, __VA_ARGS__); \
+    }                                                                            \
+  } while (0)
+
 
@@ -2,6 +2,8 @@
 #include <SDL_ttf.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <pstl/glue_algorithm_defs.h>
 
 #include "SDL_keyboard.h"
@@ -9,18 +11,27 @@
 #include "SDL_render.h"
 #include "SDL_scancode.h"
 #include "SDL_timer.h"
+#include "assets.h"
+#include "audio.h"
 #include "core.h"
-
-using Colour = Vector4<f32>;
-Colour make_colour(f32 r, f32 g, f32 b, f32 a) {
-    return make_vector4(r, g, b, a);
-}
+#include "game.h"
+#include "histogram.h"
+#include "input.h"
+#include "lockstep.h"
+#include "particles.h"
+#include "rollback.h"
+#include "snapshot.h"
+#include "sounds.h"
+#include "telemetry.h"
+#include "versus.h"
 
 #define SDL_COLOUR(colour)                                                     \
-  (int)(colour.x * 255.0f), (int)(colour.y * 255.0f),                          \
-      (int)(colour.z * 255.0f), (int)(colour.w * 255.0f)
+  colour_r(colour), colour_g(colour), colour_b(colour), colour_a(colour)
 
-using Coordinate = Vector2<i32>;
+constexpr Colour background_tile_colour = make_colour(0.1f, 0.1f, 0.1f, 1.0f);
+constexpr Colour ghost_colour = make_colour(0.25f, 0.1f, 0.15f, 1.0f);
+constexpr Colour tetromino_colour = make_colour(0.6f, 0.1f, 0.3f, 1.0f);
+constexpr Colour marker_colour = make_colour(0.0f, 1.0f, 1.0f, 1.0f);
 
 void draw_rect_filled(SDL_Renderer *renderer, Vector2<int> position,
                       Vector2<int> size, Colour colour) {
@@ -38,6 +49,8 @@ void draw_rect_filled(SDL_Renderer *renderer, Vector2<int> position,
 void draw_text(SDL_Renderer *renderer, TTF_Font *font, Vector2<int> position,
                const char *text, u8 r = 255, u8 g = 255, u8 b = 255,
                u8 _a = 255) {
+    if (!font) return; // Still loading.
+
     SDL_Color sdl_colour = {r, g, b};
     SDL_Surface *surface = TTF_RenderText_Solid(font, text, sdl_colour);
     SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
@@ -51,29 +64,14 @@ void draw_text(SDL_Renderer *renderer, TTF_Font *font, Vector2<int> position,
     SDL_DestroyTexture(texture);
 }
 
-struct Tetromino {
-    Coordinate coordinate = {};
-    Vec<Coordinate> pieces = {};
-
-    u32 last_tick = 0;
-};
-
-struct LockedIn {
-    Coordinate coordinate = {};
-    Colour colour = {};
-
-    bool is_clearing = false;
-    f32  clear_t = 0.0f;
-
-    bool is_dropping = false;
-    f32  drop_t = 0.0f;
-};
-
 bool running = true;
 i32 grid_width = 8;
 i32 grid_height = 8;
 i32 tile_width = 60;
 i32 tile_height = 60;
+i32 side_panel_tiles = 3; // Right of each board, for the held piece and the queue.
+i32 piece_texture_tile = 32;
+f32 particle_size = 0.15f; // In tiles.
 
 auto now = SDL_GetPerformanceCounter();
 auto last = now;
@@ -82,208 +80,442 @@ f32 current_frame_time = 0.0f;
 
 u64 total_frames = 0;
 u64 total_ticks = 0;
-f32 default_frame_time = 1.0f;
-f32 speed_up_factor = 4.0f;
-f32 frame_time = default_frame_time;
-
-f32 clear_animation_time = frame_time * 0.5f;
-f32 drop_animation_time = clear_animation_time * 0.5f;
 
-enum class GameState {
-  playing,
-  game_over,
-};
+const char *quicksave_path = "metris.sav";
+const char *telemetry_path = "metris.mtl";
+const char *histogram_path = "metris.hist";
+
+// Session-wide timings in microseconds, shown in the overlay and dumped to
+// histogram_path on exit for comparing runs.
+Histogram frame_histogram = {};
+Histogram tick_histogram = {};   // Input, simulation and animation.
+Histogram render_histogram = {}; // Drawing and presenting.
+Histogram input_latency_histogram = {};
+
+String histogram_overlay_line(const char *label, const Histogram &histogram) {
+    auto ms = [&](f64 percentile) { return (f64)histogram_percentile(histogram, percentile) / 1000.0; };
+    return fmt::format("{:<7} p50 {:.1f}  p99 {:.1f}  p99.9 {:.1f}  max {:.1f} ms",
+                       label, ms(50.0), ms(99.0), ms(99.9), ms(100.0));
+}
 
-GameState game_state = GameState::playing;
+void dump_histograms() {
+    File file;
+    file.path = histogram_path;
+    histogram_dump(frame_histogram, "frame", "us", &file.contents);
+    histogram_dump(tick_histogram, "tick", "us", &file.contents);
+    histogram_dump(render_histogram, "render", "us", &file.contents);
+    histogram_dump(input_latency_histogram, "input_latency", "us", &file.contents);
 
-bool is_in_bounds(Coordinate coordinate) {
-    return coordinate.x >= 0 && coordinate.x < grid_width && coordinate.y >= 0 &&
-            coordinate.y < grid_height;
+    if (write_file(file).isErr()) {
+        log_error("Could not write histograms to {}", histogram_path);
+    }
 }
 
-void next_tetromino(Tetromino &tetromino) {
-    tetromino.coordinate = make_vector2(3, 0);
-    tetromino.last_tick = 0;
-    tetromino.pieces.clear();
-
-    switch (rand() % 7) {
-    case 0: {
-        tetromino.pieces.push_back(make_vector2(0, 0));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(2, 0));
-        tetromino.pieces.push_back(make_vector2(3, 0));
-    } break;
-
-    case 1: {
-        tetromino.pieces.push_back(make_vector2(0, 0));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(2, 0));
-        tetromino.pieces.push_back(make_vector2(1, 1));
-    } break;
-
-    case 2: {
-        tetromino.pieces.push_back(make_vector2(0, 0));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(2, 0));
-        tetromino.pieces.push_back(make_vector2(0, 1));
-    } break;
-
-    case 3: {
-        tetromino.pieces.push_back(make_vector2(0, 0));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(1, 1));
-        tetromino.pieces.push_back(make_vector2(2, 1));
-    } break;
-
-    case 4: {
-        tetromino.pieces.push_back(make_vector2(0, 1));
-        tetromino.pieces.push_back(make_vector2(1, 1));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(2, 0));
-    } break;
-
-    case 5: {
-        tetromino.pieces.push_back(make_vector2(0, 0));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(1, 1));
-        tetromino.pieces.push_back(make_vector2(2, 0));
-    } break;
-
-    case 6: {
-        tetromino.pieces.push_back(make_vector2(0, 0));
-        tetromino.pieces.push_back(make_vector2(1, 0));
-        tetromino.pieces.push_back(make_vector2(1, 1));
-        tetromino.pieces.push_back(make_vector2(2, 1));
-    } break;
-
-    default: {
-        printf("Unknown tetromino type\n");
-        exit(1);
-    } break;
+void record_game_events(Telemetry *telemetry, Game &game, u32 time) {
+    auto &events = game.events;
+    if (events.pieces_locked > 0) {
+        telemetry_event(telemetry, TelemetryRecordKind::piece_locked, time, game.score, events.pieces_locked);
     }
+    if (events.lines_cleared > 0) {
+        telemetry_event(telemetry, TelemetryRecordKind::lines_cleared, time, game.score, events.lines_cleared);
+    }
+    if (events.is_game_over) {
+        telemetry_event(telemetry, TelemetryRecordKind::game_over, time, game.score);
+    }
+
+    events = {};
 }
 
-bool tetromino_fits(Tetromino &tetromino, Coordinate target,
-                    Vec<LockedIn> &locked_in) {
-    auto tetromino_target = vector2_add(tetromino.coordinate, target);
-    for (auto &piece : tetromino.pieces) {
-        auto piece_coordinate = vector2_add(tetromino_target, piece);
+// Command line. With --versus the game joins a match over UDP instead of
+// playing alone; every player runs their own copy with the same seed. With
+// --rollback it guesses late inputs for up to that many ticks instead of
+// waiting for them.
+struct Options {
+    bool is_versus = false;
+    LockstepConfig lockstep = {};
+    u32 rollback_ticks = 0;
+    u64 seed = 1;
+    u32 preview_count = 5;
+};
 
-        if (!is_in_bounds(piece_coordinate)) {
-        return false;
+constexpr const char usage[] =
+    "Usage: {} [--versus <player> <player count>] [--peer <ip>] [--port <base port>]\n"
+    "          [--input-delay <ticks>] [--rollback <ticks>] [--latency <ms>] [--jitter <ms>] [--loss <percent>] [--seed <n>]\n"
+    "          [--preview <pieces>]";
+
+Options parse_options(int argc, char *argv[]) {
+    Options options;
+
+    // A whole decimal number from `min` to `max`. strtoull alone takes an
+    // empty string as 0 and wraps a minus sign around.
+    auto number = [&](int &i, u64 min, u64 max) -> u64 {
+        auto flag = argv[i];
+        if (i + 1 >= argc) log_fatal(usage, argv[0]);
+        i += 1;
+
+        auto text = argv[i];
+        char *end = nullptr;
+        errno = 0;
+        auto value = text[0] >= '0' && text[0] <= '9' ? std::strtoull(text, &end, 10) : 0;
+        if (!end || *end != 0 || errno == ERANGE || value < min || value > max) {
+            log_error("{} takes a number from {} to {}, not \"{}\"", flag, min, max, text);
+            log_fatal(usage, argv[0]);
         }
-
-        for (auto &locked : locked_in) {
-            if (vector2_equal(locked.coordinate, piece_coordinate)) {
-                return false;
-            }
+        return value;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        StringView arg = argv[i];
+        if (arg == "--versus") {
+            options.is_versus = true;
+            options.lockstep.local_player = (u32)number(i, 0, versus_max_players - 1);
+            options.lockstep.player_count = (u32)number(i, 2, versus_max_players);
+        } else if (arg == "--peer") {
+            if (i + 1 >= argc || !parse_net_ip(argv[i + 1], &options.lockstep.peer_ip)) log_fatal(usage, argv[0]);
+            i += 1;
+        } else if (arg == "--port") {
+            options.lockstep.base_port = (u16)number(i, 1, UINT16_MAX);
+        } else if (arg == "--input-delay") {
+            options.lockstep.input_delay = (u32)number(i, 0, lockstep_max_input_delay);
+        } else if (arg == "--rollback") {
+            options.rollback_ticks = (u32)number(i, 0, rollback_max_ticks);
+        } else if (arg == "--latency") {
+            options.lockstep.conditions.latency = (u32)number(i, 0, UINT32_MAX);
+        } else if (arg == "--jitter") {
+            options.lockstep.conditions.jitter = (u32)number(i, 0, UINT32_MAX);
+        } else if (arg == "--loss") {
+            options.lockstep.conditions.loss = (f32)number(i, 0, 100) / 100.0f;
+        } else if (arg == "--seed") {
+            options.seed = number(i, 0, UINT64_MAX);
+        } else if (arg == "--preview") {
+            options.preview_count = (u32)number(i, 1, piece_queue_capacity);
+        } else {
+            log_fatal(usage, argv[0]);
         }
+    }
 
-        // Could break out early if !can_drop
+    auto &lockstep = options.lockstep;
+    if (options.is_versus && lockstep.local_player >= lockstep.player_count) {
+        log_fatal("The player number must be below the player count of {}", lockstep.player_count);
+    }
+    if (options.is_versus && lockstep.base_port + lockstep.player_count - 1 > UINT16_MAX) {
+        log_fatal("Ports {} and up don't leave room for {} players", lockstep.base_port, lockstep.player_count);
     }
 
-    return true;
+    return options;
 }
 
-bool rotate_tetromino(Tetromino &tetromino, Vec<LockedIn> &locked_in) {
-    auto old_pieces = tetromino.pieces;
+// Draws one board with its top left corner at `origin`.
+void draw_game(SDL_Renderer *renderer, Game &game, Vector2<int> origin, Vector2<int> tile_size) {
+    if (game.state != GameState::playing) return;
+
+    for (i32 y = 0; y < game.board.height; ++y) {
+        for (i32 x = 0; x < game.board.width; ++x) {
+            draw_rect_filled(renderer, origin + make_vector2(x, y) * tile_size, tile_size, background_tile_colour);
+        }
+    }
+
+    // Ghost piece where a hard drop would land
+    auto &tetromino = game.tetromino;
+    auto ghost_distance = tetromino_drop_distance(tetromino, game.board);
     for (auto &piece : tetromino.pieces) {
-        auto old_x = piece.x;
-        piece.x = piece.y;
-        piece.y = -old_x;
+        auto cell = tetromino.coordinate + piece + make_vector2(0, ghost_distance);
+        draw_rect_filled(renderer, origin + cell * tile_size, tile_size, ghost_colour);
     }
 
-    if (!tetromino_fits(tetromino, make_vector2(0, 0), locked_in)) {
-        tetromino.pieces = old_pieces;
-        return false;
+    for (auto &piece : tetromino.pieces) {
+        draw_rect_filled(renderer, origin + (tetromino.coordinate + piece) * tile_size, tile_size, tetromino_colour);
     }
 
-    return true;
-}
+    draw_rect_filled(renderer, origin + tetromino.coordinate * tile_size, make_vector2(10, 10), marker_colour);
 
-u32 try_to_move_tetromino(Tetromino &tetromino, Vec<LockedIn> &locked_in) {
-    auto drop_offset = make_vector2(0, 1);
-    auto can_drop = tetromino_fits(tetromino, drop_offset, locked_in);
-    u32 score = 0;
-
-    if ((float)(SDL_GetTicks() - tetromino.last_tick) > frame_time * 1000.0f) {
-        if (!can_drop) {
-            for (auto &piece : tetromino.pieces) {
-                LockedIn locked;
-                locked.coordinate = vector2_add(tetromino.coordinate, piece);
-                locked.colour = make_colour(0.2f, 0.1f, 0.3f, 1.0f);
-                locked_in.push_back(locked);
-                score += 1; // +1 score for every piece locked in.
-            }
+    for (auto &locked : game.locked_in) {
+        auto size_multiplier = 1.0f - (locked.clear_t / clear_animation_time);
+        auto size = make_vector2(tile_size.x, (int)((f32)tile_size.y * size_multiplier));
 
-            next_tetromino(tetromino);
-        } else {
-            tetromino.coordinate = vector2_add(tetromino.coordinate, drop_offset);
-            score += 1; // +1 score for every time the tetromino moves down.
+        auto position = origin + locked.coordinate * tile_size;
+        if (locked.is_dropping) {
+            position.y += (int)((f32)tile_size.y * locked.drop_t / drop_animation_time);
         }
 
-        tetromino.last_tick = SDL_GetTicks();
+        draw_rect_filled(renderer, position, size, locked.colour);
 
-        // Check if you can clear any lines
-        auto lines_cleared_so_far = 0;
-        if (!locked_in.empty()) {
-            for (int y = grid_height - 1; y >= 0; --y) {
-                bool can_clear_line = true;
-                for (int x = 0; x < grid_width; ++x) {
-                    auto piece_exists = locked_in.end() != std::find_if(locked_in.begin(), locked_in.end(), [&](LockedIn &locked) { return vector2_equal(locked.coordinate, make_vector2(x, y)); });
-                    if (!piece_exists) can_clear_line = false;
-                }
+        draw_rect_filled(renderer, position, size / 10, marker_colour);
+    }
+}
 
-                if (can_clear_line) {
-                    for (auto &locked : locked_in) {
-                        if (locked.coordinate.y == y && !locked.is_clearing) {
-                            locked.is_clearing = true;
-                            locked.clear_t = 0.0f;
-                        }
-                    }
+// Every kind drawn once in its spawn rotation, 4 x 2 tiles, so the side panel
+// copies one texture per piece instead of filling a rect per cell. Targets
+// can be lost with the device, so they're redrawn on SDL_RENDER_TARGETS_RESET.
+struct PieceTextures {
+    SDL_Texture *kinds[tetromino_kinds] = {};
+};
 
-                    lines_cleared_so_far += 1;
-                    score += grid_width * 10 * lines_cleared_so_far;
-                }
-            }
+void draw_piece_textures(SDL_Renderer *renderer, PieceTextures &textures) {
+    auto tile = make_vector2(piece_texture_tile, piece_texture_tile);
+    for (u32 kind = 0; kind < tetromino_kinds; ++kind) {
+        auto texture = textures.kinds[kind];
+        if (!texture) continue;
+
+        SDL_SetRenderTarget(renderer, texture);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_TRANSPARENT);
+        SDL_RenderClear(renderer);
+        for (auto piece : tetromino_pieces(kind, 0)) {
+            draw_rect_filled(renderer, piece * tile, tile, tetromino_colour);
         }
+    }
+    SDL_SetRenderTarget(renderer, nullptr);
+}
 
-        // Check if the game is over
-        for (auto &locked : locked_in) {
-            if (locked.coordinate.y == 0) {
-                game_state = GameState::game_over;
-            }
+PieceTextures make_piece_textures(SDL_Renderer *renderer) {
+    PieceTextures textures;
+    for (auto &texture : textures.kinds) {
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                    4 * piece_texture_tile, 2 * piece_texture_tile);
+        if (!texture) {
+            log_warning("Could not make piece textures, the side panel is off: {}", SDL_GetError());
+            break;
         }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
     }
 
-    return score;
+    draw_piece_textures(renderer, textures);
+    return textures;
+}
+
+void destroy_piece_textures(PieceTextures &textures) {
+    for (auto &texture : textures.kinds) {
+        if (texture) SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
+}
+
+void draw_piece(SDL_Renderer *renderer, PieceTextures &textures, u32 kind, Vector2<int> position, i32 tile, bool is_dimmed) {
+    auto texture = textures.kinds[kind];
+    if (!texture) return;
+
+    SDL_Rect rect;
+    rect.x = position.x;
+    rect.y = position.y;
+    rect.w = 4 * tile;
+    rect.h = 2 * tile;
+
+    if (is_dimmed) SDL_SetTextureColorMod(texture, 96, 96, 96);
+    SDL_RenderCopy(renderer, texture, NULL, &rect);
+    if (is_dimmed) SDL_SetTextureColorMod(texture, 255, 255, 255);
+}
+
+// The held piece, greyed once it's been used on the falling piece, and the
+// next `preview_count` kinds, in the side panel with its top left at `origin`.
+void draw_side_panel(SDL_Renderer *renderer, TTF_Font *font, PieceTextures &textures, Game &game,
+                     Vector2<int> origin, Vector2<int> tile_size, u32 preview_count) {
+    if (game.state != GameState::playing) return;
+
+    // Pieces are 4 tiles wide at most, so they're drawn smaller than the
+    // board's to fit 3 tiles with a margin, and smaller again if the queue
+    // wouldn't fit the height.
+    auto label_height = tile_size.y / 2;
+    auto margin = tile_size.x / 5;
+    auto queue_top = 2 * label_height + 3 * tile_size.y / 2;
+    auto queue_height = grid_height * tile_size.y - queue_top;
+    auto tile = std::min((side_panel_tiles * tile_size.x - 2 * margin) / 4, queue_height * 2 / (i32)(preview_count * 5));
+
+    draw_text(renderer, font, origin + make_vector2(margin, 0), "Hold");
+    if (game.has_held) {
+        draw_piece(renderer, textures, game.held_kind, origin + make_vector2(margin, label_height), tile, game.is_hold_used);
+    }
+
+    draw_text(renderer, font, origin + make_vector2(margin, queue_top - label_height), "Next");
+    for (u32 i = 0; i < preview_count; ++i) {
+        auto position = origin + make_vector2(margin, queue_top + (i32)i * tile * 5 / 2);
+        draw_piece(renderer, textures, peek_next_kind(game, i), position, tile, false);
+    }
+}
+
+// Every live particle as a quad, drawn in one SDL_RenderGeometry call. The
+// buffers are sized for a full pool up front, so drawing never allocates.
+struct ParticleBatch {
+    Vec<SDL_Vertex> vertices = {};
+    Vec<int> indices = {};
+};
+
+ParticleBatch make_particle_batch() {
+    ParticleBatch batch;
+    batch.vertices.resize(particle_capacity * 4);
+    batch.indices.resize(particle_capacity * 6);
+
+    for (usize i = 0; i < particle_capacity; ++i) {
+        auto first = (int)(i * 4);
+        auto indices = &batch.indices[i * 6];
+        indices[0] = first;
+        indices[1] = first + 1;
+        indices[2] = first + 2;
+        indices[3] = first + 2;
+        indices[4] = first + 1;
+        indices[5] = first + 3;
+    }
+
+    return batch;
+}
+
+void draw_particles(SDL_Renderer *renderer, ParticleBatch &batch, const Particles &particles, Vector2<int> tile_size) {
+    if (particles.count == 0) return;
+
+    auto scale = make_vector2((f32)tile_size.x, (f32)tile_size.y);
+    auto half = (f32)tile_size.x * particle_size * 0.5f;
+
+    for (usize i = 0; i < particles.count; ++i) {
+        auto colour = particles.colour[i];
+        auto alpha = std::min(particles.life[i] * particles.fade[i], 1.0f) * (f32)colour_a(colour);
+        SDL_Color sdl_colour = {colour_r(colour), colour_g(colour), colour_b(colour), (u8)alpha};
+
+        auto x = particles.x[i] * scale.x;
+        auto y = particles.y[i] * scale.y;
+        auto vertices = &batch.vertices[i * 4];
+        vertices[0] = {{x - half, y - half}, sdl_colour, {0.0f, 0.0f}};
+        vertices[1] = {{x + half, y - half}, sdl_colour, {0.0f, 0.0f}};
+        vertices[2] = {{x - half, y + half}, sdl_colour, {0.0f, 0.0f}};
+        vertices[3] = {{x + half, y + half}, sdl_colour, {0.0f, 0.0f}};
+    }
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderGeometry(renderer, nullptr, batch.vertices.data(), (int)particles.count * 4, batch.indices.data(), (int)particles.count * 6);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+}
+
+// Startup timing, logged once the first frame is on screen.
+struct StartupStep {
+    const char *name = "";
+    f64 milliseconds = 0.0;
+};
+
+using StartupClock = std::chrono::steady_clock;
+
+void log_startup_timing(const Vec<StartupStep> &steps) {
+    f64 previous = 0.0;
+    log_info("Startup took {:.2f} ms to the first frame", steps.empty() ? 0.0 : steps.back().milliseconds);
+    for (auto &step : steps) {
+        log_note("{:>14}: {:7.2f} ms (+{:.2f} ms)", step.name, step.milliseconds, step.milliseconds - previous);
+        previous = step.milliseconds;
+    }
 }
 
 int main(int argc, char *argv[]) {
-    // Init SDL
-    SDL_Init(SDL_INIT_EVERYTHING);
+    auto options = parse_options(argc, argv);
+
+    auto startup_begin = StartupClock::now();
+    Vec<StartupStep> startup_steps = {};
+    auto mark_startup = [&](const char *name) {
+        StartupStep step;
+        step.name = name;
+        step.milliseconds = std::chrono::duration<f64, std::milli>(StartupClock::now() - startup_begin).count();
+        startup_steps.push_back(step);
+    };
+
+    // Init SDL. Only what we use: joystick and haptics are slow to bring up
+    // and the game has no use for them, and audio_open brings up audio.
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0) {
+        log_fatal("Could not initialise SDL: {}", SDL_GetError());
+    }
+    mark_startup("SDL_Init");
+
     TTF_Init();
+    mark_startup("TTF_Init");
+
+    // The archive is built next to the binary, so the game runs from any
+    // working directory. Loose files are a fallback for development.
+    Path executable_directory = {};
+    if (auto base_path = SDL_GetBasePath()) {
+        executable_directory = base_path;
+        SDL_free(base_path);
+    }
 
-    auto window_width = grid_width * tile_width;
+    AssetManager assets = {};
+    assets_start(assets, executable_directory / "assets.pak", "assets");
+    auto font_handle = assets_load_font(assets, "fonts/font.ttf", 24);
+
+    auto board_count = options.is_versus ? (i32)options.lockstep.player_count : 1;
+    auto board_tiles = grid_width + side_panel_tiles;
+    auto window_width = board_tiles * tile_width * board_count;
     auto window_height = grid_height * tile_height;
 
     SDL_Window *window = SDL_CreateWindow("SDL2Test", SDL_WINDOWPOS_UNDEFINED,
                                           SDL_WINDOWPOS_UNDEFINED, window_width,
                                           window_height, 0);
+    mark_startup("window");
+
     SDL_Renderer *renderer =
         SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-
-    auto font = TTF_OpenFont("assets/fonts/font.ttf", 24);
-    auto font_colour = SDL_Color{255, 255, 255};
-    auto font_surface = TTF_RenderText_Solid(font, "Hello World", font_colour);
-    auto font_texture = SDL_CreateTextureFromSurface(renderer, font_surface);
+    mark_startup("renderer");
+
+    auto piece_textures = make_piece_textures(renderer);
+    auto particles = std::make_unique<Particles>();
+    auto particle_batch = make_particle_batch();
+
+    // The mixer reads the sounds from the audio thread once the device is
+    // open, so they're all made first.
+    Mixer mixer = {};
+    auto game_sounds = add_game_sounds(&mixer);
+
+    AudioDevice audio_device = {};
+    auto opened = audio_open(&mixer);
+    if (opened.isOk()) {
+        audio_device = std::move(opened).unwrap();
+    } else {
+        log_warning("Could not open an audio device, sound is off: {}", opened.unwrapErr().message);
+    }
+    mark_startup("audio");
 
     // Init game state
-    Tetromino tetromino = {};
-    Vec<LockedIn> locked_in = {};
-    u32 score = 0;
+    Game game = make_game(grid_width, grid_height, SDL_GetPerformanceCounter());
+
+    // Simulated time is SDL ticks minus this offset, so a loaded game resumes
+    // with the same time left until its next gravity step.
+    u32 time_offset = SDL_GetTicks();
+
+    // Events queued before a load carry ticks from before the loaded game's
+    // time; never hand the simulation a time it has already passed.
+    auto to_game_time = [&](u32 ticks) {
+        return (u32)std::max((i64)ticks - (i64)time_offset, (i64)game.time);
+    };
+
+    Input input = {};
+    InputCommand input_commands[input_queue_capacity];
+
+    // Versus match, stepped in fixed ticks as inputs arrive from every player,
+    // or ahead of them with rollback. Without it the session only ever waits.
+    RollbackSession session = {};
+    auto &versus = session.versus;
+    InputCommand versus_commands[input_queue_capacity];
+    usize versus_command_count = 0;
+    bool is_soft_dropping = false;
+    f32 versus_time = 0.0f; // ms not yet simulated.
+
+    if (options.is_versus) {
+        auto started = lockstep_start(options.lockstep, SDL_GetPerformanceCounter());
+        if (started.isErr()) {
+            auto error = started.unwrapErr();
+            if (error.error_kind == NetError::Kind::invalid_config) log_fatal("Lockstep can't run with these options");
+            log_fatal("Could not open UDP port {} for the match", error.port);
+        }
 
-    next_tetromino(tetromino);
+        auto match = make_versus(options.lockstep.player_count, grid_width, grid_height, options.seed);
+        rollback_start(session, std::move(started).unwrap(), match, options.rollback_ticks);
+
+        log_info("Joined a {} player match as player {} on port {}", options.lockstep.player_count,
+                 options.lockstep.local_player + 1, session.transport.socket.port);
+    }
+
+    Telemetry telemetry = {};
+    TelemetryConfig telemetry_config = {};
+    telemetry_config.path = telemetry_path;
+    if (telemetry_open(&telemetry, telemetry_config).isErr()) {
+        log_warning("Could not open telemetry file {}, telemetry is off", telemetry_path);
+    }
+    u32 telemetry_started = SDL_GetTicks();
+
+    mark_startup("game state");
+    bool is_first_frame = true;
 
     // Game loop
     while (running) {
@@ -293,51 +525,37 @@ int main(int argc, char *argv[]) {
             if (event.type == SDL_QUIT) {
                 running = false;
             }
-            else if (event.type == SDL_KEYDOWN) {
-                switch (event.key.keysym.sym) {
-                case SDLK_ESCAPE: {
-                    running = false;
-                } break;
-
-                case SDLK_s: {
-                    frame_time = default_frame_time / speed_up_factor;
-                } break;
-
-                case SDLK_a: {
-                    if (game_state == GameState::playing) {
-                        tetromino.coordinate.x -= 1;
-                        if (!tetromino_fits(tetromino, make_vector2(0, 0),
-                                            locked_in)) {
-                            tetromino.coordinate.x += 1;
-                        }
-                    }
-                } break;
-
-                case SDLK_d: {
-                    if (game_state == GameState::playing) {
-                        tetromino.coordinate.x += 1;
-                        if (!tetromino_fits(tetromino, make_vector2(0, 0),
-                                            locked_in)) {
-                            tetromino.coordinate.x -= 1;
-                        }
-                    }
-                } break;
-
-                case SDLK_SPACE: {
-                    if (game_state == GameState::playing) {
-                        auto did_rotate =
-                            rotate_tetromino(tetromino, locked_in);
-                    }
-                } break;
+            else if (event.type == SDL_RENDER_TARGETS_RESET) {
+                draw_piece_textures(renderer, piece_textures);
+            }
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE) {
+                running = false;
+            }
+            else if (event.type == SDL_KEYDOWN && options.is_versus && (event.key.keysym.sym == SDLK_F5 || event.key.keysym.sym == SDLK_F9)) {
+                log_warning("Saving and loading are off in versus matches");
+            }
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F5) {
+                auto saved = save_game(game, quicksave_path);
+                if (saved.isOk()) {
+                    log_info("Saved game to {}", quicksave_path);
+                } else {
+                    log_error("Could not save game to {}", quicksave_path);
                 }
             }
-            else if (event.type == SDL_KEYUP) {
-                switch (event.key.keysym.sym) {
-                case SDLK_s: {
-                    frame_time = default_frame_time;
-                } break;
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9) {
+                auto loaded = load_game(quicksave_path);
+                if (loaded.isOk()) {
+                    game = std::move(loaded).unwrap();
+                    mixer_stop_all(&mixer);
+                    time_offset = SDL_GetTicks() - game.time;
+                    log_info("Loaded game from {}", quicksave_path);
+                } else {
+                    log_error("Could not load game from {} (error {})", quicksave_path, (int)loaded.unwrapErr().error_kind);
                 }
             }
+            else {
+                input_handle_event(input, event);
+            }
         }
 
         last = now;
@@ -345,129 +563,161 @@ int main(int argc, char *argv[]) {
         delta_time = (f32)((now - last) / (f32)SDL_GetPerformanceFrequency());
         current_frame_time += delta_time;
 
-        // Try to move the tetromino
-        score += try_to_move_tetromino(tetromino, locked_in);
-
-        // Update the clear time
-        // clear_t += delta_time;
-        Vec<i32> lines_cleared = {};
-        for (auto it = locked_in.begin(); it != locked_in.end();) {
-            if (it->is_clearing) {
-                if (it->clear_t < clear_animation_time) {
-                    it->clear_t += delta_time;
-                    ++it;
-                } else {
-                    if (lines_cleared.end() == std::find(lines_cleared.begin(), lines_cleared.end(), it->coordinate.y)) {
-                        lines_cleared.push_back(it->coordinate.y);
-                    }
+        auto update_begin = now;
 
-                    it = locked_in.erase(it);
-                }
+        auto now_ticks = SDL_GetTicks();
+        auto command_count = input_update(input, now_ticks, input_commands, input_queue_capacity);
+
+        if (options.is_versus) {
+            // Commands gather until the next tick's input is read; the match
+            // only moves on in whole ticks, once every player's input is in.
+            for (usize i = 0; i < command_count && versus_command_count < input_queue_capacity; ++i) {
+                versus_commands[versus_command_count++] = input_commands[i];
             }
-            else if (it->is_dropping) {
-                if (it->drop_t < drop_animation_time) {
-                    it->drop_t += delta_time;
-                    ++it;
-                }
-                else {
-                    it->is_dropping = false;
-                    it->coordinate.y += 1;
-
-                    // If there are any empty lines, push down lines above them
-                    for (auto y = 0; y < grid_height; ++y) {
-                        bool line_is_empty = true;
-                        for (auto x = 0; x < grid_width; ++x) {
-                            auto piece_exists = locked_in.end() != std::find_if(locked_in.begin(), locked_in.end(), [&](LockedIn &locked) {
-                                return vector2_equal(locked.coordinate, make_vector2(x, y));
-                            });
-                            if (!piece_exists) line_is_empty = false;
-                        }
-
-                        if (line_is_empty) {
-                            for (auto &locked : locked_in) {
-                                if (locked.coordinate.y < y && !locked.is_dropping) {
-                                    locked.is_dropping = true;
-                                    locked.drop_t = 0.0f;
-                                }
-                            }
-                        }
+
+            lockstep_poll(&session.transport, now_ticks);
+            versus_time += delta_time * 1000.0f;
+
+            while (versus_time >= (f32)versus_tick_ms) {
+                if (lockstep_needs_local_input(session.transport)) {
+                    auto tick_input = versus_encode_input(versus_commands, versus_command_count, is_soft_dropping);
+                    lockstep_add_local_input(&session.transport, tick_input);
+                    lockstep_poll(&session.transport, now_ticks);
+
+                    for (usize i = 0; i < versus_command_count; ++i) {
+                        input_mark_applied(input, versus_commands[i]);
                     }
+                    versus_command_count = 0;
+                }
 
-                    ++it;
+                if (!rollback_advance(session)) {
+                    // Waiting on a peer. Don't bank more than a few ticks to
+                    // catch up on, or a long stall ends in a fast-forward.
+                    versus_time = std::min(versus_time, (f32)(versus_tick_ms * 4));
+                    break;
                 }
+
+                versus_time -= (f32)versus_tick_ms;
             }
-            else {
-                ++it;
+        } else {
+            // Apply input at the time it happened, letting gravity catch up to
+            // each command first so moves and drops interleave correctly.
+            for (usize i = 0; i < command_count; ++i) {
+                auto command = input_commands[i];
+                command.timestamp = to_game_time(command.timestamp);
+
+                try_to_move_tetromino(game, command.timestamp);
+                if (apply_input_command(game, command)) {
+                    input_mark_applied(input, input_commands[i]);
+                }
             }
+
+            // Try to move the tetromino
+            try_to_move_tetromino(game, to_game_time(now_ticks));
+
+            update_animations(game, delta_time);
         }
 
-        // Move the lines down
-        for (auto &line : lines_cleared) {
-            for (auto &locked : locked_in) {
-                if (locked.coordinate.y < line && !locked.is_dropping) {
-                    locked.is_dropping = true;
-                    locked.drop_t = 0.0f;
-                }
-            }
+        assets_update(assets);
+
+        auto &shown_game = options.is_versus ? versus.players[options.lockstep.local_player].game : game;
+
+        for (i32 i = 0; i < board_count; ++i) {
+            auto &board_game = options.is_versus ? versus.players[(usize)i].game : game;
+            particles_spawn_for_events(*particles, board_game, make_vector2((f32)(i * board_tiles), 0.0f));
+
+            // Only the shown game's events go on to sounds and telemetry.
+            if (&board_game != &shown_game) board_game.events = {};
         }
+        particles_update(*particles, delta_time);
 
+        auto update_end = SDL_GetPerformanceCounter();
+        auto update_us = (u32)((update_end - update_begin) * 1000000 / SDL_GetPerformanceFrequency());
+        auto telemetry_time = SDL_GetTicks() - telemetry_started;
+        play_game_sounds(&mixer, game_sounds, shown_game.events);
+        record_game_events(&telemetry, shown_game, telemetry_time);
 
         // Draw
         i32 window_width, window_height;
         SDL_GetWindowSize(window, &window_width, &window_height);
 
-        auto tile_size = make_vector2(window_width / grid_width, window_height / grid_height);
+        auto tile_size = make_vector2(window_width / board_count / board_tiles, window_height / grid_height);
+        auto font = assets_font(assets, font_handle);
 
         SDL_SetRenderDrawColor(renderer, 255, 0, 255, SDL_ALPHA_OPAQUE);
         SDL_RenderClear(renderer);
 
-        if (game_state == GameState::playing) {
-            for (i32 y = 0; y < grid_height; ++y) {
-                for (i32 x = 0; x < grid_width; ++x) {
-                    draw_rect_filled(renderer, make_vector2(x * tile_size.x, y * tile_size.y), tile_size, make_colour(0.1f, 0.1f, 0.1f, 1.0f));
-                }
+        for (i32 i = 0; i < board_count; ++i) {
+            auto &board_game = options.is_versus ? versus.players[(usize)i].game : game;
+            auto origin = make_vector2(i * board_tiles * tile_size.x, 0);
+            draw_game(renderer, board_game, origin, tile_size);
+            draw_side_panel(renderer, font, piece_textures, board_game, origin + make_vector2(grid_width * tile_size.x, 0),
+                            tile_size, options.preview_count);
+        }
+        draw_particles(renderer, particle_batch, *particles, tile_size);
+
+        auto score_string = std::to_string(shown_game.score);
+        if (options.is_versus) {
+            auto winner = versus_winner(versus);
+            auto waiting_for = lockstep_waiting_for(session.transport);
+            if (winner >= 0) {
+                score_string += fmt::format("  Player {} wins", winner + 1);
+            } else if (waiting_for != options.lockstep.player_count && versus_time >= (f32)(versus_tick_ms * 4)) {
+                score_string += fmt::format("  Waiting for player {}", waiting_for + 1);
             }
+        }
+        draw_text(renderer, font, make_vector2(0, 0), score_string.c_str(), 255, 0, 0);
 
-            for (auto &piece : tetromino.pieces) {
-                draw_rect_filled(
-                    renderer,
-                    make_vector2(
-                        (tetromino.coordinate.x + piece.x) * tile_width,
-                        (tetromino.coordinate.y + piece.y) * tile_height),
-                    make_vector2(tile_width, tile_height),
-                    make_colour(0.6f, 0.1f, 0.3f, 1.0f));
-            }
+        auto frame_string = histogram_overlay_line("Frame", frame_histogram);
+        draw_text(renderer, font, make_vector2(0, 20), frame_string.c_str(), 255, 0, 0);
 
-            draw_rect_filled(
-                renderer,
-                make_vector2((tetromino.coordinate.x) * tile_width,
-                             (tetromino.coordinate.y) * tile_height),
-                make_vector2(10, 10), make_colour(0.0f, 1.0f, 1.0f, 1.0f));
+        auto tick_string = histogram_overlay_line("Tick", tick_histogram);
+        draw_text(renderer, font, make_vector2(0, 40), tick_string.c_str(), 255, 0, 0);
 
-            for (auto &locked : locked_in) {
-                auto size_multiplier = 1.0f - (locked.clear_t / clear_animation_time);
-                auto size = make_vector2((int)(tile_width), (int)(tile_height * size_multiplier));
+        auto render_string = histogram_overlay_line("Render", render_histogram);
+        draw_text(renderer, font, make_vector2(0, 60), render_string.c_str(), 255, 0, 0);
 
-                auto position = make_vector2(locked.coordinate.x * tile_width, locked.coordinate.y * tile_height);
-                if (locked.is_dropping) {
-                    position.y += (tile_height * locked.drop_t / drop_animation_time);
-                }
+        auto latency_string = histogram_overlay_line("Input", input_latency_histogram);
+        draw_text(renderer, font, make_vector2(0, 80), latency_string.c_str(), 255, 0, 0);
 
-                draw_rect_filled(renderer, position, size, locked.colour);
+        SDL_RenderPresent(renderer);
 
-                draw_rect_filled(renderer, position, vector2_div(size, 10), make_colour(0.0f, 1.0f, 1.0f, 1.0f));
-            }
+        auto latency_samples = input.latency.samples;
+        input_mark_presented(input, SDL_GetTicks());
+        if (input.latency.samples != latency_samples) {
+            histogram_record(&input_latency_histogram, input.latency.last * 1000);
         }
 
-        auto score_string = std::to_string(score);
-        draw_text(renderer, font, make_vector2(0, 0), score_string.c_str(), 255, 0, 0);
+        auto render_us = (u32)((SDL_GetPerformanceCounter() - update_end) * 1000000 / SDL_GetPerformanceFrequency());
+        if (!is_first_frame) {
+            // The first frame's delta covers startup, not a frame.
+            histogram_record(&frame_histogram, (u32)(delta_time * 1000000.0f));
+        }
+        histogram_record(&tick_histogram, update_us);
+        histogram_record(&render_histogram, render_us);
 
-        auto fps_string = fmt::format("FPS: {}", (int)(1.0f / delta_time));
-        draw_text(renderer, font, make_vector2(0, 20), fps_string.c_str(), 255, 0, 0);
+        telemetry_frame(&telemetry, telemetry_time, (u32)(delta_time * 1000000.0f), update_us, shown_game.score);
 
-        SDL_RenderPresent(renderer);
+        if (is_first_frame) {
+            is_first_frame = false;
+            mark_startup("first frame");
+            log_startup_timing(startup_steps);
+        }
+    }
+
+    if (options.is_versus) {
+        auto &transport = session.transport;
+        log_info("Match used {:.1f} bytes per tick over {} ticks, with {} rollbacks", (f64)transport.socket.stats.bytes_sent / std::max(transport.tick, 1u),
+                 transport.tick, session.stats.rollbacks);
+        rollback_stop(session);
     }
 
+    telemetry_close(&telemetry);
+    dump_histograms();
+    assets_stop(assets);
+
+    audio_close(&audio_device);
+    destroy_piece_textures(piece_textures);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
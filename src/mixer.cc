@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+
+#include "mixer.h"
+
+u32 mixer_add_sound(Mixer* mixer, Sound sound) {
+  mixer->sounds.push_back(std::move(sound));
+  return (u32) mixer->sounds.size() - 1;
+}
+
+static bool push_command(Mixer* mixer, const MixerCommand& command) {
+  auto& queue = mixer->queue;
+  auto head = queue.head.load(std::memory_order_relaxed);
+  if (head - queue.tail.load(std::memory_order_acquire) >= mixer_queue_capacity) {
+    mixer->dropped_commands += 1;
+    return false;
+  }
+
+  queue.commands[head % mixer_queue_capacity] = command;
+  queue.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool mixer_play(Mixer* mixer, u32 sound, f32 volume, f32 pan) {
+  MixerCommand command;
+  command.kind = MixerCommandKind::play;
+  command.sound = sound;
+  command.volume = volume;
+  command.pan = pan;
+  return push_command(mixer, command);
+}
+
+bool mixer_stop_all(Mixer* mixer) {
+  MixerCommand command;
+  command.kind = MixerCommandKind::stop_all;
+  return push_command(mixer, command);
+}
+
+bool mixer_set_volume(Mixer* mixer, f32 volume) {
+  MixerCommand command;
+  command.kind = MixerCommandKind::set_volume;
+  command.volume = volume;
+  return push_command(mixer, command);
+}
+
+static void start_voice(Mixer* mixer, const MixerCommand& command) {
+  if (command.sound >= mixer->sounds.size()) return;
+
+  auto& voices = mixer->voices;
+  MixerVoice* voice = nullptr;
+  if (voices.size() < voices.capacity()) {
+    voices.resize(voices.size() + 1);
+    voice = &voices.back();
+  } else {
+    // The one furthest along has the least left to lose.
+    voice = std::max_element(voices.begin(), voices.end(), [](auto& a, auto& b) { return a.position < b.position; });
+    mixer->stolen_voices.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Equal power, so a sound is as loud panned as centred.
+  auto angle = (std::clamp(command.pan, -1.0f, 1.0f) + 1.0f) * 0.25f * 3.14159265f;
+  voice->sound = &mixer->sounds[command.sound];
+  voice->position = 0;
+  voice->left = command.volume * std::cos(angle);
+  voice->right = command.volume * std::sin(angle);
+}
+
+static void apply_commands(Mixer* mixer) {
+  auto& queue = mixer->queue;
+  auto tail = queue.tail.load(std::memory_order_relaxed);
+  auto head = queue.head.load(std::memory_order_acquire);
+
+  for (; tail != head; ++tail) {
+    auto& command = queue.commands[tail % mixer_queue_capacity];
+    switch (command.kind) {
+    case MixerCommandKind::play:       start_voice(mixer, command); break;
+    case MixerCommandKind::stop_all:   mixer->voices.clear(); break;
+    case MixerCommandKind::set_volume: mixer->master_volume = command.volume; break;
+    }
+  }
+
+  queue.tail.store(tail, std::memory_order_release);
+}
+
+void mixer_render(Mixer* mixer, f32* out, usize frames) {
+  apply_commands(mixer);
+
+  std::fill(out, out + frames * mixer_channels, 0.0f);
+
+  auto& voices = mixer->voices;
+  for (auto it = voices.begin(); it != voices.end();) {
+    auto& samples = it->sound->samples;
+    auto count = std::min(frames, samples.size() - it->position);
+    auto in = samples.data() + it->position;
+    auto left = it->left;
+    auto right = it->right;
+
+    for (usize i = 0; i < count; ++i) {
+      out[2 * i] += in[i] * left;
+      out[2 * i + 1] += in[i] * right;
+    }
+
+    it->position += count;
+    if (it->position == samples.size()) {
+      it = voices.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  u64 clipped = 0;
+  auto volume = mixer->master_volume;
+  for (usize i = 0; i < frames * mixer_channels; ++i) {
+    auto sample = out[i] * volume;
+    clipped += sample > 1.0f || sample < -1.0f;
+    out[i] = std::clamp(sample, -1.0f, 1.0f);
+  }
+  if (clipped) mixer->clipped_samples.fetch_add(clipped, std::memory_order_relaxed);
+}
+
+static void append_le(String* out, u32 value, usize bytes) {
+  for (usize i = 0; i < bytes; ++i) out->push_back((char) (value >> (8 * i)));
+}
+
+Result<void, WriteFileError> write_wav(const Path& path, const f32* samples, usize frames) {
+  constexpr u32 bytes_per_sample = 2;
+  auto data_size = (u32) (frames * mixer_channels * bytes_per_sample);
+
+  File file;
+  file.path = path;
+  auto out = &file.contents;
+  out->reserve(44 + data_size);
+
+  out->append("RIFF");
+  append_le(out, 36 + data_size, 4);
+  out->append("WAVEfmt ");
+  append_le(out, 16, 4);
+  append_le(out, 1, 2); // PCM
+  append_le(out, mixer_channels, 2);
+  append_le(out, mixer_sample_rate, 4);
+  append_le(out, mixer_sample_rate * mixer_channels * bytes_per_sample, 4);
+  append_le(out, mixer_channels * bytes_per_sample, 2);
+  append_le(out, 8 * bytes_per_sample, 2);
+  out->append("data");
+  append_le(out, data_size, 4);
+
+  for (usize i = 0; i < frames * mixer_channels; ++i) {
+    auto sample = (i16) std::lround(std::clamp(samples[i], -1.0f, 1.0f) * 32767.0f);
+    append_le(out, (u16) sample, 2);
+  }
+
+  return write_file(file);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+
+#include "core.h"
+
+// Mixer
+//
+// Mixes sounds into interleaved stereo f32 on the audio thread. Sounds are
+// mono samples decoded up front and added before the mixer starts; after that
+// nothing about them changes, so the audio thread reads them without locks.
+//
+// The game thread never touches the voices. It pushes commands into a single
+// producer, single consumer ring that the audio thread drains at the start of
+// every buffer, and a full ring drops the command rather than waiting. The
+// audio thread never locks or allocates: voices are a fixed array, and a
+// sound started with every voice busy takes over the one furthest along.
+
+constexpr u32 mixer_sample_rate = 48000;
+constexpr u32 mixer_channels = 2;
+constexpr usize mixer_max_voices = 32;
+constexpr usize mixer_queue_capacity = 64;
+
+struct Sound {
+  Vec<f32> samples = {}; // Mono, at mixer_sample_rate.
+};
+
+enum class MixerCommandKind : u8 {
+  play,
+  stop_all,
+  set_volume,
+};
+
+struct MixerCommand {
+  MixerCommandKind kind = MixerCommandKind::play;
+  u32 sound = 0;
+  f32 volume = 1.0f; // Of the voice, or the master volume for set_volume.
+  f32 pan = 0.0f;    // -1 left to 1 right.
+};
+
+// Positions only ever grow; the slot is position % capacity.
+struct MixerQueue {
+  alignas(64) std::atomic<u64> head = 0; // Published by the game thread.
+  alignas(64) std::atomic<u64> tail = 0; // Published by the audio thread.
+  MixerCommand commands[mixer_queue_capacity] = {};
+};
+
+struct MixerVoice {
+  const Sound* sound = nullptr;
+  usize position = 0; // Next sample to play.
+  f32 left = 0.0f;
+  f32 right = 0.0f;
+};
+
+struct Mixer {
+  Vec<Sound> sounds = {};
+  MixerQueue queue = {};
+
+  // Audio thread only.
+  FixedVec<MixerVoice, mixer_max_voices> voices = {};
+  f32 master_volume = 0.5f;
+
+  u64 dropped_commands = 0;             // Game thread only.
+  std::atomic<u64> stolen_voices = 0;   // Written by the audio thread.
+  std::atomic<u64> clipped_samples = 0; // Written by the audio thread.
+};
+
+// Before the mixer starts only. Returns the index to play the sound by.
+u32 mixer_add_sound(Mixer* mixer, Sound sound);
+
+// Game thread. Return false if the queue was full and the command dropped.
+bool mixer_play(Mixer* mixer, u32 sound, f32 volume = 1.0f, f32 pan = 0.0f);
+bool mixer_stop_all(Mixer* mixer);
+bool mixer_set_volume(Mixer* mixer, f32 volume);
+
+// Audio thread. Applies queued commands, then overwrites `out` with `frames`
+// frames of interleaved stereo, clamped to -1 to 1.
+void mixer_render(Mixer* mixer, f32* out, usize frames);
+
+// 16-bit PCM stereo at mixer_sample_rate, from interleaved stereo f32.
+Result<void, WriteFileError> write_wav(const Path& path, const f32* samples, usize frames);
@@ -0,0 +1,143 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "net.h"
+
+NetAddress make_net_address(u32 ip, u16 port) {
+  NetAddress address;
+  address.ip = ip;
+  address.port = port;
+  return address;
+}
+
+bool parse_net_ip(StringView text, u32* ip) {
+  String terminated(text);
+  in_addr address = {};
+  if (inet_pton(AF_INET, terminated.c_str(), &address) != 1) return false;
+
+  *ip = ntohl(address.s_addr);
+  return true;
+}
+
+static sockaddr_in to_sockaddr(NetAddress address) {
+  sockaddr_in result = {};
+  result.sin_family = AF_INET;
+  result.sin_addr.s_addr = htonl(address.ip);
+  result.sin_port = htons(address.port);
+  return result;
+}
+
+Result<NetSocket, NetError> net_open(u16 port, const NetConditions& conditions, u64 seed) {
+  NetError error;
+  error.port = port;
+
+  auto fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    error.error_kind = NetError::Kind::socket_failed;
+    return Err(error);
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, (const sockaddr*) &address, sizeof(address)) != 0) {
+    close(fd);
+    error.error_kind = NetError::Kind::bind_failed;
+    return Err(error);
+  }
+
+  NetSocket socket;
+  socket.fd = fd;
+  socket.port = port;
+  socket.conditions = conditions;
+  socket.random_state = seed;
+  return Ok(std::move(socket));
+}
+
+void net_close(NetSocket* socket) {
+  if (socket->fd >= 0) {
+    close(socket->fd);
+  }
+
+  *socket = {};
+}
+
+static void send_now(NetSocket* socket, NetAddress to, StringView bytes) {
+  auto address = to_sockaddr(to);
+  auto sent = sendto(socket->fd, bytes.data(), bytes.size(), 0, (const sockaddr*) &address, sizeof(address));
+
+  // A full send buffer is as good as a lost packet to UDP; the protocol on
+  // top resends whatever it still needs.
+  if (sent != (ssize_t) bytes.size()) {
+    socket->stats.packets_dropped += 1;
+    return;
+  }
+
+  socket->stats.packets_sent += 1;
+  socket->stats.bytes_sent += bytes.size();
+}
+
+void net_send(NetSocket* socket, NetAddress to, StringView bytes, u32 now) {
+  log_assert(bytes.size() <= net_max_packet_size, "Packet of {} bytes is over the {} byte limit", bytes.size(), net_max_packet_size);
+
+  auto& conditions = socket->conditions;
+  if (conditions.latency == 0 && conditions.jitter == 0 && conditions.loss <= 0.0f) {
+    send_now(socket, to, bytes);
+    return;
+  }
+
+  auto random = random_next(&socket->random_state);
+  if ((f32) (random >> 40) / (f32) (1 << 24) < conditions.loss) {
+    socket->stats.packets_dropped += 1;
+    return;
+  }
+
+  NetDelayedPacket packet;
+  packet.send_at = now + conditions.latency;
+  if (conditions.jitter > 0) {
+    packet.send_at += (u32) (random % (conditions.jitter + 1));
+  }
+  packet.to = to;
+  packet.bytes = String(bytes);
+  socket->delayed.push_back(std::move(packet));
+}
+
+void net_flush(NetSocket* socket, u32 now) {
+  auto& delayed = socket->delayed;
+
+  // Jitter can let a later packet overtake an earlier one, as on a real link.
+  auto due = std::stable_partition(delayed.begin(), delayed.end(), [&](const NetDelayedPacket& packet) {
+    return (i32) (packet.send_at - now) <= 0;
+  });
+
+  for (auto it = delayed.begin(); it != due; ++it) {
+    send_now(socket, it->to, it->bytes);
+  }
+  delayed.erase(delayed.begin(), due);
+}
+
+bool net_receive(NetSocket* socket, String* bytes, NetAddress* from) {
+  bytes->resize(net_max_packet_size);
+
+  sockaddr_in address = {};
+  socklen_t address_size = sizeof(address);
+  auto received = recvfrom(socket->fd, bytes->data(), bytes->size(), 0, (sockaddr*) &address, &address_size);
+  if (received < 0) {
+    bytes->clear();
+    return false;
+  }
+
+  bytes->resize((usize) received);
+  from->ip = ntohl(address.sin_addr.s_addr);
+  from->port = ntohs(address.sin_port);
+
+  socket->stats.packets_received += 1;
+  socket->stats.bytes_received += (usize) received;
+  return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core.h"
+
+// Networking
+//
+// Non-blocking UDP sockets, plus a stand-in for a real network: outgoing
+// packets can be held back by a fixed latency and random jitter, or dropped,
+// before they are handed to the kernel. Two games on one machine talking over
+// loopback can then be made to behave like they are across the internet.
+//
+// Times are ms on whatever clock the caller uses; the socket only compares
+// them against each other.
+
+constexpr u32 net_loopback_ip = 0x7F000001; // 127.0.0.1
+constexpr usize net_max_packet_size = 1200;  // Stays under common MTUs.
+
+// Host byte order.
+struct NetAddress {
+  u32 ip = 0;
+  u16 port = 0;
+
+  friend bool operator==(NetAddress, NetAddress) = default;
+};
+
+NetAddress make_net_address(u32 ip, u16 port);
+
+// Dotted IPv4, e.g. "192.168.0.2".
+bool parse_net_ip(StringView text, u32* ip);
+
+struct NetConditions {
+  u32 latency = 0;  // ms added to every packet, one way.
+  u32 jitter = 0;   // Up to this many ms more, uniformly at random.
+  f32 loss = 0.0f;  // Chance a packet is dropped, 0 to 1.
+};
+
+struct NetDelayedPacket {
+  u32        send_at = 0;
+  NetAddress to = {};
+  String     bytes = {};
+};
+
+struct NetStats {
+  u64 packets_sent = 0;
+  u64 bytes_sent = 0; // Payload only, excluding UDP/IP headers.
+  u64 packets_dropped = 0;
+  u64 packets_received = 0;
+  u64 bytes_received = 0;
+};
+
+struct NetSocket {
+  int fd = -1;
+  u16 port = 0;
+
+  NetConditions conditions = {};
+  Vec<NetDelayedPacket> delayed = {};
+  u64 random_state = 0;
+
+  NetStats stats = {};
+};
+
+struct NetError {
+  enum class Kind {
+    none,
+    socket_failed,
+    bind_failed,
+    invalid_config, // From lockstep_start, for a config it can't run.
+  };
+
+  NetError::Kind error_kind = NetError::Kind::none;
+  u16            port       = 0;
+};
+
+// Binds to `port` on every interface. `seed` drives the simulated loss and
+// jitter, so a run with the same seed drops the same packets.
+Result<NetSocket, NetError> net_open(u16 port, const NetConditions& conditions, u64 seed);
+void net_close(NetSocket* socket);
+
+// Sends right away when no latency or loss is simulated; otherwise the packet
+// waits in the socket until a net_flush at or after its send time.
+void net_send(NetSocket* socket, NetAddress to, StringView bytes, u32 now);
+void net_flush(NetSocket* socket, u32 now);
+
+// Returns false once nothing is waiting. `bytes` is resized to the packet.
+bool net_receive(NetSocket* socket, String* bytes, NetAddress* from);
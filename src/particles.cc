@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cmath>
+
+#include "particles.h"
+
+constexpr f32 particle_gravity = 30.0f; // Tiles per second squared.
+constexpr f32 particle_drag = 2.0f;     // Fraction of speed lost per second.
+constexpr f32 particle_min_life = 0.3f;
+constexpr f32 particle_max_life = 0.8f;
+
+constexpr usize clear_particles_per_cell = 24;
+constexpr f32 clear_particle_speed = 8.0f;
+
+constexpr Colour hard_drop_colour = make_colour(0.9f, 0.85f, 0.95f, 1.0f);
+
+static f32 random_unit(Particles &particles) {
+    return (f32)(random_next(&particles.random_state) >> 40) / (f32)(1 << 24);
+}
+
+void particles_burst(Particles &particles, Vector2<f32> centre, usize count, f32 speed, Colour colour) {
+    count = std::min(count, particle_capacity - particles.count);
+
+    for (usize i = particles.count; i < particles.count + count; ++i) {
+        auto angle = random_unit(particles) * 6.28318531f;
+        auto velocity = speed * (0.25f + 0.75f * random_unit(particles));
+        auto lifetime = particle_min_life + (particle_max_life - particle_min_life) * random_unit(particles);
+
+        particles.x[i] = centre.x;
+        particles.y[i] = centre.y;
+        particles.velocity_x[i] = velocity * std::cos(angle);
+        particles.velocity_y[i] = velocity * std::sin(angle);
+        particles.life[i] = lifetime;
+        particles.fade[i] = 1.0f / lifetime;
+        particles.colour[i] = colour;
+    }
+
+    particles.count += count;
+}
+
+void particles_spawn_for_events(Particles &particles, const Game &game, Vector2<f32> origin) {
+    auto &events = game.events;
+    auto cell_centre = [&](Coordinate cell) {
+        return origin + make_vector2((f32)cell.x + 0.5f, (f32)cell.y + 0.5f);
+    };
+
+    if (events.clearing_rows) {
+        for (auto &locked : game.locked_in) {
+            if (!locked.is_clearing || !(events.clearing_rows & (1u << locked.coordinate.y))) continue;
+            particles_burst(particles, cell_centre(locked.coordinate), clear_particles_per_cell, clear_particle_speed, locked.colour);
+        }
+    }
+
+    // Dust off the bottom of the landed piece, more the further it fell.
+    if (events.hard_drops > 0) {
+        auto &tetromino = events.hard_dropped;
+        auto count = (usize)(4 + std::min(events.hard_drop_distance, game.board.height));
+        for (auto piece : tetromino.pieces) {
+            auto centre = cell_centre(tetromino.coordinate + piece) + make_vector2(0.0f, 0.5f);
+            particles_burst(particles, centre, count, 4.0f, hard_drop_colour);
+        }
+    }
+}
+
+static void copy_particle(Particles &particles, usize to, usize from) {
+    particles.x[to] = particles.x[from];
+    particles.y[to] = particles.y[from];
+    particles.velocity_x[to] = particles.velocity_x[from];
+    particles.velocity_y[to] = particles.velocity_y[from];
+    particles.life[to] = particles.life[from];
+    particles.fade[to] = particles.fade[from];
+    particles.colour[to] = particles.colour[from];
+}
+
+void particles_update(Particles &particles, f32 delta_time) {
+    auto count = particles.count;
+    auto drag = std::max(1.0f - particle_drag * delta_time, 0.0f);
+    auto fall = particle_gravity * delta_time;
+
+    // No branches and no calls, and the arrays are members of one struct so
+    // they can't alias: this compiles to SIMD.
+    for (usize i = 0; i < count; ++i) {
+        particles.velocity_x[i] *= drag;
+        particles.velocity_y[i] = particles.velocity_y[i] * drag + fall;
+        particles.x[i] += particles.velocity_x[i] * delta_time;
+        particles.y[i] += particles.velocity_y[i] * delta_time;
+        particles.life[i] -= delta_time;
+    }
+
+    for (usize i = 0; i < particles.count;) {
+        if (particles.life[i] > 0.0f) {
+            ++i;
+            continue;
+        }
+
+        particles.count -= 1;
+        copy_particle(particles, i, particles.count);
+    }
+}
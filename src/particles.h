@@ -0,0 +1,42 @@
+#pragma once
+
+#include "core.h"
+#include "game.h"
+
+// Particles
+//
+// Bursts of small squares thrown off by line clears and hard drops. They are
+// only for show, so they live outside Game, where snapshots, rollback and
+// checksums never see them.
+//
+// Every field is an array of its own, and the pool never grows: a burst that
+// doesn't fit is cut short. Live particles are packed at the front, dead ones
+// swapped out for the last live one, so the update is straight loops over
+// floats that the compiler vectorises. Positions are in tiles from the top
+// left of the window, so one pool and one draw call covers every board.
+
+constexpr usize particle_capacity = 16384;
+
+struct Particles {
+    usize count = 0;
+
+    alignas(64) f32 x[particle_capacity] = {};
+    alignas(64) f32 y[particle_capacity] = {};
+    alignas(64) f32 velocity_x[particle_capacity] = {}; // Tiles per second.
+    alignas(64) f32 velocity_y[particle_capacity] = {};
+    alignas(64) f32 life[particle_capacity] = {}; // Seconds left.
+    alignas(64) f32 fade[particle_capacity] = {}; // 1 / lifetime, so life * fade is the alpha.
+    alignas(64) Colour colour[particle_capacity] = {};
+
+    u64 random_state = 1;
+};
+
+// `count` particles from `centre`, thrown up to `speed` tiles per second in
+// random directions.
+void particles_burst(Particles &particles, Vector2<f32> centre, usize count, f32 speed, Colour colour);
+
+// Bursts for what `game.events` says happened, on a board drawn `origin`
+// tiles from the top left of the window. Call it before the events are reset.
+void particles_spawn_for_events(Particles &particles, const Game &game, Vector2<f32> origin);
+
+void particles_update(Particles &particles, f32 delta_time);
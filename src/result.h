@@ -1,25 +1,36 @@
 
-/* 
+/*
    Mathieu Stefani, 03 mai 2016
-   
+
    This header provides a Result type that can be used to replace exceptions in code
    that has to handle error.
 
    Result<T, E> can be used to return and propagate an error to the caller. Result<T, E> is an algebraic
    data type that can either Ok(T) to represent success or Err(E) to represent an error.
+
+   Result is constexpr-usable and copying, moving and destroying it are
+   trivial whenever they are for T and E. When both are trivially copyable
+   it is a union and a flag, so a Result<i32, SomeErrorKind> is built and
+   returned in a register, like a bare return code; otherwise it is a
+   std::variant. tools/result_bench checks this and compares its speed and
+   code size with return codes, std::optional and exceptions.
 */
 
 #pragma once
 
-#include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
 #include <functional>
 #include <type_traits>
+#include <utility>
+#include <variant>
 
 namespace ErrorTypes {
     template<typename T>
     struct Ok {
-        Ok(const T& val) : val(val) { }
-        Ok(T&& val) : val(std::move(val)) { }
+        constexpr Ok(const T& val) : val(val) { }
+        constexpr Ok(T&& val) : val(std::move(val)) { }
 
         T val;
     };
@@ -29,24 +40,24 @@ namespace ErrorTypes {
 
     template<typename E>
     struct Err {
-        Err(const E& val) : val(val) { }
-        Err(E&& val) : val(std::move(val)) { }
+        constexpr Err(const E& val) : val(val) { }
+        constexpr Err(E&& val) : val(std::move(val)) { }
 
         E val;
     };
 }
 
 template<typename T, typename CleanT = typename std::decay<T>::type>
-ErrorTypes::Ok<CleanT> Ok(T&& val) {
+constexpr ErrorTypes::Ok<CleanT> Ok(T&& val) {
     return ErrorTypes::Ok<CleanT>(std::forward<T>(val));
 }
 
-inline ErrorTypes::Ok<void> Ok() {
+constexpr ErrorTypes::Ok<void> Ok() {
     return ErrorTypes::Ok<void>();
 }
 
 template<typename E, typename CleanE = typename std::decay<E>::type>
-ErrorTypes::Err<CleanE> Err(E&& val) {
+constexpr ErrorTypes::Err<CleanE> Err(E&& val) {
     return ErrorTypes::Err<CleanE>(std::forward<E>(val));
 }
 
@@ -54,33 +65,80 @@ template<typename T, typename E> struct Result;
 
 namespace ErrorTypesImplementation {
 
-template<typename ...> struct void_t { typedef void type; };
+// Stands in for the value of a Result<void, E>.
+struct Unit {
+    constexpr bool operator==(const Unit&) const = default;
+};
 
-namespace impl {
-    template<typename Func> struct result_of;
+template<typename T>
+using Value = std::conditional_t<std::is_void_v<T>, Unit, T>;
+
+// Storage for a Result whose value and error are both trivially copyable.
+// GCC builds a std::variant's index byte and alternative separately in
+// memory and reloads them to return them; a union and a flag come back
+// built in registers, like a bare return code.
+template<typename V, typename E>
+struct TrivialStorage {
+    union Alternatives {
+        template<typename... Args>
+        constexpr Alternatives(std::in_place_index_t<0>, Args&&... args) : value(std::forward<Args>(args)...) { }
+        template<typename... Args>
+        constexpr Alternatives(std::in_place_index_t<1>, Args&&... args) : error(std::forward<Args>(args)...) { }
+
+        V value;
+        E error;
+    };
 
-    template<typename Ret, typename Cls, typename... Args>
-    struct result_of<Ret (Cls::*)(Args...)> : public result_of<Ret (Args...)> { };
+    template<std::size_t I, typename... Args>
+    constexpr TrivialStorage(std::in_place_index_t<I> index, Args&&... args)
+        : alternatives(index, std::forward<Args>(args)...), is_error(I == 1)
+    { }
 
-    template<typename Ret, typename... Args>
-    struct result_of<Ret (Args...)> {
-        typedef Ret type;
-    };
-}
+    constexpr std::size_t index() const { return is_error; }
 
-template<typename Func>
-struct result_of : public impl::result_of<decltype(&Func::operator())> { };
+    template<std::size_t I>
+    constexpr auto& get() & {
+        if constexpr (I == 0) return alternatives.value; else return alternatives.error;
+    }
 
-template<typename Ret, typename Cls, typename... Args>
-struct result_of<Ret (Cls::*) (Args...) const> {
-    typedef Ret type;
-};
+    template<std::size_t I>
+    constexpr const auto& get() const& {
+        if constexpr (I == 0) return alternatives.value; else return alternatives.error;
+    }
 
-template<typename Ret, typename... Args>
-struct result_of<Ret (*)(Args...)> {
-    typedef Ret type;
+    template<std::size_t I>
+    constexpr auto&& get() && {
+        if constexpr (I == 0) return std::move(alternatives.value); else return std::move(alternatives.error);
+    }
+
+    friend constexpr bool operator==(const TrivialStorage& lhs, const TrivialStorage& rhs) {
+        if (lhs.is_error != rhs.is_error) return false;
+        return lhs.is_error ? lhs.alternatives.error == rhs.alternatives.error : lhs.alternatives.value == rhs.alternatives.value;
+    }
+
+    Alternatives alternatives;
+    bool is_error;
 };
 
+template<typename T, typename E>
+using Storage = std::conditional_t<std::is_trivially_copyable_v<Value<T>> && std::is_trivially_copyable_v<E>,
+                                   TrivialStorage<Value<T>, E>,
+                                   std::variant<Value<T>, E>>;
+
+template<typename S> struct IsTrivialStorage : public std::false_type { };
+template<typename V, typename E>
+struct IsTrivialStorage<TrivialStorage<V, E>> : public std::true_type { };
+
+// std::get for either kind of storage.
+template<std::size_t I, typename S>
+constexpr decltype(auto) get(S&& storage) {
+    if constexpr (IsTrivialStorage<std::remove_cvref_t<S>>::value) {
+        return std::forward<S>(storage).template get<I>();
+    } else {
+        return std::get<I>(std::forward<S>(storage));
+    }
+}
+
 template<typename R>
 struct ResultOkType { typedef typename std::decay<R>::type type; };
 
@@ -101,810 +159,346 @@ template<typename R> struct IsResult : public std::false_type { };
 template<typename T, typename E>
 struct IsResult<Result<T, E>> : public std::true_type { };
 
-namespace ok {
-
-namespace impl {
-
-template<typename T> struct Map;
-
-template<typename Ret, typename Cls, typename Arg>
-struct Map<Ret (Cls::*)(Arg) const> : public Map<Ret (Arg)> { };
-
-template<typename Ret, typename Cls, typename Arg>
-struct Map<Ret (Cls::*)(Arg)> : public Map<Ret (Arg)> { };
-
-// General implementation
-template<typename Ret, typename Arg>
-struct Map<Ret (Arg)> {
-
-    static_assert(!IsResult<Ret>::value,
-            "Can not map a callback returning a Result, use andThen instead");
-
-    template<typename T, typename E, typename Func>
-    static Result<Ret, E> map(const Result<T, E>& result, Func func) {
-
-        static_assert(
-                std::is_same<T, Arg>::value ||
-                std::is_convertible<T, Arg>::value,
-                "Incompatible types detected");
-
-        if (result.isOk()) {
-            auto res = func(result.storage().template get<T>());
-            return ErrorTypes::Ok<Ret>(std::move(res));
-        }
+[[noreturn]] inline void fail(const char* message) {
+    std::fprintf(stderr, "%s\n", message);
+    std::terminate();
+}
 
-        return ErrorTypes::Err<E>(result.storage().template get<E>());
+// Calls `func` with the Ok value, or with nothing for a Result<void, E>.
+template<typename T, typename Func, typename V>
+constexpr decltype(auto) invoke_ok(Func&& func, V&& value) {
+    if constexpr (std::is_void_v<T>) {
+        return std::invoke(std::forward<Func>(func));
+    } else {
+        return std::invoke(std::forward<Func>(func), std::forward<V>(value));
     }
-};
+}
 
-// Specialization for callback returning void
-template<typename Arg>
-struct Map<void (Arg)> {
+template<typename T, typename Func, typename V>
+using OkCallResultFrom = std::decay_t<decltype(invoke_ok<T>(std::declval<Func&>(), std::declval<V>()))>;
 
-    template<typename T, typename E, typename Func>
-    static Result<void, E> map(const Result<T, E>& result, Func func) {
+template<typename T, typename Func>
+using OkCallResult = OkCallResultFrom<T, Func, const Value<T>&>;
 
-        if (result.isOk()) {
-            func(result.storage().template get<T>());
-            return ErrorTypes::Ok<void>();
-        }
+template<typename E, typename Func>
+using ErrCallResult = std::decay_t<std::invoke_result_t<Func&, const E&>>;
 
-        return ErrorTypes::Err<E>(result.storage().template get<E>());
-    }
-};
+} // namespace ErrorTypesImplementation
 
-// Specialization for a void Result
-template<typename Ret>
-struct Map<Ret (void)> {
-
-    template<typename T, typename E, typename Func>
-    static Result<Ret, E> map(const Result<T, E>& result, Func func) {
-        static_assert(std::is_same<T, void>::value,
-                "Can not map a void callback on a non-void Result");
+template<typename T, typename E>
+struct Result {
 
-        if (result.isOk()) {
-            auto ret = func();
-            return ErrorTypes::Ok<Ret>(std::move(ret));
-        }
+    static_assert(!std::is_same<E, void>::value, "void error type is not allowed");
 
-        return ErrorTypes::Err<E>(result.storage().template get<E>());
-    }
-};
+    typedef ErrorTypesImplementation::Storage<T, E> storage_type;
 
-// Specialization for callback returning void on a void Result
-template<>
-struct Map<void (void)> {
+    template<typename U>
+        requires (!std::is_void_v<T> && std::is_constructible_v<T, U&&>)
+    constexpr Result(ErrorTypes::Ok<U> ok)
+        : storage_(std::in_place_index<0>, std::move(ok.val))
+    { }
 
-    template<typename T, typename E, typename Func>
-    static Result<void, E> map(const Result<T, E>& result, Func func) {
-        static_assert(std::is_same<T, void>::value,
-                "Can not map a void callback on a non-void Result");
+    constexpr Result(ErrorTypes::Ok<void>) requires std::is_void_v<T>
+        : storage_(std::in_place_index<0>)
+    { }
 
-        if (result.isOk()) {
-            func();
-            return ErrorTypes::Ok<void>();
-        }
+    template<typename F>
+        requires std::is_constructible_v<E, F&&>
+    constexpr Result(ErrorTypes::Err<F> err)
+        : storage_(std::in_place_index<1>, std::move(err.val))
+    { }
 
-        return ErrorTypes::Err<E>(result.storage().template get<E>());
+    constexpr bool isOk() const {
+        return storage_.index() == 0;
     }
-};
-
-// General specialization for a callback returning a Result
-template<typename U, typename E, typename Arg>
-struct Map<Result<U, E> (Arg)> {
 
-    template<typename T, typename Func>
-    static Result<U, E> map(const Result<T, E>& result, Func func) {
-        static_assert(
-                std::is_same<T, Arg>::value ||
-                std::is_convertible<T, Arg>::value,
-                "Incompatible types detected");
-
-        if (result.isOk()) {
-            auto res = func(result.storage().template get<T>());
-            return res;
-        }
-
-        return ErrorTypes::Err<E>(result.storage().template get<E>());
+    constexpr bool isErr() const {
+        return !isOk();
     }
-};
-
-// Specialization for a void callback returning a Result
-template<typename U, typename E>
-struct Map<Result<U, E> (void)> {
 
-    template<typename T, typename Func>
-    static Result<U, E> map(const Result<T, E>& result, Func func) {
-        static_assert(std::is_same<T, void>::value, "Can not call a void-callback on a non-void Result");
-
-        if (result.isOk()) {
-            auto res = func();
-            return res;
+    constexpr T expect(const char* str) const& {
+        if (!isOk()) {
+            ErrorTypesImplementation::fail(str);
         }
-
-        return ErrorTypes::Err<E>(result.storage().template get<E>());
-    }
-
-};
-
-} // namespace impl
-
-template<typename Func> struct Map : public impl::Map<decltype(&Func::operator())> { };
-
-template<typename Ret, typename... Args>
-struct Map<Ret (*) (Args...)> : public impl::Map<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Map<Ret (Cls::*) (Args...)> : public impl::Map<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Map<Ret (Cls::*) (Args...) const> : public impl::Map<Ret (Args...)> { };
-
-template<typename Ret, typename... Args>
-struct Map<std::function<Ret (Args...)>> : public impl::Map<Ret (Args...)> { };
-
-} // namespace ok
-
-
-namespace err {
-
-namespace impl {
-
-template<typename T> struct Map;
-
-template<typename Ret, typename Cls, typename Arg>
-struct Map<Ret (Cls::*)(Arg) const> {
-
-    static_assert(!IsResult<Ret>::value,
-            "Can not map a callback returning a Result, use orElse instead");
-
-    template<typename T, typename E, typename Func>
-    static Result<T, Ret> map(const Result<T, E>& result, Func func) {
-        if (result.isErr()) {
-            auto res = func(result.storage().template get<E>());
-            return ErrorTypes::Err<Ret>(res);
+        if constexpr (!std::is_void_v<T>) {
+            return ErrorTypesImplementation::get<0>(storage_);
         }
-
-        return ErrorTypes::Ok<T>(result.storage().template get<T>());
     }
 
-    template<typename E, typename Func>
-    static Result<void, Ret> map(const Result<void, E>& result, Func func) {
-        if (result.isErr()) {
-            auto res = func(result.storage().template get<E>());
-            return ErrorTypes::Err<Ret>(res);
+    constexpr T expect(const char* str) && {
+        if (!isOk()) {
+            ErrorTypesImplementation::fail(str);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return ErrorTypesImplementation::get<0>(std::move(storage_));
         }
-
-        return ErrorTypes::Ok<void>();
     }
 
+    // Every combinator has a const& overload that copies out of the Result
+    // and an && overload that moves out of it, so chains on temporaries such
+    // as `read_file(path).map(...)` never copy the value along the way.
 
-};
-
-} // namespace impl
-
-template<typename Func> struct Map : public impl::Map<decltype(&Func::operator())> { };
-
-} // namespace err;
-
-namespace And {
-
-namespace impl {
-
-    template<typename Func> struct Then;
+    // A callback returning a Result is chained like andThen.
+    template<typename Func>
+    constexpr auto map(Func func) const& { return mapImpl(*this, func); }
+    template<typename Func>
+    constexpr auto map(Func func) && { return mapImpl(std::move(*this), func); }
 
-    template<typename Ret, typename... Args>
-    struct Then<Ret (*)(Args...)> : public Then<Ret (Args...)> { };
+    template<typename Func>
+    constexpr auto andThen(Func func) const& { return andThenImpl(*this, func); }
+    template<typename Func>
+    constexpr auto andThen(Func func) && { return andThenImpl(std::move(*this), func); }
 
-    template<typename Ret, typename Cls, typename... Args>
-    struct Then<Ret (Cls::*)(Args...)> : public Then<Ret (Args...)> { };
+    template<typename Func>
+    constexpr auto mapError(Func func) const& { return mapErrorImpl(*this, func); }
+    template<typename Func>
+    constexpr auto mapError(Func func) && { return mapErrorImpl(std::move(*this), func); }
 
-    template<typename Ret, typename Cls, typename... Args>
-    struct Then<Ret (Cls::*)(Args...) const> : public Then<Ret (Args...)> { };
+    template<typename Func>
+    constexpr auto orElse(Func func) const& { return orElseImpl(*this, func); }
+    template<typename Func>
+    constexpr auto orElse(Func func) && { return orElseImpl(std::move(*this), func); }
 
-    template<typename Ret, typename Arg>
-    struct Then<Ret (Arg)> {
-        static_assert(std::is_same<Ret, void>::value,
+    template<typename Func>
+    constexpr Result<T, E> then(Func func) const& {
+        static_assert(std::is_void_v<ErrorTypesImplementation::OkCallResult<T, Func>>,
                 "then() should not return anything, use map() instead");
 
-        template<typename T, typename E, typename Func>
-        static Result<T, E> then(const Result<T, E>& result, Func func) {
-            if (result.isOk()) {
-                func(result.storage().template get<T>());
-            }
-            return result;
+        if (isOk()) {
+            ErrorTypesImplementation::invoke_ok<T>(func, ErrorTypesImplementation::get<0>(storage_));
         }
-    };
+        return *this;
+    }
 
-    template<typename Ret>
-    struct Then<Ret (void)> {
-        static_assert(std::is_same<Ret, void>::value,
+    template<typename Func>
+    constexpr Result<T, E> then(Func func) && {
+        static_assert(std::is_void_v<ErrorTypesImplementation::OkCallResult<T, Func>>,
                 "then() should not return anything, use map() instead");
 
-        template<typename T, typename E, typename Func>
-        static Result<T, E> then(const Result<T, E>& result, Func func) {
-            static_assert(std::is_same<T, void>::value, "Can not call a void-callback on a non-void Result");
-
-            if (result.isOk()) {
-                func();
-            }
-
-            return result;
-        }
-    };
-
-
-} // namespace impl
-
-template<typename Func>
-struct Then : public impl::Then<decltype(&Func::operator())> { };
-
-template<typename Ret, typename... Args>
-struct Then<Ret (*) (Args...)> : public impl::Then<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Then<Ret (Cls::*)(Args...)> : public impl::Then<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Then<Ret (Cls::*)(Args...) const> : public impl::Then<Ret (Args...)> { };
-
-} // namespace And
-
-namespace Or {
-
-namespace impl {
-
-    template<typename Func> struct Else;
-
-    template<typename Ret, typename... Args>
-    struct Else<Ret (*)(Args...)> : public Else<Ret (Args...)> { };
-
-    template<typename Ret, typename Cls, typename... Args>
-    struct Else<Ret (Cls::*)(Args...)> : public Else<Ret (Args...)> { };
-
-    template<typename Ret, typename Cls, typename... Args>
-    struct Else<Ret (Cls::*)(Args...) const> : public Else<Ret (Args...)> { };
-
-    template<typename T, typename F, typename Arg>
-    struct Else<Result<T, F> (Arg)> {
-
-        template<typename E, typename Func>
-        static Result<T, F> orElse(const Result<T, E>& result, Func func) {
-            static_assert(
-                    std::is_same<E, Arg>::value ||
-                    std::is_convertible<E, Arg>::value,
-                    "Incompatible types detected");
-
-            if (result.isErr()) {
-                auto res = func(result.storage().template get<E>());
-                return res;
-            }
-
-            return ErrorTypes::Ok<T>(result.storage().template get<T>());
-        }
-
-        template<typename E, typename Func>
-        static Result<void, F> orElse(const Result<void, E>& result, Func func) {
-            if (result.isErr()) {
-                auto res = func(result.storage().template get<E>());
-                return res;
-            }
-
-            return ErrorTypes::Ok<void>();
-        }
-
-    };
-
-    template<typename T, typename F>
-    struct Else<Result<T, F> (void)> {
-
-        template<typename E, typename Func>
-        static Result<T, F> orElse(const Result<T, E>& result, Func func) {
-            static_assert(std::is_same<T, void>::value,
-                    "Can not call a void-callback on a non-void Result");
-
-            if (result.isErr()) {
-                auto res = func();
-                return res;
-            }
-
-            return ErrorTypes::Ok<T>(result.storage().template get<T>());
-        }
-
-        template<typename E, typename Func>
-        static Result<void, F> orElse(const Result<void, E>& result, Func func) {
-            if (result.isErr()) {
-                auto res = func();
-                return res;
-            }
-
-            return ErrorTypes::Ok<void>();
+        if (isOk()) {
+            ErrorTypesImplementation::invoke_ok<T>(func, ErrorTypesImplementation::get<0>(storage_));
         }
+        return std::move(*this);
+    }
 
-    };
-
-} // namespace impl
-
-template<typename Func>
-struct Else : public impl::Else<decltype(&Func::operator())> { };
-
-template<typename Ret, typename... Args>
-struct Else<Ret (*) (Args...)> : public impl::Else<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Else<Ret (Cls::*)(Args...)> : public impl::Else<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Else<Ret (Cls::*)(Args...) const> : public impl::Else<Ret (Args...)> { };
-
-} // namespace Or
-
-namespace Other {
-
-namespace impl {
-
-    template<typename Func> struct Wise;
-
-    template<typename Ret, typename... Args>
-    struct Wise<Ret (*)(Args...)> : public Wise<Ret (Args...)> { };
-
-    template<typename Ret, typename Cls, typename... Args>
-    struct Wise<Ret (Cls::*)(Args...)> : public Wise<Ret (Args...)> { };
-
-    template<typename Ret, typename Cls, typename... Args>
-    struct Wise<Ret (Cls::*)(Args...) const> : public Wise<Ret (Args...)> { };
-
-    template<typename Ret, typename Arg>
-    struct Wise<Ret (Arg)> {
-
-        template<typename T, typename E, typename Func>
-        static Result<T, E> otherwise(const Result<T, E>& result, Func func) {
-            static_assert(
-                    std::is_same<E, Arg>::value ||
-                    std::is_convertible<E, Arg>::value,
-                    "Incompatible types detected");
-
-            static_assert(std::is_same<Ret, void>::value,
-                    "callback should not return anything, use mapError() for that");
+    template<typename Func>
+    constexpr Result<T, E> otherwise(Func func) const& {
+        static_assert(std::is_void_v<ErrorTypesImplementation::ErrCallResult<E, Func>>,
+                "callback should not return anything, use mapError() for that");
 
-            if (result.isErr()) {
-                func(result.storage().template get<E>());
-            }
-            return result;
+        if (isErr()) {
+            std::invoke(func, ErrorTypesImplementation::get<1>(storage_));
         }
-
-    };
-
-} // namespace impl
-
-template<typename Func>
-struct Wise : public impl::Wise<decltype(&Func::operator())> { };
-
-template<typename Ret, typename... Args>
-struct Wise<Ret (*) (Args...)> : public impl::Wise<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Wise<Ret (Cls::*)(Args...)> : public impl::Wise<Ret (Args...)> { };
-
-template<typename Ret, typename Cls, typename... Args>
-struct Wise<Ret (Cls::*)(Args...) const> : public impl::Wise<Ret (Args...)> { };
-
-} // namespace Other
-
-template<typename T, typename E, typename Func,
-         typename Ret =
-            Result<
-                typename ErrorTypesImplementation::ResultOkType<
-                    typename ErrorTypesImplementation::result_of<Func>::type
-                >::type,
-            E>
-        >
-Ret map(const Result<T, E>& result, Func func) {
-    return ok::Map<Func>::map(result, func);
-}
-
-template<typename T, typename E, typename Func,
-         typename Ret =
-            Result<T,
-                typename ErrorTypesImplementation::ResultErrType<
-                    typename ErrorTypesImplementation::result_of<Func>::type
-                >::type
-            >
-        >
-Ret mapError(const Result<T, E>& result, Func func) {
-    return err::Map<Func>::map(result, func);
-}
-
-template<typename T, typename E, typename Func>
-Result<T, E> then(const Result<T, E>& result, Func func) {
-    return And::Then<Func>::then(result, func);
-}
-
-template<typename T, typename E, typename Func>
-Result<T, E> otherwise(const Result<T, E>& result, Func func) {
-    return Other::Wise<Func>::otherwise(result, func);
-}
-
-template<typename T, typename E, typename Func,
-    typename Ret =
-        Result<T,
-            typename ErrorTypesImplementation::ResultErrType<
-                typename ErrorTypesImplementation::result_of<Func>::type
-            >::type
-       >
->
-Ret orElse(const Result<T, E>& result, Func func) {
-    return Or::Else<Func>::orElse(result, func);
-}
-
-struct ok_tag { };
-struct err_tag { };
-
-template<typename T, typename E>
-struct Storage {
-    static constexpr size_t Size = sizeof(T) > sizeof(E) ? sizeof(T) : sizeof(E);
-    static constexpr size_t Align = sizeof(T) > sizeof(E) ? alignof(T) : alignof(E);
-
-    typedef typename std::aligned_storage<Size, Align>::type type;
-
-    Storage()
-        : initialized_(false)
-    { }
-
-    void construct(ErrorTypes::Ok<T> ok)
-    {
-        new (&storage_) T(ok.val);
-        initialized_ = true;
-    }
-    void construct(ErrorTypes::Err<E> err)
-    {
-        new (&storage_) E(err.val);
-        initialized_ = true;
+        return *this;
     }
 
-    template<typename U>
-    void rawConstruct(U&& val) {
-        typedef typename std::decay<U>::type CleanU;
+    template<typename Func>
+    constexpr Result<T, E> otherwise(Func func) && {
+        static_assert(std::is_void_v<ErrorTypesImplementation::ErrCallResult<E, Func>>,
+                "callback should not return anything, use mapError() for that");
 
-        new (&storage_) CleanU(std::forward<U>(val));
-        initialized_ = true;
+        if (isErr()) {
+            std::invoke(func, ErrorTypesImplementation::get<1>(storage_));
+        }
+        return std::move(*this);
     }
 
-    template<typename U>
-    const U& get() const {
-        return *reinterpret_cast<const U *>(&storage_);
+    constexpr storage_type& storage() {
+        return storage_;
     }
 
-    template<typename U>
-    U& get() {
-        return *reinterpret_cast<U *>(&storage_);
+    constexpr const storage_type& storage() const {
+        return storage_;
     }
 
-    void destroy(ok_tag) {
-        if (initialized_) {
-            get<T>().~T();
-            initialized_ = false;
+    template<typename U = T>
+    constexpr typename std::enable_if<
+        !std::is_same<U, void>::value,
+        U
+    >::type
+    unwrapOr(const U& defaultValue) const& {
+        if (isOk()) {
+            return ErrorTypesImplementation::get<0>(storage_);
         }
+        return defaultValue;
     }
 
-    void destroy(err_tag) {
-        if (initialized_) {
-            get<E>().~E();
-            initialized_ = false;
+    template<typename U = T>
+    constexpr typename std::enable_if<
+        !std::is_same<U, void>::value,
+        U
+    >::type
+    unwrapOr(U defaultValue) && {
+        if (isOk()) {
+            return ErrorTypesImplementation::get<0>(std::move(storage_));
         }
+        return defaultValue;
     }
 
-    type storage_;
-    bool initialized_;
-};
-
-template<typename E>
-struct Storage<void, E> {
-    typedef typename std::aligned_storage<sizeof(E), alignof(E)>::type type;
-
-    void construct(ErrorTypes::Ok<void>)
-    {
-        initialized_ = true;
-    }
-
-    void construct(ErrorTypes::Err<E> err)
-    {
-        new (&storage_) E(err.val);
-        initialized_ = true;
-    }
-
-    template<typename U>
-    void rawConstruct(U&& val) {
-        typedef typename std::decay<U>::type CleanU;
-
-        new (&storage_) CleanU(std::forward<U>(val));
-        initialized_ = true;
-    }
-
-    void destroy(ok_tag) { initialized_ = false; }
-    void destroy(err_tag) {
-        if (initialized_) {
-            get<E>().~E(); initialized_ = false;
+    template<typename U = T>
+    constexpr typename std::enable_if<
+        !std::is_same<U, void>::value,
+        U
+    >::type
+    unwrap() const& {
+        if (isOk()) {
+            return ErrorTypesImplementation::get<0>(storage_);
         }
-    }
-
-    template<typename U>
-    const U& get() const {
-        return *reinterpret_cast<const U *>(&storage_);
-    }
-
-    template<typename U>
-    U& get() {
-        return *reinterpret_cast<U *>(&storage_);
-    }
-
-    type storage_;
-    bool initialized_;
-};
 
-template<typename T, typename E>
-struct Constructor {
-
-    static void move(Storage<T, E>&& src, Storage<T, E>& dst, ok_tag) {
-        dst.rawConstruct(std::move(src.template get<T>()));
-        src.destroy(ok_tag());
+        ErrorTypesImplementation::fail("Attempting to unwrap an error Result");
     }
 
-    static void copy(const Storage<T, E>& src, Storage<T, E>& dst, ok_tag) {
-        dst.rawConstruct(src.template get<T>());
-    }
-
-    static void move(Storage<T, E>&& src, Storage<T, E>& dst, err_tag) {
-        dst.rawConstruct(std::move(src.template get<E>()));
-        src.destroy(err_tag());
-    }
-
-    static void copy(const Storage<T, E>& src, Storage<T, E>& dst, err_tag) {
-        dst.rawConstruct(src.template get<E>());
-    }
-};
-
-template<typename E>
-struct Constructor<void, E> {
-    static void move(Storage<void, E>&& src, Storage<void, E>& dst, ok_tag) {
-    }
-
-    static void copy(const Storage<void, E>& src, Storage<void, E>& dst, ok_tag) {
-    }
-
-    static void move(Storage<void, E>&& src, Storage<void, E>& dst, err_tag) {
-        dst.rawConstruct(std::move(src.template get<E>()));
-        src.destroy(err_tag());
-    }
-
-    static void copy(const Storage<void, E>& src, Storage<void, E>& dst, err_tag) {
-        dst.rawConstruct(src.template get<E>());
-    }
-};
-
-} // namespace details
-
-namespace result_concept {
-
-template<typename T, typename = void> struct EqualityComparable : std::false_type { };
-
-template<typename T>
-struct EqualityComparable<T,
-typename std::enable_if<
-    true,
-    typename ErrorTypesImplementation::void_t<decltype(std::declval<T>() == std::declval<T>())>::type
+    template<typename U = T>
+    constexpr typename std::enable_if<
+        !std::is_same<U, void>::value,
+        U
     >::type
-> : std::true_type
-{
-};
-
-
-} // namespace result_concept
-
-template<typename T, typename E>
-struct Result {
-
-    static_assert(!std::is_same<E, void>::value, "void error type is not allowed");
-
-    typedef ErrorTypesImplementation::Storage<T, E> storage_type;
-
-    Result(ErrorTypes::Ok<T> ok)
-        : ok_(true)
-    {
-        storage_.construct(std::move(ok));
-    }
-
-    Result(ErrorTypes::Err<E> err)
-        : ok_(false)
-    {
-        storage_.construct(std::move(err));
-    }
-
-    Result(Result&& other) {
-        if (other.isOk()) {
-            ErrorTypesImplementation::Constructor<T, E>::move(std::move(other.storage_), storage_, ErrorTypesImplementation::ok_tag());
-            ok_ = true;
-        } else {
-            ErrorTypesImplementation::Constructor<T, E>::move(std::move(other.storage_), storage_, ErrorTypesImplementation::err_tag());
-            ok_ = false;
-        }
-    }
-
-    Result(const Result& other) {
-        if (other.isOk()) {
-            ErrorTypesImplementation::Constructor<T, E>::copy(other.storage_, storage_, ErrorTypesImplementation::ok_tag());
-            ok_ = true;
-        } else {
-            ErrorTypesImplementation::Constructor<T, E>::copy(other.storage_, storage_, ErrorTypesImplementation::err_tag());
-            ok_ = false;
+    unwrap() && {
+        if (isOk()) {
+            return ErrorTypesImplementation::get<0>(std::move(storage_));
         }
-    }
 
-    ~Result() {
-        if (ok_)
-            storage_.destroy(ErrorTypesImplementation::ok_tag());
-        else
-            storage_.destroy(ErrorTypesImplementation::err_tag());
+        ErrorTypesImplementation::fail("Attempting to unwrap an error Result");
     }
 
-    bool isOk() const {
-        return ok_;
-    }
+    constexpr E unwrapErr() const& {
+        if (isErr()) {
+            return ErrorTypesImplementation::get<1>(storage_);
+        }
 
-    bool isErr() const {
-        return !ok_;
+        ErrorTypesImplementation::fail("Attempting to unwrapErr an ok Result");
     }
 
-    T expect(const char* str) const {
-        if (!isOk()) {
-            std::fprintf(stderr, "%s\n", str);
-            std::terminate(); 
+    constexpr E unwrapErr() && {
+        if (isErr()) {
+            return ErrorTypesImplementation::get<1>(std::move(storage_));
         }
-        return expect_impl(std::is_same<T, void>());
-    }
-
-    template<typename Func,
-             typename Ret =
-                Result<
-                    typename ErrorTypesImplementation::ResultOkType<
-                        typename ErrorTypesImplementation::result_of<Func>::type
-                    >::type,
-                E>
-            >
-    Ret map(Func func) const {
-        return ErrorTypesImplementation::map(*this, func);
-    }
 
-    template<typename Func,
-         typename Ret =
-             Result<T,
-                typename ErrorTypesImplementation::ResultErrType<
-                    typename ErrorTypesImplementation::result_of<Func>::type
-                >::type
-            >
-    >
-    Ret mapError(Func func) const {
-        return ErrorTypesImplementation::mapError(*this, func);
+        ErrorTypesImplementation::fail("Attempting to unwrapErr an ok Result");
     }
 
-    template<typename Func>
-    Result<T, E> then(Func func) const {
-        return ErrorTypesImplementation::then(*this, func);
-    }
+    typedef T value_type;
+    typedef E error_type;
 
-    template<typename Func>
-    Result<T, E> otherwise(Func func) const {
-        return ErrorTypesImplementation::otherwise(*this, func);
+private:
+    // `Self` is `const Result&` or `Result`, so std::forward<Self>(self).storage_
+    // copies or moves the alternatives to match.
+    template<typename Self, typename Func>
+    static constexpr auto mapImpl(Self&& self, Func& func) {
+        using Ret = ErrorTypesImplementation::OkCallResultFrom<T, Func, decltype(ErrorTypesImplementation::get<0>(std::forward<Self>(self).storage_))>;
+
+        if constexpr (ErrorTypesImplementation::IsResult<Ret>::value) {
+            return andThenImpl(std::forward<Self>(self), func);
+        } else if constexpr (std::is_void_v<Ret>) {
+            if (self.isOk()) {
+                ErrorTypesImplementation::invoke_ok<T>(func, ErrorTypesImplementation::get<0>(std::forward<Self>(self).storage_));
+                return Result<void, E>(ErrorTypes::Ok<void>());
+            }
+            return Result<void, E>(ErrorTypes::Err<E>(ErrorTypesImplementation::get<1>(std::forward<Self>(self).storage_)));
+        } else {
+            if (self.isOk()) {
+                return Result<Ret, E>(ErrorTypes::Ok<Ret>(ErrorTypesImplementation::invoke_ok<T>(func, ErrorTypesImplementation::get<0>(std::forward<Self>(self).storage_))));
+            }
+            return Result<Ret, E>(ErrorTypes::Err<E>(ErrorTypesImplementation::get<1>(std::forward<Self>(self).storage_)));
+        }
     }
 
-    template<typename Func,
-        typename Ret =
-            Result<T,
-                typename ErrorTypesImplementation::ResultErrType<
-                    typename ErrorTypesImplementation::result_of<Func>::type
-                >::type
-           >
-    >
-    Ret orElse(Func func) const {
-        return ErrorTypesImplementation::orElse(*this, func);
-    }
+    template<typename Self, typename Func>
+    static constexpr auto andThenImpl(Self&& self, Func& func) {
+        using Ret = ErrorTypesImplementation::OkCallResultFrom<T, Func, decltype(ErrorTypesImplementation::get<0>(std::forward<Self>(self).storage_))>;
+        static_assert(ErrorTypesImplementation::IsResult<Ret>::value,
+                "andThen() callbacks must return a Result, use map() instead");
+        static_assert(std::is_same<typename Ret::error_type, E>::value,
+                "andThen() callbacks must return the same error type");
 
-    storage_type& storage() {
-        return storage_;
+        if (self.isOk()) {
+            return Ret(ErrorTypesImplementation::invoke_ok<T>(func, ErrorTypesImplementation::get<0>(std::forward<Self>(self).storage_)));
+        }
+        return Ret(ErrorTypes::Err<E>(ErrorTypesImplementation::get<1>(std::forward<Self>(self).storage_)));
     }
 
-    const storage_type& storage() const {
-        return storage_;
-    }
+    template<typename Self, typename Func>
+    static constexpr auto mapErrorImpl(Self&& self, Func& func) {
+        using Ret = ErrorTypesImplementation::ErrCallResult<E, Func>;
+        static_assert(!ErrorTypesImplementation::IsResult<Ret>::value,
+                "Can not map a callback returning a Result, use orElse instead");
 
-    template<typename U = T>
-    typename std::enable_if<
-        !std::is_same<U, void>::value,
-        U
-    >::type
-    unwrapOr(const U& defaultValue) const {
-        if (isOk()) {
-            return storage().template get<U>();
+        if (self.isErr()) {
+            return Result<T, Ret>(ErrorTypes::Err<Ret>(std::invoke(func, ErrorTypesImplementation::get<1>(std::forward<Self>(self).storage_))));
         }
-        return defaultValue;
+        return Result<T, Ret>(okWrapper(std::forward<Self>(self)));
     }
 
-    template<typename U = T>
-    typename std::enable_if<
-        !std::is_same<U, void>::value,
-        U
-    >::type
-    unwrap() const {
-        if (isOk()) {
-            return storage().template get<U>();
-        }
+    template<typename Self, typename Func>
+    static constexpr auto orElseImpl(Self&& self, Func& func) {
+        using Ret = ErrorTypesImplementation::ErrCallResult<E, Func>;
+        static_assert(ErrorTypesImplementation::IsResult<Ret>::value,
+                "orElse() callbacks must return a Result, use mapError() instead");
 
-        std::fprintf(stderr, "Attempting to unwrap an error Result\n");
-        std::terminate();
+        if (self.isErr()) {
+            return Ret(std::invoke(func, ErrorTypesImplementation::get<1>(std::forward<Self>(self).storage_)));
+        }
+        return Ret(okWrapper(std::forward<Self>(self)));
     }
 
-    E unwrapErr() const {
-        if (isErr()) {
-            return storage().template get<E>();
+    template<typename Self>
+    static constexpr ErrorTypes::Ok<T> okWrapper(Self&& self) {
+        if constexpr (std::is_void_v<T>) {
+            return ErrorTypes::Ok<void>();
+        } else {
+            return ErrorTypes::Ok<T>(ErrorTypesImplementation::get<0>(std::forward<Self>(self).storage_));
         }
-
-        std::fprintf(stderr, "Attempting to unwrapErr an ok Result\n");
-        std::terminate();
     }
 
-private:
-    T expect_impl(std::true_type) const { }
-    T expect_impl(std::false_type) const { return storage_.template get<T>(); }
-
-    bool ok_;
     storage_type storage_;
 };
 
 template<typename T, typename E>
-bool operator==(const Result<T, E>& lhs, const Result<T, E>& rhs) {
-    static_assert(result_concept::EqualityComparable<T>::value, "T must be EqualityComparable for Result to be comparable");
-    static_assert(result_concept::EqualityComparable<E>::value, "E must be EqualityComparable for Result to be comparable");
-
-    if (lhs.isOk() && rhs.isOk()) {
-        return lhs.storage().template get<T>() == rhs.storage().template get<T>();
-    }
-    if (lhs.isErr() && rhs.isErr()) {
-        return lhs.storage().template get<E>() == rhs.storage().template get<E>();
-    }
+constexpr bool operator==(const Result<T, E>& lhs, const Result<T, E>& rhs) {
+    return lhs.storage() == rhs.storage();
 }
 
-template<typename T, typename E>
-bool operator==(const Result<T, E>& lhs, ErrorTypes::Ok<T> ok) {
-    static_assert(result_concept::EqualityComparable<T>::value, "T must be EqualityComparable for Result to be comparable");
-
+template<typename T, typename E, typename U>
+constexpr bool operator==(const Result<T, E>& lhs, ErrorTypes::Ok<U> ok) {
     if (!lhs.isOk()) return false;
 
-    return lhs.storage().template get<T>() == ok.val;
+    return ErrorTypesImplementation::get<0>(lhs.storage()) == ok.val;
 }
 
 template<typename E>
-bool operator==(const Result<void, E>& lhs, ErrorTypes::Ok<void>) {
+constexpr bool operator==(const Result<void, E>& lhs, ErrorTypes::Ok<void>) {
     return lhs.isOk();
 }
 
-template<typename T, typename E>
-bool operator==(const Result<T, E>& lhs, ErrorTypes::Err<E> err) {
-    static_assert(result_concept::EqualityComparable<E>::value, "E must be EqualityComparable for Result to be comparable");
+template<typename T, typename E, typename F>
+constexpr bool operator==(const Result<T, E>& lhs, ErrorTypes::Err<F> err) {
     if (!lhs.isErr()) return false;
 
-    return lhs.storage().template get<E>() == err.val;
+    return ErrorTypesImplementation::get<1>(lhs.storage()) == err.val;
 }
 
-#define TRY(...)                                                   \
-    ({                                                             \
-        auto res = __VA_ARGS__;                                    \
-        if (!res.isOk()) {                                         \
-            typedef details::ResultErrType<decltype(res)>::type E; \
-            return types::Err<E>(res.storage().get<E>());          \
-        }                                                          \
-        typedef details::ResultOkType<decltype(res)>::type T;      \
-        res.storage().get<T>();                                    \
-    })
-
-
+namespace ErrorTypesImplementation {
+    // Moves the value out of a Result already known to be Ok, for TRY.
+    template<typename T, typename E>
+    constexpr T takeOk(Result<T, E>&& result) {
+        if constexpr (!std::is_void_v<T>) {
+            return ErrorTypesImplementation::get<0>(std::move(result.storage()));
+        }
+    }
+}
 
+// Evaluates a Result and, on error, returns its error from the enclosing
+// function, which must return a Result whose error type can be built from it.
+// Otherwise the whole expression is the Ok value, moved out:
+//
+//   auto file = TRY(read_file(path));
+//
+// Uses a GCC/Clang statement expression.
+#define TRY(...)                                                                  \
+    ({                                                                            \
+        auto try_result_ = (__VA_ARGS__);                                         \
+        if (try_result_.isErr()) {                                                \
+            return Err(std::move(try_result_).unwrapErr());                       \
+        }                                                                         \
+        ErrorTypesImplementation::takeOk(std::move(try_result_));                 \
+    })
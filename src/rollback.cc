@@ -0,0 +1,99 @@
+#include <algorithm>
+
+#include "rollback.h"
+
+constexpr u32 rollback_ring_size = rollback_max_ticks + 1;
+
+void rollback_start(RollbackSession &session, LockstepSession &&transport, const Versus &versus, u32 max_ticks) {
+    log_assert(max_ticks <= rollback_max_ticks, "Rollback goes back at most {} ticks, not {}", rollback_max_ticks, max_ticks);
+    log_assert(versus.tick == transport.tick, "Versus is on tick {} but lockstep on {}", versus.tick, transport.tick);
+
+    session.transport = std::move(transport);
+    session.max_ticks = max_ticks;
+    copy_versus(session.versus, versus);
+    session.verified_until = session.transport.tick;
+    session.stats = {};
+}
+
+void rollback_stop(RollbackSession &session) {
+    lockstep_stop(&session.transport);
+}
+
+// The real input where it has arrived, otherwise a guess from the last one
+// that has: soft drop stays held, presses don't repeat.
+static void inputs_for(const RollbackSession &session, u32 tick, VersusInput *inputs) {
+    auto &transport = session.transport;
+    for (u32 player = 0; player < transport.config.player_count; ++player) {
+        auto received_until = transport.peers[player].received_until;
+        if (tick < received_until) {
+            inputs[player] = lockstep_input(transport, tick, player);
+        } else if (received_until > 0) {
+            inputs[player] = lockstep_input(transport, received_until - 1, player) & versus_soft_drop_bit;
+        } else {
+            inputs[player] = 0;
+        }
+    }
+}
+
+static void simulate(RollbackSession &session, u32 tick) {
+    auto slot = tick % rollback_ring_size;
+    copy_versus(session.saved[slot], session.versus);
+    inputs_for(session, tick, session.used[slot]);
+    versus_step(session.versus, session.used[slot]);
+}
+
+bool rollback_advance(RollbackSession &session) {
+    auto &transport = session.transport;
+    auto player_count = transport.config.player_count;
+    auto tick = transport.tick;
+
+    // Everything before both the current tick and the first missing input is
+    // known for good now. Find the first of those ticks that was guessed wrong.
+    auto verifiable_until = std::min(lockstep_confirmed_until(transport), tick);
+    auto wrong_tick = verifiable_until;
+    for (auto t = session.verified_until; t < verifiable_until && wrong_tick == verifiable_until; ++t) {
+        VersusInput inputs[versus_max_players] = {};
+        inputs_for(session, t, inputs);
+        if (!std::equal(inputs, inputs + player_count, session.used[t % rollback_ring_size])) wrong_tick = t;
+    }
+
+    if (wrong_tick != verifiable_until) {
+        // Events are reported once, as ticks are first simulated. The saved
+        // states carry events from then, and simulating the ticks again
+        // repeats them, so the events not yet collected are kept aside and
+        // put back over whatever the rollback produced.
+        auto &players = session.versus.players;
+        GameEvents pending[versus_max_players] = {};
+        for (usize i = 0; i < players.size(); ++i) pending[i] = players[i].game.events;
+
+        copy_versus(session.versus, session.saved[wrong_tick % rollback_ring_size]);
+        for (auto t = wrong_tick; t < tick; ++t) simulate(session, t);
+
+        for (usize i = 0; i < players.size(); ++i) players[i].game.events = pending[i];
+
+        session.stats.rollbacks += 1;
+        session.stats.resimulated_ticks += tick - wrong_tick;
+        session.stats.deepest = std::max(session.stats.deepest, tick - wrong_tick);
+    }
+
+    session.verified_until = verifiable_until;
+
+    // Our own input is never guessed; a tick without it waits for the caller.
+    auto is_too_far_ahead = tick - session.verified_until >= session.max_ticks && lockstep_waiting_for(transport) != player_count;
+    if (is_too_far_ahead || transport.peers[transport.config.local_player].received_until <= tick) {
+        session.stats.stalled += 1;
+        return false;
+    }
+
+    simulate(session, tick);
+    lockstep_step(&transport);
+    return true;
+}
+
+const Versus &rollback_state_at(const RollbackSession &session, u32 tick) {
+    auto current = session.transport.tick;
+    log_assert(tick <= current && tick + rollback_ring_size > current, "Tick {} is not kept, the match is on {}", tick, current);
+
+    if (tick == current) return session.versus;
+    return session.saved[tick % rollback_ring_size];
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "core.h"
+#include "lockstep.h"
+#include "versus.h"
+
+// Rollback
+//
+// Versus over lockstep.h without waiting on the network. A tick whose remote
+// inputs haven't arrived is simulated anyway, on a guess: whatever the player
+// did last keeps going, which for a held soft drop is usually right and for
+// single presses means nothing new happened. The state before every tick is
+// kept, so when the real inputs arrive and differ from the guess, the match
+// goes back to the first wrong tick and simulates forward again, all before
+// the frame is drawn.
+//
+// Only max_ticks ticks are ever guessed; past that the match stalls like
+// lockstep does, which with max_ticks 0 is exactly what it is. A Game owns no
+// memory, so keeping a tick is copy_versus into a ring of saved states.
+//
+// Each game's events come from the first time a tick is simulated, guess or
+// not; simulating it again after a rollback doesn't report them twice.
+
+constexpr u32 rollback_max_ticks = 8;
+
+struct RollbackStats {
+    u64 rollbacks = 0;         // Times a guess turned out wrong.
+    u64 resimulated_ticks = 0;
+    u32 deepest = 0;           // Most ticks simulated again at once.
+    u64 stalled = 0;           // Calls that couldn't advance.
+};
+
+struct RollbackSession {
+    LockstepSession transport = {};
+    u32 max_ticks = 0;
+
+    Versus versus = {}; // The current tick, simulated on guesses where needed.
+
+    // saved[t % size] is the state before tick t, and used[t % size] the
+    // inputs it was simulated with, for the ticks not yet verified.
+    Versus saved[rollback_max_ticks + 1] = {};
+    VersusInput used[rollback_max_ticks + 1][versus_max_players] = {};
+
+    u32 verified_until = 0; // Ticks before this ran on everyone's real inputs.
+
+    RollbackStats stats = {};
+};
+
+// Takes over `transport`, which carries the inputs as in plain lockstep. The
+// caller keeps feeding it local input and polling it.
+void rollback_start(RollbackSession &session, LockstepSession &&transport, const Versus &versus, u32 max_ticks);
+void rollback_stop(RollbackSession &session);
+
+// Puts right any guesses the inputs that have arrived since disagree with,
+// then simulates the next tick unless that would mean guessing more than
+// max_ticks ahead. Returns whether it did.
+bool rollback_advance(RollbackSession &session);
+
+// The state before `tick`, for ticks up to max_ticks behind the current one.
+const Versus &rollback_state_at(const RollbackSession &session, u32 tick);
@@ -0,0 +1,277 @@
+#include <bit>
+#include <type_traits>
+
+#include "snapshot.h"
+
+constexpr u8 locked_flag_clearing = 1 << 0;
+constexpr u8 locked_flag_dropping = 1 << 1;
+
+constexpr u8 hold_flag_held = 1 << 0;
+constexpr u8 hold_flag_used = 1 << 1;
+
+template <typename T>
+static void write_le(String &out, T value) {
+    static_assert(std::is_integral_v<T>);
+    using U = std::make_unsigned_t<T>;
+
+    auto bits = (U)value;
+    for (usize i = 0; i < sizeof(T); ++i) {
+        out.push_back((char)((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+static void write_f32(String &out, f32 value) {
+    write_le(out, std::bit_cast<u32>(value));
+}
+
+struct SnapshotReader {
+    StringView data = {};
+    usize offset = 0;
+    bool is_truncated = false;
+};
+
+template <typename T>
+static T read_le(SnapshotReader &reader) {
+    static_assert(std::is_integral_v<T>);
+    using U = std::make_unsigned_t<T>;
+
+    if (reader.data.size() - reader.offset < sizeof(T)) {
+        reader.is_truncated = true;
+        reader.offset = reader.data.size();
+        return T{};
+    }
+
+    U bits = 0;
+    for (usize i = 0; i < sizeof(T); ++i) {
+        bits = (U)(bits | (U)((U)(u8)reader.data[reader.offset + i] << (8 * i)));
+    }
+    reader.offset += sizeof(T);
+
+    return (T)bits;
+}
+
+static f32 read_f32(SnapshotReader &reader) {
+    return std::bit_cast<f32>(read_le<u32>(reader));
+}
+
+void serialize_game(const Game &game, String &out) {
+    // Header, game and piece fields take well under 64 bytes, each locked cell 18.
+    out.reserve(out.size() + 64 + game.locked_in.size() * 18);
+
+    write_le(out, snapshot_magic);
+    write_le(out, snapshot_version);
+    write_le(out, (u16)0);
+
+    write_le(out, game.time);
+    write_le(out, game.score);
+    write_le(out, (u8)game.state);
+    write_f32(out, game.frame_time);
+    write_le(out, game.random_state);
+    write_le(out, (u16)game.board.width);
+    write_le(out, (u16)game.board.height);
+
+    auto &tetromino = game.tetromino;
+    write_le(out, (i16)tetromino.coordinate.x);
+    write_le(out, (i16)tetromino.coordinate.y);
+    write_le(out, tetromino.last_tick);
+    write_le(out, tetromino.kind);
+    write_le(out, tetromino.rotation);
+    write_le(out, (u8)tetromino.pieces.size());
+    for (auto &piece : tetromino.pieces) {
+        write_le(out, (i8)piece.x);
+        write_le(out, (i8)piece.y);
+    }
+
+    u8 hold_flags = 0;
+    if (game.has_held) hold_flags |= hold_flag_held;
+    if (game.is_hold_used) hold_flags |= hold_flag_used;
+
+    for (auto kind : game.next_kinds.kinds) write_le(out, kind);
+    write_le(out, game.next_kinds.head);
+    write_le(out, game.held_kind);
+    write_le(out, hold_flags);
+
+    write_le(out, (u32)game.locked_in.size());
+    for (auto &locked : game.locked_in) {
+        u8 flags = 0;
+        if (locked.is_clearing) flags |= locked_flag_clearing;
+        if (locked.is_dropping) flags |= locked_flag_dropping;
+
+        write_le(out, (u16)locked.coordinate.x);
+        write_le(out, (u16)locked.coordinate.y);
+        write_le(out, locked.colour.rgba);
+        write_le(out, flags);
+        write_le(out, locked.drop_rows);
+        write_f32(out, locked.clear_t);
+        write_f32(out, locked.drop_t);
+    }
+}
+
+Result<Game, SnapshotError> deserialize_game(StringView data) {
+    SnapshotError error;
+    SnapshotReader reader;
+    reader.data = data;
+
+    auto magic = read_le<u32>(reader);
+    auto version = read_le<u16>(reader);
+    read_le<u16>(reader); // Reserved
+
+    if (reader.is_truncated) {
+        error.error_kind = SnapshotError::Kind::truncated;
+        return Err(error);
+    }
+    if (magic != snapshot_magic) {
+        error.error_kind = SnapshotError::Kind::bad_magic;
+        return Err(error);
+    }
+    if (version != snapshot_version) {
+        error.error_kind = SnapshotError::Kind::unsupported_version;
+        return Err(error);
+    }
+
+    Game game;
+    game.time = read_le<u32>(reader);
+    game.score = read_le<u32>(reader);
+    auto state = read_le<u8>(reader);
+    game.frame_time = read_f32(reader);
+    game.random_state = read_le<u64>(reader);
+    auto width = (i32)read_le<u16>(reader);
+    auto height = (i32)read_le<u16>(reader);
+
+    auto &tetromino = game.tetromino;
+    tetromino.coordinate.x = read_le<i16>(reader);
+    tetromino.coordinate.y = read_le<i16>(reader);
+    tetromino.last_tick = read_le<u32>(reader);
+    tetromino.kind = read_le<u8>(reader);
+    tetromino.rotation = read_le<u8>(reader);
+    auto piece_count = read_le<u8>(reader);
+
+    if (reader.is_truncated) {
+        error.error_kind = SnapshotError::Kind::truncated;
+        return Err(error);
+    }
+    if (state > (u8)GameState::game_over ||
+        width < game_min_width || width > board_max_width ||
+        height < game_min_height || height > board_max_height ||
+        tetromino.kind >= tetromino_kinds || tetromino.rotation >= tetromino_rotations ||
+        piece_count > tetromino_max_pieces) {
+        error.error_kind = SnapshotError::Kind::invalid_data;
+        return Err(error);
+    }
+
+    game.state = (GameState)state;
+    game.board = make_board(width, height);
+
+    tetromino.pieces.resize(piece_count);
+    for (auto &piece : tetromino.pieces) {
+        piece.x = read_le<i8>(reader);
+        piece.y = read_le<i8>(reader);
+    }
+
+    auto is_queue_valid = true;
+    for (auto &kind : game.next_kinds.kinds) {
+        kind = read_le<u8>(reader);
+        is_queue_valid = is_queue_valid && kind < tetromino_kinds;
+    }
+    game.next_kinds.head = read_le<u8>(reader);
+    game.held_kind = read_le<u8>(reader);
+    auto hold_flags = read_le<u8>(reader);
+    game.has_held = (hold_flags & hold_flag_held) != 0;
+    game.is_hold_used = (hold_flags & hold_flag_used) != 0;
+
+    if (!is_queue_valid || game.next_kinds.head >= piece_queue_capacity || game.held_kind >= tetromino_kinds) {
+        error.error_kind = SnapshotError::Kind::invalid_data;
+        return Err(error);
+    }
+
+    auto locked_count = read_le<u32>(reader);
+    if (reader.is_truncated || locked_count > (data.size() - reader.offset) / 18) {
+        error.error_kind = SnapshotError::Kind::truncated;
+        return Err(error);
+    }
+    if (locked_count > game.locked_in.capacity()) {
+        error.error_kind = SnapshotError::Kind::invalid_data;
+        return Err(error);
+    }
+
+    game.locked_in.resize(locked_count);
+    for (auto &locked : game.locked_in) {
+        locked.coordinate.x = read_le<u16>(reader);
+        locked.coordinate.y = read_le<u16>(reader);
+        locked.colour.rgba = read_le<u32>(reader);
+        auto flags = read_le<u8>(reader);
+        locked.drop_rows = read_le<u8>(reader);
+        locked.clear_t = read_f32(reader);
+        locked.drop_t = read_f32(reader);
+
+        locked.is_clearing = (flags & locked_flag_clearing) != 0;
+        locked.is_dropping = (flags & locked_flag_dropping) != 0;
+
+        // A dropping cell moves down drop_rows more rows, one per animation,
+        // and has to stay on the board all the way.
+        auto is_drop_valid = locked.coordinate.y + locked.drop_rows < game.board.height &&
+                             (!locked.is_dropping || locked.drop_rows > 0);
+        if (!board_is_in_bounds(game.board, locked.coordinate) || !is_drop_valid) {
+            error.error_kind = SnapshotError::Kind::invalid_data;
+            return Err(error);
+        }
+        board_add(game.board, locked.coordinate);
+    }
+
+    if (reader.is_truncated) {
+        error.error_kind = SnapshotError::Kind::truncated;
+        return Err(error);
+    }
+
+    // The falling piece locks into the board eventually, so it has to be the
+    // shape its kind and rotation say and be on the board. A playing game
+    // keeps it clear of the stack too, except a piece that has just spawned
+    // onto it, which locks where it is on the next gravity tick.
+    auto shape = tetromino_pieces(tetromino.kind, tetromino.rotation);
+    auto is_piece_valid = tetromino.pieces.size() == shape.size();
+    for (usize i = 0; is_piece_valid && i < shape.size(); ++i) {
+        is_piece_valid = tetromino.pieces[i] == shape[i] && board_is_in_bounds(game.board, tetromino.coordinate + shape[i]);
+    }
+
+    auto is_spawned = tetromino.coordinate == tetromino_spawn && tetromino.rotation == 0;
+    if (is_piece_valid && game.state == GameState::playing && !is_spawned) {
+        is_piece_valid = board_fits(game.board, tetromino.coordinate, tetromino.pieces);
+    }
+
+    if (!is_piece_valid) {
+        error.error_kind = SnapshotError::Kind::invalid_data;
+        return Err(error);
+    }
+
+    return Ok(std::move(game));
+}
+
+Result<void, SnapshotError> save_game(const Game &game, const Path &path) {
+    File file;
+    file.path = path;
+    serialize_game(game, file.contents);
+
+    auto written = write_file(file);
+    if (written.isErr()) {
+        SnapshotError error;
+        error.error_kind = SnapshotError::Kind::file_not_writable;
+        error.path = path;
+        return Err(error);
+    }
+
+    return Ok();
+}
+
+Result<Game, SnapshotError> load_game(const Path &path) {
+    auto file = TRY(read_file(path).mapError([&](const ReadFileError &) {
+        SnapshotError error;
+        error.error_kind = SnapshotError::Kind::file_not_readable;
+        error.path = path;
+        return error;
+    }));
+
+    return deserialize_game(file.contents).mapError([&](SnapshotError error) {
+        error.path = path;
+        return error;
+    });
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "core.h"
+#include "game.h"
+
+// Snapshots
+//
+// A versioned, little-endian binary image of a Game. The board occupancy grid
+// is a cache of `locked_in`, so it is rebuilt on load rather than stored.
+//
+//   header   u32 magic, u16 version, u16 reserved
+//   game     u32 time, u32 score, u8 state, f32 frame_time, u64 random_state,
+//            u16 width, u16 height
+//   piece    i16 x, i16 y, u32 last_tick, u8 kind, u8 rotation, u8 count,
+//            count * (i8 x, i8 y)
+//   queue    6 * u8 kind, u8 head, u8 held kind, u8 hold flags
+//   locked   u32 count, count * (u16 x, u16 y, u32 rgba colour, u8 flags,
+//            u8 drop_rows, f32 clear_t, f32 drop_t)
+
+constexpr u32 snapshot_magic = 0x5352544D; // "MTRS"
+constexpr u16 snapshot_version = 5;
+
+struct SnapshotError {
+  enum class Kind {
+    none,
+    file_not_readable,
+    file_not_writable,
+    truncated,
+    bad_magic,
+    unsupported_version,
+    invalid_data,
+  };
+
+  SnapshotError::Kind error_kind = SnapshotError::Kind::none;
+  Path                path       = {};
+};
+
+void serialize_game(const Game &game, String &out);
+Result<Game, SnapshotError> deserialize_game(StringView data);
+
+Result<void, SnapshotError> save_game(const Game &game, const Path &path);
+Result<Game, SnapshotError> load_game(const Path &path);
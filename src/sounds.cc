@@ -0,0 +1,60 @@
+#include <cmath>
+
+#include "sounds.h"
+
+constexpr f32 tau = 6.28318531f;
+
+template <typename F>
+static Sound synthesise(f32 seconds, F sample_at) {
+    Sound sound;
+    sound.samples.resize((usize)(seconds * (f32)mixer_sample_rate));
+    for (usize i = 0; i < sound.samples.size(); ++i) {
+        sound.samples[i] = sample_at((f32)i / (f32)mixer_sample_rate);
+    }
+    return sound;
+}
+
+GameSounds add_game_sounds(Mixer *mixer) {
+    GameSounds sounds;
+    auto add = [&](GameSound sound, Sound samples) { sounds.ids[(usize)sound] = mixer_add_sound(mixer, std::move(samples)); };
+
+    // A short thud with a little noise for the click of it landing.
+    u64 noise_state = 1;
+    add(GameSound::lock, synthesise(0.08f, [&](f32 t) {
+        auto noise = (f32)(random_next(&noise_state) >> 40) / (f32)(1 << 24) * 2.0f - 1.0f;
+        return std::exp(-t * 60.0f) * (0.7f * std::sin(tau * 90.0f * t) + 0.3f * noise);
+    }));
+
+    // Sweeps up an octave, 660 to 1320 Hz.
+    add(GameSound::line_clear, synthesise(0.25f, [](f32 t) {
+        return 0.6f * std::exp(-t * 12.0f) * std::sin(tau * (660.0f * t + 1650.0f * t * t));
+    }));
+
+    // A C major chord, slower to die away.
+    add(GameSound::four_lines, synthesise(0.6f, [](f32 t) {
+        auto chord = std::sin(tau * 523.25f * t) + std::sin(tau * 659.25f * t) + std::sin(tau * 783.99f * t) + std::sin(tau * 1046.5f * t);
+        return 0.2f * std::min(t * 200.0f, 1.0f) * std::exp(-t * 4.0f) * chord;
+    }));
+
+    // Sweeps down two octaves, 440 to 110 Hz, with a third harmonic to buzz.
+    add(GameSound::game_over, synthesise(0.9f, [](f32 t) {
+        auto phase = tau * (440.0f * t - 183.33f * t * t);
+        return 0.4f * (1.0f - t / 0.9f) * (std::sin(phase) + std::sin(3.0f * phase) / 3.0f);
+    }));
+
+    return sounds;
+}
+
+void play_game_sounds(Mixer *mixer, const GameSounds &sounds, const GameEvents &events) {
+    auto play = [&](GameSound sound, f32 volume) { mixer_play(mixer, sounds.ids[(usize)sound], volume); };
+
+    if (events.pieces_locked > 0) play(GameSound::lock, 0.6f);
+
+    if (events.lines_cleared >= 4) {
+        play(GameSound::four_lines, 1.0f);
+    } else if (events.lines_cleared > 0) {
+        play(GameSound::line_clear, 0.5f + 0.15f * (f32)events.lines_cleared);
+    }
+
+    if (events.is_game_over) play(GameSound::game_over, 1.0f);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "game.h"
+#include "mixer.h"
+
+// Game sounds
+//
+// There are no sound files among the assets, so the game's sounds are
+// synthesised into samples once at startup, before the mixer starts, and
+// played from memory like decoded files would be.
+
+enum class GameSound : u8 {
+    lock,
+    line_clear,
+    four_lines,
+    game_over,
+    count,
+};
+
+struct GameSounds {
+    u32 ids[(usize)GameSound::count] = {}; // Mixer sound indices.
+};
+
+GameSounds add_game_sounds(Mixer *mixer);
+
+// Plays whatever `events` call for; call it before they are reset.
+void play_game_sounds(Mixer *mixer, const GameSounds &sounds, const GameEvents &events);
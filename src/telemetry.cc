@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+#include "telemetry.h"
+
+constexpr usize telemetry_buffer_size = KiB(64);
+
+static Path rotated_path(const Path& path, u32 index) {
+  auto result = path;
+  result += fmt::format(".{}", index);
+  return result;
+}
+
+static bool open_file(Telemetry* telemetry) {
+  telemetry->file = std::fopen(telemetry->config.path.c_str(), "wb");
+  if (!telemetry->file) return false;
+
+  // Records are already batched in `buffer`; stdio buffering would only copy them again.
+  std::setvbuf(telemetry->file, nullptr, _IONBF, 0);
+
+  TelemetryFileHeader header;
+  header.session_started_at = telemetry->session_started_at;
+  header.file_index = telemetry->file_index;
+
+  auto written = std::fwrite(&header, sizeof(header), 1, telemetry->file);
+  telemetry->file_size = sizeof(header);
+  return written == 1;
+}
+
+// Moves `path` to `path.1` and so on, dropping the oldest past max_files, so
+// opening `path` next doesn't overwrite anything worth keeping.
+static void shift_files(const TelemetryConfig& config) {
+  auto& path = config.path;
+  std::error_code ignored;
+  if (config.max_files > 1) {
+    std::filesystem::remove(rotated_path(path, config.max_files - 1), ignored);
+    for (auto index = config.max_files - 1; index > 1; --index) {
+      std::filesystem::rename(rotated_path(path, index - 1), rotated_path(path, index), ignored);
+    }
+    std::filesystem::rename(path, rotated_path(path, 1), ignored);
+  }
+}
+
+static void rotate(Telemetry* telemetry) {
+  std::fclose(telemetry->file);
+  telemetry->file = nullptr;
+
+  auto& path = telemetry->config.path;
+  shift_files(telemetry->config);
+
+  telemetry->file_index += 1;
+  if (!open_file(telemetry)) {
+    log_error("Could not rotate telemetry file {}, telemetry is off", path.string());
+    if (telemetry->file) std::fclose(telemetry->file);
+    telemetry->file = nullptr;
+  }
+}
+
+static void append(Telemetry* telemetry, const void* record, usize size) {
+  if (telemetry->buffer.size() + size > telemetry_buffer_size) {
+    telemetry_flush(telemetry);
+  }
+
+  auto bytes = (const u8*) record;
+  telemetry->buffer.insert(telemetry->buffer.end(), bytes, bytes + size);
+}
+
+static void write_summary(Telemetry* telemetry, u32 time) {
+  auto& summary = telemetry->summary;
+  if (summary.frame_count > 0) {
+    summary.header.kind = TelemetryRecordKind::frame_summary;
+    summary.header.size = sizeof(TelemetryFrameSummary);
+    summary.header.time = telemetry->summary_started;
+    summary.interval = time - telemetry->summary_started;
+    append(telemetry, &summary, sizeof(summary));
+  }
+
+  summary = {};
+  telemetry->summary_started = time;
+}
+
+Result<void, TelemetryError> telemetry_open(Telemetry* telemetry, const TelemetryConfig& config) {
+  *telemetry = {};
+  telemetry->config = config;
+  telemetry->session_started_at = (u64) std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  telemetry->buffer.reserve(telemetry_buffer_size);
+
+  // The last session's file is rotated out like a full one, not truncated.
+  std::error_code ignored;
+  if (std::filesystem::exists(config.path, ignored)) shift_files(config);
+
+  if (!open_file(telemetry)) {
+    if (telemetry->file) std::fclose(telemetry->file);
+    telemetry->file = nullptr;
+
+    TelemetryError error;
+    error.error_kind = TelemetryError::Kind::file_not_writable;
+    error.path = config.path;
+    return Err(error);
+  }
+
+  return Ok();
+}
+
+void telemetry_close(Telemetry* telemetry) {
+  if (!telemetry->file) return;
+
+  write_summary(telemetry, telemetry->summary_started + telemetry->summary.interval);
+  telemetry_flush(telemetry);
+
+  if (telemetry->file) std::fclose(telemetry->file);
+  telemetry->file = nullptr;
+}
+
+u32 telemetry_histogram_bucket(u32 frame_us) {
+  if (frame_us == 0) return 0;
+
+  auto bucket = (u32) std::bit_width(frame_us) - 1;
+  return bucket < telemetry_histogram_buckets ? bucket : telemetry_histogram_buckets - 1;
+}
+
+void telemetry_frame(Telemetry* telemetry, u32 time, u32 frame_us, u32 update_us, u32 score) {
+  if (!telemetry->file) return;
+
+  auto& summary = telemetry->summary;
+  summary.frame_count += 1;
+  summary.score = score;
+  summary.total_frame_us += frame_us;
+  summary.total_update_us += update_us;
+  summary.max_frame_us = std::max(summary.max_frame_us, frame_us);
+  summary.max_update_us = std::max(summary.max_update_us, update_us);
+  summary.frame_buckets[telemetry_histogram_bucket(frame_us)] += 1;
+
+  // Kept up to date so telemetry_close knows when the last interval ended.
+  summary.interval = time - telemetry->summary_started;
+
+  if (time - telemetry->summary_started >= telemetry->config.summary_interval) {
+    write_summary(telemetry, time);
+  }
+
+  if (time - telemetry->last_flush >= telemetry->config.flush_interval) {
+    telemetry_flush(telemetry);
+    telemetry->last_flush = time;
+  }
+}
+
+void telemetry_event(Telemetry* telemetry, TelemetryRecordKind kind, u32 time, u32 score, u32 value) {
+  if (!telemetry->file) return;
+
+  TelemetryEvent event;
+  event.header.kind = kind;
+  event.header.size = sizeof(TelemetryEvent);
+  event.header.time = time;
+  event.score = score;
+  event.value = value;
+  append(telemetry, &event, sizeof(event));
+}
+
+void telemetry_flush(Telemetry* telemetry) {
+  if (!telemetry->file || telemetry->buffer.empty()) return;
+
+  auto size = telemetry->buffer.size();
+  if (std::fwrite(telemetry->buffer.data(), 1, size, telemetry->file) != size) {
+    log_error("Could not write telemetry to {}, telemetry is off", telemetry->config.path.string());
+    std::fclose(telemetry->file);
+    telemetry->file = nullptr;
+    return;
+  }
+
+  telemetry->buffer.clear();
+  telemetry->file_size += size;
+
+  if (telemetry->file_size >= telemetry->config.max_file_size) {
+    rotate(telemetry);
+  }
+}
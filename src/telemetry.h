@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdio>
+
+#include "core.h"
+
+// Telemetry
+//
+// Gameplay and performance metrics written as fixed-layout binary records, for
+// aggregating across many sessions offline (see tools/telemetry_decode.cc).
+// Frames are not recorded one by one: they are folded into a summary with a
+// frame time histogram that is written once per interval, so the per-frame
+// cost is a handful of additions. Gameplay events are written as they happen.
+//
+//   TelemetryFileHeader
+//   records                      each starts with a TelemetryRecordHeader
+//
+// Records are appended to a buffer that is written out when it fills up or
+// every flush interval. Once a file reaches its size limit, and whenever a
+// session starts, it is rotated: `path` becomes `path.1`, `path.1` becomes
+// `path.2` and so on, and the oldest file past max_files is removed. Fields
+// are stored in host byte order.
+
+constexpr u32 telemetry_magic = 0x4D4C544D; // "MTLM"
+constexpr u16 telemetry_version = 1;
+
+// Bucket i counts frames that took [2^i, 2^(i+1)) microseconds; the last one
+// also takes everything slower.
+constexpr u32 telemetry_histogram_buckets = 24;
+
+struct TelemetryFileHeader {
+  u32 magic = telemetry_magic;
+  u16 version = telemetry_version;
+  u16 reserved = 0;
+  u64 session_started_at = 0; // Unix time in ms, shared by every file of a session.
+  u32 file_index = 0;         // Counts up across rotations.
+  u32 reserved2 = 0;
+};
+
+enum class TelemetryRecordKind : u16 {
+  frame_summary,
+  piece_locked,
+  lines_cleared,
+  game_over,
+};
+
+struct TelemetryRecordHeader {
+  TelemetryRecordKind kind = TelemetryRecordKind::frame_summary;
+  u16 size = 0; // Of the whole record, so readers can skip kinds they don't know.
+  u32 time = 0; // ms since the session started.
+};
+
+struct TelemetryFrameSummary {
+  TelemetryRecordHeader header = {};
+
+  u32 frame_count = 0;
+  u32 interval = 0; // ms covered by this summary.
+  u32 score = 0;    // At the end of the interval.
+
+  // Update time is spent in input, simulation and animation, excluding drawing.
+  u32 max_frame_us = 0;
+  u32 max_update_us = 0;
+  u32 reserved = 0;
+  u64 total_frame_us = 0;
+  u64 total_update_us = 0;
+
+  u32 frame_buckets[telemetry_histogram_buckets] = {};
+};
+
+struct TelemetryEvent {
+  TelemetryRecordHeader header = {};
+
+  u32 score = 0;
+  u32 value = 0; // Lines for lines_cleared, pieces for piece_locked.
+};
+
+static_assert(sizeof(TelemetryFileHeader) == 24);
+static_assert(sizeof(TelemetryRecordHeader) == 8);
+static_assert(sizeof(TelemetryFrameSummary) == 144);
+static_assert(sizeof(TelemetryEvent) == 16);
+
+struct TelemetryConfig {
+  Path path = {};
+
+  u64 max_file_size = MiB(4);
+  u32 max_files = 4;
+
+  u32 summary_interval = 1000; // ms
+  u32 flush_interval = 10000;  // ms
+};
+
+struct Telemetry {
+  TelemetryConfig config = {};
+
+  std::FILE* file = nullptr;
+  u64 file_size = 0;
+  u32 file_index = 0;
+  u64 session_started_at = 0;
+
+  Vec<u8> buffer = {};
+  u32 last_flush = 0;
+
+  TelemetryFrameSummary summary = {};
+  u32 summary_started = 0;
+};
+
+struct TelemetryError {
+  enum class Kind {
+    none,
+    file_not_writable,
+  };
+
+  TelemetryError::Kind error_kind = TelemetryError::Kind::none;
+  Path                 path       = {};
+};
+
+Result<void, TelemetryError> telemetry_open(Telemetry* telemetry, const TelemetryConfig& config);
+
+// Writes out the current summary and everything buffered.
+void telemetry_close(Telemetry* telemetry);
+
+// `time` is ms since telemetry_open. Does nothing if telemetry isn't open.
+void telemetry_frame(Telemetry* telemetry, u32 time, u32 frame_us, u32 update_us, u32 score);
+void telemetry_event(Telemetry* telemetry, TelemetryRecordKind kind, u32 time, u32 score, u32 value = 0);
+
+void telemetry_flush(Telemetry* telemetry);
+
+u32 telemetry_histogram_bucket(u32 frame_us);
@@ -0,0 +1,183 @@
+#include <algorithm>
+
+#include "snapshot.h"
+#include "versus.h"
+
+// Applied in this order when several arrive in one tick, so moves and drops
+// in the same tick as a hold apply to the piece it brings out.
+constexpr InputAction versus_tick_actions[] = {
+    InputAction::hold,
+    InputAction::move_left,
+    InputAction::move_right,
+    InputAction::rotate,
+    InputAction::hard_drop,
+};
+
+static_assert(input_action_count <= 8, "Versus inputs are one bit per action");
+
+Versus make_versus(u32 player_count, i32 width, i32 height, u64 seed) {
+    if (player_count < 1 || player_count > versus_max_players) {
+        log_warning("Versus takes 1 to {} players, not {}", versus_max_players, player_count);
+        player_count = std::clamp(player_count, 1u, versus_max_players);
+    }
+
+    Versus versus;
+    versus.random_state = seed;
+
+    versus.players.resize(player_count);
+    for (auto &player : versus.players) {
+        player.game = make_game(width, height, seed);
+    }
+
+    return versus;
+}
+
+void copy_versus(Versus &to, const Versus &from) {
+    static_assert(sizeof(VersusPlayer) == sizeof(Game) + 2 * sizeof(u32), "copy_versus is missing a VersusPlayer field");
+
+    to.players.count = from.players.count;
+    for (usize i = 0; i < from.players.size(); ++i) {
+        auto &player = to.players[i];
+        copy_game(player.game, from.players[i].game);
+        player.pending_garbage = from.players[i].pending_garbage;
+        player.lines_sent = from.players[i].lines_sent;
+    }
+
+    to.tick = from.tick;
+    to.random_state = from.random_state;
+}
+
+VersusInput versus_encode_input(const InputCommand *commands, usize count, bool &is_soft_dropping) {
+    VersusInput input = 0;
+    for (usize i = 0; i < count; ++i) {
+        auto &command = commands[i];
+        if (command.action == InputAction::soft_drop) {
+            is_soft_dropping = command.is_pressed;
+        } else if (command.is_pressed) {
+            input |= (VersusInput)(1 << (u8)command.action);
+        }
+    }
+
+    if (is_soft_dropping) input |= versus_soft_drop_bit;
+    return input;
+}
+
+u32 versus_garbage_for(u32 lines) {
+    switch (lines) {
+    case 0: return 0;
+    case 1: return 0;
+    case 2: return 1;
+    case 3: return 2;
+    default: return 4;
+    }
+}
+
+static void apply_input(Game &game, VersusInput input, u32 now) {
+    InputCommand command;
+    command.timestamp = now;
+
+    command.action = InputAction::soft_drop;
+    command.is_pressed = (input & versus_soft_drop_bit) != 0;
+    apply_input_command(game, command);
+
+    command.is_pressed = true;
+    for (auto action : versus_tick_actions) {
+        if (input & (1 << (u8)action)) {
+            command.action = action;
+            apply_input_command(game, command);
+        }
+    }
+}
+
+void versus_step_game(Game &game, VersusInput input, u32 now) {
+    apply_input(game, input, now);
+    try_to_move_tetromino(game, now);
+    update_animations(game, (f32)versus_tick_ms / 1000.0f);
+}
+
+// The next player after `from` still in the game, or `from` if nobody is.
+static u32 next_opponent(const Versus &versus, u32 from) {
+    auto player_count = (u32)versus.players.size();
+    for (u32 i = 1; i < player_count; ++i) {
+        auto target = (from + i) % player_count;
+        if (versus.players[target].game.state == GameState::playing) return target;
+    }
+
+    return from;
+}
+
+void versus_step(Versus &versus, const VersusInput *inputs) {
+    versus.tick += 1;
+    auto now = versus.tick * versus_tick_ms;
+
+    for (u32 i = 0; i < (u32)versus.players.size(); ++i) {
+        auto &player = versus.players[i];
+        auto &game = player.game;
+        if (game.state != GameState::playing) continue;
+
+        auto pieces_before = game.events.pieces_locked;
+        auto lines_before = game.events.lines_cleared;
+
+        versus_step_game(game, inputs[i], now);
+
+        // Clearing lines first cancels garbage on its way in, and only what
+        // is left over goes out.
+        auto lines = game.events.lines_cleared - lines_before;
+        auto garbage = versus_garbage_for(lines);
+        auto cancelled = std::min(garbage, player.pending_garbage);
+        player.pending_garbage -= cancelled;
+        garbage -= cancelled;
+
+        auto target = next_opponent(versus, i);
+        if (garbage > 0 && target != i) {
+            versus.players[target].pending_garbage += garbage;
+            player.lines_sent += garbage;
+        }
+
+        if (game.events.pieces_locked != pieces_before && lines == 0 && player.pending_garbage > 0) {
+            auto hole_x = (i32)(random_next(&versus.random_state) % (u64)game.board.width);
+            add_garbage_lines(game, player.pending_garbage, hole_x);
+            player.pending_garbage = 0;
+        }
+    }
+}
+
+i32 versus_winner(const Versus &versus) {
+    i32 winner = -1;
+    u32 playing = 0;
+    for (u32 i = 0; i < (u32)versus.players.size(); ++i) {
+        if (versus.players[i].game.state == GameState::playing) {
+            winner = (i32)i;
+            playing += 1;
+        }
+    }
+
+    if (playing >= 2 || versus.players.size() < 2) return -1;
+    if (playing == 1) return winner;
+
+    // Everyone left topped out on the same tick: the higher score wins.
+    winner = 0;
+    for (u32 i = 1; i < (u32)versus.players.size(); ++i) {
+        if (versus.players[i].game.score > versus.players[(usize)winner].game.score) winner = (i32)i;
+    }
+    return winner;
+}
+
+u64 versus_checksum(const Versus &versus) {
+    // FNV-1a over each game's snapshot, which covers everything simulated.
+    u64 hash = 0xCBF29CE484222325ull;
+    auto mix = [&](u8 byte) {
+        hash ^= byte;
+        hash *= 0x100000001B3ull;
+    };
+
+    String bytes;
+    for (auto &player : versus.players) {
+        bytes.clear();
+        serialize_game(player.game, bytes);
+        for (auto c : bytes) mix((u8)c);
+        for (usize i = 0; i < 4; ++i) mix((u8)(player.pending_garbage >> (i * 8)));
+    }
+
+    return hash;
+}
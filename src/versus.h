@@ -0,0 +1,67 @@
+#pragma once
+
+#include "core.h"
+#include "game.h"
+#include "input.h"
+
+// Versus
+//
+// Two or more games side by side, stepped together in fixed ticks so every
+// copy of a match (one per player, kept in step by lockstep.h) computes the
+// exact same thing from the same inputs. Clearing lines sends garbage to the
+// next player still in the game; it waits in their queue, cancelling against
+// lines they clear, and rises into their board the next time they lock a
+// piece without clearing.
+//
+// A player's input for a tick is one byte: bit (u8)action is set for each
+// action pressed during the tick, and the soft drop bit is set for as long as
+// soft drop is held.
+
+constexpr u32 versus_tick_ms = 16;
+constexpr u32 versus_max_players = 4;
+
+using VersusInput = u8;
+
+constexpr VersusInput versus_soft_drop_bit = 1 << (u8)InputAction::soft_drop;
+
+struct VersusPlayer {
+    Game game = {};
+
+    u32 pending_garbage = 0; // Lines waiting to rise into this board.
+    u32 lines_sent = 0;
+};
+
+struct Versus {
+    FixedVec<VersusPlayer, versus_max_players> players = {};
+
+    u32 tick = 0;
+    u64 random_state = 0; // Garbage holes; the games' own state stays per player.
+};
+
+// Every player gets the same piece sequence. The player count and board size
+// are clamped to what fits, as make_game does.
+Versus make_versus(u32 player_count, i32 width, i32 height, u64 seed);
+
+// Same as `to = from`, copying only the players and cells in use. A two
+// player match early on is a few hundred bytes rather than the whole struct.
+void copy_versus(Versus &to, const Versus &from);
+
+// Folds the commands read for one tick into an input byte. `is_soft_dropping`
+// carries the held state of soft drop from tick to tick.
+VersusInput versus_encode_input(const InputCommand *commands, usize count, bool &is_soft_dropping);
+
+// `inputs` holds one byte per player.
+void versus_step(Versus &versus, const VersusInput *inputs);
+
+// One tick of one game on its own, at `now` ms of game time: the input,
+// then gravity, then animations. versus_step is this plus garbage.
+void versus_step_game(Game &game, VersusInput input, u32 now);
+
+// The last player standing, or -1 while two or more are still playing.
+i32 versus_winner(const Versus &versus);
+
+// Hash of every game, for checking that two copies of a match agree.
+u64 versus_checksum(const Versus &versus);
+
+// Lines of garbage sent for clearing `lines` lines at once.
+u32 versus_garbage_for(u32 lines);
@@ -0,0 +1,149 @@
+// Plays bot games headlessly with the game's sounds going through the mixer,
+// in buffers the size the audio device asks for, and writes the mix to a WAV
+// file. Reports how long mixing a buffer takes against how long it plays
+// for, and any commands dropped, voices stolen or samples clipped.
+//
+//   audio_render [wav path] [seconds] [seed]
+
+#include <chrono>
+#include <cstdlib>
+
+#include "mixer.h"
+#include "sounds.h"
+#include "versus.h"
+
+constexpr usize buffer_frames = 512; // As audio.h asks the device for.
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  return index < argc ? (u32) std::strtoul(argv[index], nullptr, 10) : fallback;
+}
+
+// Random play hardly ever clears a line, so the bot picks a placement for
+// every piece and walks it there, one action a tick, to get every sound.
+struct Bot {
+  bool has_plan = false;
+  u32 rotations = 0; // Presses of rotate still to go.
+  i32 target_x = 0;
+};
+
+// Lines cleared, less holes and stack height, for the piece dropped from `box`.
+static i32 placement_score(const Board& board, Coordinate box, const TetrominoPieces& pieces) {
+  auto placed = board;
+  auto landed = box + make_vector2(0, board_drop_distance(board, box, pieces));
+  for (auto piece : pieces) board_add(placed, landed + piece);
+
+  i32 lines = 0;
+  for (i32 y = 0; y < placed.height; ++y) lines += board_is_row_full(placed, y);
+
+  i32 holes = 0;
+  i32 heights = 0;
+  for (i32 x = 0; x < placed.width; ++x) {
+    auto is_covered = false;
+    for (i32 y = 0; y < placed.height; ++y) {
+      auto is_occupied = board_is_occupied(placed, make_vector2(x, y));
+      if (is_occupied && !is_covered) heights += placed.height - y;
+      holes += is_covered && !is_occupied;
+      is_covered |= is_occupied;
+    }
+  }
+
+  return lines * 40 - holes * 30 - heights;
+}
+
+static void plan(Bot* bot, Game& game) {
+  auto best = INT32_MIN;
+  auto turned = game.tetromino;
+  for (u32 rotations = 0; rotations < tetromino_rotations; ++rotations) {
+    if (rotations > 0 && !rotate_tetromino(turned, game.board, RotationDirection::counter_clockwise)) break;
+
+    // Every column the piece can slide to from where it is.
+    for (auto step : {-1, 1}) {
+      for (auto box = turned.coordinate; board_fits(game.board, box, turned.pieces); box.x += step) {
+        auto score = placement_score(game.board, box, turned.pieces);
+        if (score > best) {
+          best = score;
+          bot->rotations = rotations;
+          bot->target_x = box.x;
+        }
+      }
+    }
+  }
+  bot->has_plan = true;
+}
+
+static u8 bot_input(Bot* bot, Game& game) {
+  if (!bot->has_plan) plan(bot, game);
+
+  if (bot->rotations > 0) {
+    bot->rotations -= 1;
+    return 1 << (u8) InputAction::rotate;
+  }
+  if (game.tetromino.coordinate.x < bot->target_x) return 1 << (u8) InputAction::move_right;
+  if (game.tetromino.coordinate.x > bot->target_x) return 1 << (u8) InputAction::move_left;
+
+  bot->has_plan = false;
+  return 1 << (u8) InputAction::hard_drop;
+}
+
+int main(int argc, char* argv[]) {
+  Path path = argc > 1 ? argv[1] : "metris_audio.wav";
+  auto seconds = argument(argc, argv, 2, 30);
+  u64 random_state = argument(argc, argv, 3, 1);
+
+  auto mixer = std::make_unique<Mixer>();
+  auto sounds = add_game_sounds(mixer.get());
+
+  auto game = make_game(10, 20, random_next(&random_state));
+  Bot bot;
+  u32 tick = 0;
+  u32 game_started = 0; // Tick the current game started on.
+  u32 games = 1;
+  GameEvents totals = {};
+
+  auto frames = (usize) seconds * mixer_sample_rate;
+  Vec<f32> output(frames * mixer_channels);
+  f64 mix_seconds = 0.0;
+  f64 slowest_mix = 0.0;
+
+  for (usize frame = 0; frame < frames; frame += buffer_frames) {
+    // The game runs ahead to the end of this buffer, as the game thread
+    // would while the device plays the one before it.
+    auto buffer_end_ms = (frame + buffer_frames) * 1000 / mixer_sample_rate;
+    while ((usize) tick * versus_tick_ms < buffer_end_ms) {
+      tick += 1;
+      versus_step_game(game, bot_input(&bot, game), (tick - game_started) * versus_tick_ms);
+
+      totals.pieces_locked += game.events.pieces_locked;
+      totals.lines_cleared += game.events.lines_cleared;
+      play_game_sounds(mixer.get(), sounds, game.events);
+
+      if (game.events.is_game_over) {
+        game = make_game(10, 20, random_next(&random_state));
+        bot = {};
+        game_started = tick;
+        games += 1;
+      }
+      game.events = {};
+    }
+
+    auto count = std::min(buffer_frames, frames - frame);
+    auto started = std::chrono::steady_clock::now();
+    mixer_render(mixer.get(), output.data() + frame * mixer_channels, count);
+    auto took = std::chrono::duration<f64>(std::chrono::steady_clock::now() - started).count();
+
+    mix_seconds += took;
+    slowest_mix = std::max(slowest_mix, took);
+  }
+
+  if (write_wav(path, output.data(), frames).isErr()) log_fatal("Could not write {}", path.string());
+
+  auto buffers = (frames + buffer_frames - 1) / buffer_frames;
+  auto buffer_seconds = (f64) buffer_frames / mixer_sample_rate;
+  log("Wrote {} ({} s): {} games, {} pieces locked, {} lines cleared", path.string(), seconds, games, totals.pieces_locked, totals.lines_cleared);
+  log("Mixing took {:.2f} us per {} frame buffer on average, {:.2f} us at worst, {:.4f}% of real time",
+      mix_seconds * 1e6 / (f64) buffers, buffer_frames, slowest_mix * 1e6, mix_seconds / (f64) buffers / buffer_seconds * 100.0);
+  log("{} commands dropped, {} voices stolen, {} samples clipped", mixer->dropped_commands,
+      mixer->stolen_voices.load(), mixer->clipped_samples.load());
+
+  return 0;
+}
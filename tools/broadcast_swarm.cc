@@ -0,0 +1,274 @@
+// A crowd of synthetic spectators for metris_server. Opens many connections
+// to it on this machine, some over WebSocket, and decodes every frame each one
+// receives, checking that it starts from a keyframe and that every delta
+// follows the tick before it. Slow clients have a tiny receive buffer and
+// only read now and then; paused for long enough they fill the kernel's
+// buffers and the server's queue, and should be caught up with a keyframe.
+//
+//   broadcast_swarm [clients] [seconds] [port] [slow %] [websocket %] [slow pause ms]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+
+#include "broadcast.h"
+#include "broadcast_server.h"
+#include "histogram.h"
+
+constexpr int slow_receive_buffer = 2048;
+
+// The example key from RFC 6455 and the accept value it must produce.
+constexpr StringView websocket_key = "dGhlIHNhbXBsZSBub25jZQ==";
+constexpr StringView websocket_accept = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+struct Spectator {
+  int fd = -1;
+  BroadcastProtocol protocol = BroadcastProtocol::tcp;
+  bool is_slow = false;
+  bool is_handshaking = false;
+  bool is_open = true;
+
+  String buffer = {};
+  BroadcastState state = {};
+  bool has_keyframe = false;
+  u32 last_tick = 0;
+
+  u64 frames = 0;
+  u64 bytes = 0;
+  u64 keyframes = 0;
+  u64 errors = 0;
+};
+
+static u64 now_us() {
+  return (u64) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  return index < argc ? (u32) std::strtoul(argv[index], nullptr, 10) : fallback;
+}
+
+static int connect_to(u16 port, bool is_slow) {
+  auto fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  if (is_slow) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &slow_receive_buffer, sizeof(slow_receive_buffer));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (connect(fd, (const sockaddr*) &address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// Splits a whole frame off the front of `bytes`. Returns false if there
+// isn't one yet, or the stream stops making sense.
+static bool take_frame(Spectator* spectator, StringView bytes, StringView* frame, usize* consumed) {
+  auto data = (const u8*) bytes.data();
+  auto size = bytes.size();
+
+  usize header = 0;
+  u64 length = 0;
+  if (spectator->protocol == BroadcastProtocol::tcp) {
+    if (size < 4) return false;
+    header = 4;
+    for (usize i = 0; i < 4; ++i) length |= (u64) data[i] << (i * 8);
+  } else {
+    if (size < 2) return false;
+    if (data[0] != 0x82 || (data[1] & 0x80)) {
+      spectator->errors += 1;
+      spectator->is_open = false;
+      return false;
+    }
+
+    length = data[1];
+    header = 2;
+    usize extended = length == 126 ? 2 : length == 127 ? 8 : 0;
+    if (extended > 0) {
+      if (size < 2 + extended) return false;
+      length = 0;
+      for (usize i = 0; i < extended; ++i) length = length << 8 | data[2 + i];
+      header += extended;
+    }
+  }
+
+  if (size < header + length) return false;
+  *frame = bytes.substr(header, (usize) length);
+  *consumed = header + (usize) length;
+  return true;
+}
+
+static void handle_frames(Spectator* spectator, Histogram* latency) {
+  usize offset = 0;
+  while (true) {
+    if (spectator->is_handshaking) {
+      auto end = spectator->buffer.find("\r\n\r\n");
+      if (end == String::npos) break;
+
+      if (spectator->buffer.find(websocket_accept) == String::npos) {
+        spectator->errors += 1;
+        spectator->is_open = false;
+        return;
+      }
+      spectator->buffer.erase(0, end + 4);
+      spectator->is_handshaking = false;
+      continue;
+    }
+
+    StringView frame;
+    usize consumed = 0;
+    if (!take_frame(spectator, StringView(spectator->buffer).substr(offset), &frame, &consumed)) break;
+
+    // A delta is only any use on top of the frame before it.
+    BroadcastFrameHeader header;
+    auto is_keyframe = frame.size() > 1 && ((u8) frame[1] & broadcast_keyframe);
+    auto is_valid = (is_keyframe || spectator->has_keyframe) && broadcast_decode(frame, spectator->state, header);
+
+    if (!is_valid || (!is_keyframe && header.tick != spectator->last_tick + 1)) {
+      spectator->errors += 1;
+      spectator->has_keyframe = false;
+    } else {
+      spectator->has_keyframe = true;
+      spectator->last_tick = header.tick;
+      spectator->frames += 1;
+      if (is_keyframe) spectator->keyframes += 1;
+      if (!spectator->is_slow) histogram_record(latency, (u32) (now_us() - header.sent_at));
+    }
+
+    offset += consumed;
+  }
+
+  spectator->buffer.erase(0, offset);
+}
+
+// Reads up to `limit` bytes. Returns false when the server has gone.
+static bool read_spectator(Spectator* spectator, usize limit, Histogram* latency) {
+  char chunk[16 * 1024];
+  usize total = 0;
+  while (total < limit) {
+    auto got = recv(spectator->fd, chunk, std::min(sizeof(chunk), limit - total), MSG_DONTWAIT);
+    if (got == 0) return false;
+    if (got < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+      return false;
+    }
+
+    spectator->buffer.append(chunk, (usize) got);
+    spectator->bytes += (u64) got;
+    total += (usize) got;
+  }
+
+  handle_frames(spectator, latency);
+  return spectator->is_open;
+}
+
+int main(int argc, char* argv[]) {
+  auto client_count = argument(argc, argv, 1, 1000);
+  auto seconds = argument(argc, argv, 2, 20);
+  auto port = (u16) argument(argc, argv, 3, 27600);
+  auto slow_percent = argument(argc, argv, 4, 5);
+  auto websocket_percent = argument(argc, argv, 5, 20);
+  auto slow_pause = argument(argc, argv, 6, 3000);
+
+  if (client_count == 0 || slow_percent > 100 || websocket_percent > 100) {
+    log_fatal("Usage: {} [clients] [seconds] [port] [slow %] [websocket %] [slow pause ms]", argv[0]);
+  }
+
+  auto epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  auto latency = std::make_unique<Histogram>();
+
+  Vec<Spectator> spectators(client_count);
+  for (u32 i = 0; i < client_count; ++i) {
+    auto& spectator = spectators[i];
+    spectator.is_slow = (i % 100) < slow_percent;
+    spectator.protocol = (i * 7 % 100) < websocket_percent ? BroadcastProtocol::websocket : BroadcastProtocol::tcp;
+
+    auto target = (u16) (port + (spectator.protocol == BroadcastProtocol::websocket ? 1 : 0));
+    spectator.fd = connect_to(target, spectator.is_slow);
+    if (spectator.fd < 0) log_fatal("Could not connect client {} to port {}", i, target);
+
+    if (spectator.protocol == BroadcastProtocol::websocket) {
+      auto request = fmt::format("GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                                 "Sec-WebSocket-Key: {}\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                                 websocket_key);
+      send(spectator.fd, request.data(), request.size(), MSG_NOSIGNAL);
+      spectator.is_handshaking = true;
+    }
+
+    if (!spectator.is_slow) {
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u32 = i;
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, spectator.fd, &event);
+    }
+  }
+
+  log("{} spectators connected to port {}", client_count, port);
+
+  auto started = now_us();
+  auto next_slow_read = started + (u64) slow_pause * 1000;
+  u32 closed = 0;
+  while (now_us() - started < (u64) seconds * 1000000) {
+    epoll_event events[256];
+    auto count = epoll_wait(epoll_fd, events, 256, 10);
+    for (int i = 0; i < count; ++i) {
+      auto& spectator = spectators[events[i].data.u32];
+      if (spectator.is_open && !read_spectator(&spectator, SIZE_MAX, latency.get())) {
+        spectator.is_open = false;
+        closed += 1;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, spectator.fd, nullptr);
+      }
+    }
+
+    // Slow clients wake up now and then and drain everything at once.
+    if (now_us() >= next_slow_read) {
+      next_slow_read = now_us() + (u64) slow_pause * 1000;
+      for (auto& spectator : spectators) {
+        if (!spectator.is_slow || !spectator.is_open) continue;
+        if (!read_spectator(&spectator, SIZE_MAX, latency.get())) {
+          spectator.is_open = false;
+          closed += 1;
+        }
+      }
+    }
+  }
+
+  auto elapsed = (f64) (now_us() - started) / 1000000.0;
+  u64 totals[2][4] = {}; // [is_slow][frames, bytes, keyframes, errors]
+  u32 counts[2] = {};
+  for (auto& spectator : spectators) {
+    auto& total = totals[spectator.is_slow];
+    total[0] += spectator.frames;
+    total[1] += spectator.bytes;
+    total[2] += spectator.keyframes;
+    total[3] += spectator.errors;
+    counts[spectator.is_slow] += 1;
+    close(spectator.fd);
+  }
+  close(epoll_fd);
+
+  for (usize is_slow = 0; is_slow < 2; ++is_slow) {
+    if (counts[is_slow] == 0) continue;
+    auto& total = totals[is_slow];
+    log("{} clients ({}): {:.1f} frames/s and {:.0f} bytes/s each, {:.1f} keyframes each, {} errors",
+        is_slow ? "slow" : "steady", counts[is_slow], (f64) total[0] / counts[is_slow] / elapsed, (f64) total[1] / counts[is_slow] / elapsed,
+        (f64) total[2] / counts[is_slow], total[3]);
+  }
+
+  log("latency, steady clients: p50 {} us, p99 {} us, max {} us over {} frames", histogram_percentile(*latency, 50.0),
+      histogram_percentile(*latency, 99.0), latency->max.load(), histogram_count(*latency));
+  log("{} connections closed by the server", closed);
+
+  auto errors = totals[0][3] + totals[1][3];
+  return errors == 0 ? 0 : 1;
+}
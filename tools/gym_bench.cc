@@ -0,0 +1,78 @@
+// Steps a batch of gym environments with random actions and reports how many
+// game ticks per second that comes to with each thread count, up to the
+// given one. Also checks that the thread count doesn't change the results.
+//
+//   gym_bench [games] [steps] [max threads]
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "core.h"
+#include "gym.h"
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  return index < argc ? (u32) std::strtoul(argv[index], nullptr, 10) : fallback;
+}
+
+struct BenchResult {
+  f64 seconds = 0.0;
+  f64 total_reward = 0.0;
+  u64 episodes = 0;
+  u64 observation_hash = 0;
+};
+
+static BenchResult run(u32 game_count, u32 steps, u32 threads) {
+  auto gym = metris_gym_create(game_count, 10, 20, threads);
+  if (!gym) log_fatal("Could not create {} games", game_count);
+
+  auto observation_size = metris_gym_observation_size(gym);
+  Vec<f32> observations((usize) game_count * observation_size);
+  Vec<f32> rewards(game_count);
+  Vec<u8> dones(game_count);
+  Vec<u8> actions(game_count);
+
+  metris_gym_reset(gym, 1, observations.data());
+
+  BenchResult result;
+  u64 random_state = 42;
+  auto started = std::chrono::steady_clock::now();
+  for (u32 step = 0; step < steps; ++step) {
+    for (auto& action : actions) action = (u8) (random_next(&random_state) % METRIS_GYM_ACTION_COUNT);
+    metris_gym_step(gym, actions.data(), observations.data(), rewards.data(), dones.data());
+
+    for (u32 i = 0; i < game_count; ++i) {
+      result.total_reward += rewards[i];
+      result.episodes += dones[i];
+    }
+  }
+  result.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - started).count();
+
+  for (auto value : observations) result.observation_hash = result.observation_hash * 31 + (u64) value;
+
+  metris_gym_destroy(gym);
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  auto game_count = argument(argc, argv, 1, 1024);
+  auto steps = argument(argc, argv, 2, 2000);
+  auto max_threads = argument(argc, argv, 3, std::max(std::thread::hardware_concurrency(), 1u));
+
+  BenchResult first;
+  for (u32 threads = 1; threads <= max_threads; threads *= 2) {
+    auto result = run(game_count, steps, threads);
+    if (threads == 1) first = result;
+
+    auto ticks = (f64) game_count * steps;
+    log("{} games x {} steps on {} threads: {:.1f} M ticks/s, {:.2f} us per batch step, {} games finished, reward {:.0f}",
+        game_count, steps, threads, ticks / result.seconds / 1e6, result.seconds * 1e6 / steps, result.episodes, result.total_reward);
+
+    if (result.observation_hash != first.observation_hash || result.total_reward != first.total_reward) {
+      log_error("{} threads gave different results from 1", threads);
+      return 1;
+    }
+  }
+
+  return 0;
+}
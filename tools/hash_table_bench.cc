@@ -0,0 +1,129 @@
+// Compares HashTable with std::unordered_map and Table (std::map) on u64 and
+// string keys: inserting, looking up keys that are there and keys that
+// aren't, and erasing half and inserting them again. Prints ns per operation,
+// and fails if the three disagree on what they found.
+//
+//   hash_table_bench [keys] [rounds]
+
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+
+#include "hash_table.h"
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [keys, at least 1] [rounds, at least 1]", argv[0]);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || value == 0 || value > UINT32_MAX) usage(argv);
+  return (u32) value;
+}
+
+struct BenchResult {
+  f64 insert = 0.0; // ns per operation
+  f64 hit = 0.0;
+  f64 miss = 0.0;
+  f64 churn = 0.0;
+  u64 checksum = 0;
+};
+
+// Only operator[], find through `lookup`, and erase, which all three share
+// closely enough.
+template <typename Map, typename K, typename Lookup>
+static BenchResult run(const Vec<K>& keys, const Vec<K>& missing, u32 rounds, Lookup lookup) {
+  using Clock = std::chrono::steady_clock;
+  auto ns_per = [](Clock::time_point started, u64 operations) {
+    return std::chrono::duration<f64, std::nano>(Clock::now() - started).count() / (f64) operations;
+  };
+
+  BenchResult result;
+  auto operations = (u64) keys.size() * rounds;
+
+  Map map;
+  auto started = Clock::now();
+  for (u32 round = 0; round < rounds; ++round) {
+    map = Map();
+    for (usize i = 0; i < keys.size(); ++i) map[keys[i]] = (u64) i;
+  }
+  result.insert = ns_per(started, operations);
+
+  started = Clock::now();
+  for (u32 round = 0; round < rounds; ++round) {
+    for (auto& key : keys) result.checksum += lookup(map, key);
+  }
+  result.hit = ns_per(started, operations);
+
+  started = Clock::now();
+  for (u32 round = 0; round < rounds; ++round) {
+    for (auto& key : missing) result.checksum += lookup(map, key);
+  }
+  result.miss = ns_per(started, operations);
+
+  started = Clock::now();
+  for (u32 round = 0; round < rounds; ++round) {
+    for (usize i = 0; i < keys.size(); i += 2) map.erase(keys[i]);
+    for (usize i = 0; i < keys.size(); i += 2) map[keys[i]] = (u64) i + round;
+  }
+  result.churn = ns_per(started, operations);
+  result.checksum += map.size();
+
+  return result;
+}
+
+template <typename K>
+static void compare(const char* name, const Vec<K>& keys, const Vec<K>& missing, u32 rounds) {
+  auto hash_table = run<HashTable<K, u64>>(keys, missing, rounds, [](auto& map, const K& key) -> u64 {
+    auto value = map.find(key);
+    return value ? *value + 1 : 0;
+  });
+  auto unordered = run<std::unordered_map<K, u64>>(keys, missing, rounds, [](auto& map, const K& key) -> u64 {
+    auto it = map.find(key);
+    return it != map.end() ? it->second + 1 : 0;
+  });
+  auto ordered = run<Table<K, u64>>(keys, missing, rounds, [](auto& map, const K& key) -> u64 {
+    auto it = map.find(key);
+    return it != map.end() ? it->second + 1 : 0;
+  });
+
+  log("{}, {} keys:", name, keys.size());
+  auto line = [](const char* map, const BenchResult& result) {
+    log("  {:<14} insert {:7.1f}  hit {:7.1f}  miss {:7.1f}  erase + insert {:7.1f} ns/op", map, result.insert, result.hit,
+        result.miss, result.churn);
+  };
+  line("HashTable", hash_table);
+  line("unordered_map", unordered);
+  line("Table", ordered);
+
+  if (hash_table.checksum != unordered.checksum || hash_table.checksum != ordered.checksum) {
+    log_fatal("{}: the maps disagree, checksums {}, {} and {}", name, hash_table.checksum, unordered.checksum, ordered.checksum);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  auto count = argument(argc, argv, 1, 100000);
+  auto rounds = argument(argc, argv, 2, 10);
+
+  // Keys and misses drawn from the same generator, so they're equally spread.
+  u64 random_state = 1;
+  Vec<u64> numbers(count);
+  Vec<u64> missing_numbers(count);
+  for (auto& key : numbers) key = random_next(&random_state) << 1;
+  for (auto& key : missing_numbers) key = random_next(&random_state) << 1 | 1;
+  compare("u64", numbers, missing_numbers, rounds);
+
+  // Shaped like the asset table's "name@point_size" keys.
+  Vec<String> names(count);
+  Vec<String> missing_names(count);
+  for (usize i = 0; i < count; ++i) {
+    names[i] = fmt::format("fonts/font_{}.ttf@{}", numbers[i] % 100000, i);
+    missing_names[i] = fmt::format("fonts/font_{}.ttf@{}", missing_numbers[i] % 100000, i + count);
+  }
+  compare("strings", names, missing_names, rounds);
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+// Runs bot versus matches and broadcasts them to spectators, one frame per
+// tick, over plain TCP on `port` and WebSocket on `port + 1` (see
+// broadcast.h and broadcast_server.h). A new match starts shortly after each
+// one ends. Prints what the broadcast is costing every few seconds.
+//
+//   metris_server [port] [players] [seconds, 0 for ever] [max queued KB per client] [send buffer KB, 0 for default]
+
+#include <chrono>
+#include <cstdlib>
+
+#include "broadcast.h"
+#include "broadcast_server.h"
+
+constexpr u16 default_port = 27600;
+constexpr u32 report_interval = 5000;  // ms
+constexpr u32 next_match_delay = 2000; // ms
+
+static u64 now_us() {
+  return (u64) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Mostly idle, sometimes moving or rotating, now and then dropping.
+static u8 bot_input(u64* random_state) {
+  auto random = random_next(random_state);
+  switch (random % 24) {
+  case 0: return 1 << (u8) InputAction::move_left;
+  case 1: return 1 << (u8) InputAction::move_right;
+  case 2: return 1 << (u8) InputAction::rotate;
+  case 3: return 1 << (u8) InputAction::hard_drop;
+  case 4: return 1 << (u8) InputAction::soft_drop;
+  default: return 0;
+  }
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  return index < argc ? (u32) std::strtoul(argv[index], nullptr, 10) : fallback;
+}
+
+int main(int argc, char* argv[]) {
+  auto port = (u16) argument(argc, argv, 1, default_port);
+  auto player_count = argument(argc, argv, 2, 2);
+  auto seconds = argument(argc, argv, 3, 0);
+
+  BroadcastServerConfig config;
+  config.max_queued_bytes = (usize) argument(argc, argv, 4, (u32) (config.max_queued_bytes / 1024)) * 1024;
+  config.send_buffer_bytes = (int) argument(argc, argv, 5, 0) * 1024;
+
+  if (player_count < 1 || player_count > versus_max_players || config.max_queued_bytes == 0) {
+    log_fatal("Usage: {} [port] [players 1-{}] [seconds, 0 for ever] [max queued KB per client] [send buffer KB, 0 for default]", argv[0],
+              versus_max_players);
+  }
+
+  auto opened = broadcast_server_open(port, config);
+  if (opened.isErr()) {
+    log_fatal("Could not listen on port {}", opened.unwrapErr().port);
+  }
+  auto server = std::move(opened).unwrap();
+  log("Broadcasting {} player matches on port {} (TCP) and {} (WebSocket)", player_count, port, port + 1);
+
+  u64 seed = 1;
+  u64 random_state = 1000;
+  auto versus = make_versus(player_count, 10, 20, seed);
+  u64 match_over_at = 0;
+
+  // Frames are numbered on their own, as matches start again from tick 0.
+  u32 frame_tick = 0;
+  BroadcastState previous = {};
+  auto has_previous = false;
+  String delta;
+  String keyframe;
+
+  auto started = now_us();
+  auto next_tick_at = started;
+  auto next_report_at = started + report_interval * 1000;
+
+  // Per report.
+  u64 ticks = 0;
+  u64 delta_bytes = 0;
+  u64 keyframes = 0;
+  u64 encode_us = 0;
+  u64 send_us = 0;
+  auto last_stats = server.stats;
+
+  while (seconds == 0 || now_us() - started < (u64) seconds * 1000000) {
+    auto now = now_us();
+    auto wait_ms = next_tick_at > now ? (i32) ((next_tick_at - now + 999) / 1000) : 0;
+    broadcast_server_poll(&server, wait_ms, now_us() / 1000);
+
+    now = now_us();
+    if (now < next_tick_at) continue;
+    next_tick_at += versus_tick_ms * 1000;
+
+    if (match_over_at != 0 && now - match_over_at >= next_match_delay * 1000) {
+      seed += 1;
+      versus = make_versus(player_count, 10, 20, seed);
+      match_over_at = 0;
+    }
+
+    VersusInput inputs[versus_max_players] = {};
+    for (u32 i = 0; i < player_count; ++i) inputs[i] = bot_input(&random_state);
+    versus_step(versus, inputs);
+
+    auto is_over = player_count > 1 ? versus_winner(versus) >= 0 : versus.players[0].game.state != GameState::playing;
+    if (is_over && match_over_at == 0) match_over_at = now;
+
+    // Encoded once per tick, whoever is watching.
+    auto encode_started = now_us();
+    auto current = broadcast_capture(versus);
+    delta.clear();
+    keyframe.clear();
+    frame_tick += 1;
+    broadcast_encode(has_previous ? &previous : nullptr, current, frame_tick, encode_started, delta);
+    if (broadcast_server_wants_keyframe(server)) {
+      broadcast_encode(nullptr, current, frame_tick, encode_started, keyframe);
+      keyframes += 1;
+    }
+    previous = current;
+    has_previous = true;
+
+    auto send_started = now_us();
+    broadcast_server_send(&server, delta, keyframe, send_started / 1000);
+    auto send_ended = now_us();
+
+    ticks += 1;
+    delta_bytes += delta.size();
+    encode_us += send_started - encode_started;
+    send_us += send_ended - send_started;
+
+    if (send_ended >= next_report_at) {
+      auto& stats = server.stats;
+      auto elapsed = (f64) (send_ended - next_report_at + report_interval * 1000) / 1000000.0;
+      log("{} clients: {:.1f} delta bytes per tick, {} keyframes, {:.2f} MB/s out in {:.0f} sends/s, "
+          "encode {:.1f} us and fan-out {:.1f} us per tick, {} frames dropped, {} resyncs, {} slow clients cut off",
+          broadcast_server_client_count(server), (f64) delta_bytes / (f64) ticks, keyframes,
+          (f64) (stats.bytes_sent - last_stats.bytes_sent) / elapsed / 1e6, (f64) (stats.send_calls - last_stats.send_calls) / elapsed,
+          (f64) encode_us / (f64) ticks, (f64) send_us / (f64) ticks, stats.frames_dropped - last_stats.frames_dropped,
+          stats.resyncs - last_stats.resyncs, stats.slow_disconnects - last_stats.slow_disconnects);
+
+      ticks = delta_bytes = keyframes = encode_us = send_us = 0;
+      last_stats = stats;
+      next_report_at = send_ended + report_interval * 1000;
+    }
+  }
+
+  log("Accepted {} clients, {} disconnected ({} too slow)", server.stats.accepted, server.stats.disconnected, server.stats.slow_disconnects);
+  broadcast_server_close(&server);
+  return 0;
+}
@@ -0,0 +1,52 @@
+// Packs every file under an asset directory into one archive that the game
+// memory-maps at startup. Run by the build; see archive.h for the layout.
+//
+//   pack_assets <output archive> <asset directory>
+
+#include "archive.h"
+#include "core.h"
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    log_fatal("Usage: {} <output archive> <asset directory>", argv[0]);
+  }
+
+  Path output_path = argv[1];
+  Path asset_directory = argv[2];
+
+  std::error_code directory_error;
+  auto iterator = std::filesystem::recursive_directory_iterator(asset_directory, directory_error);
+  if (directory_error) {
+    log_fatal("Could not open asset directory {}", asset_directory.string());
+  }
+
+  Vec<ArchiveInput> inputs = {};
+  usize total_size = 0;
+
+  for (auto& entry : iterator) {
+    if (!entry.is_regular_file()) continue;
+
+    auto file = read_file(entry.path());
+    if (file.isErr()) {
+      log_fatal("Could not read asset {}", entry.path().string());
+    }
+
+    ArchiveInput input;
+    input.name = entry.path().lexically_relative(asset_directory).generic_string();
+    input.contents = std::move(file).unwrap().contents;
+    total_size += input.contents.size();
+    inputs.push_back(std::move(input));
+  }
+
+  File archive;
+  archive.path = output_path;
+  pack_archive(inputs, &archive.contents);
+
+  if (write_file(archive).isErr()) {
+    log_fatal("Could not write archive {}", output_path.string());
+  }
+
+  log_info("Packed {} assets ({} bytes) into {} ({} bytes)", inputs.size(), total_size, output_path.string(), archive.contents.size());
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Clears every row of a full board_max_width x board_max_height board (10 x
+// 24) on each of four boards, every frame, so the particle pool stays full,
+// and reports how long spawning and updating take per frame.
+//
+//   particle_bench [frames]
+
+#include <chrono>
+#include <cstdlib>
+
+#include "particles.h"
+
+constexpr usize board_count = 4;
+constexpr f32 frame_time = 1.0f / 60.0f;
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [frames, at least 1]", argv[0]);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || value == 0 || value > UINT32_MAX) usage(argv);
+  return (u32) value;
+}
+
+int main(int argc, char* argv[]) {
+  auto frames = argument(argc, argv, 1, 10000);
+
+  auto game = make_game(board_max_width, board_max_height, 1);
+  for (i32 y = 0; y < board_max_height; ++y) {
+    for (i32 x = 0; x < board_max_width; ++x) {
+      LockedIn locked;
+      locked.coordinate = make_vector2(x, y);
+      locked.colour = make_colour(0.2f, 0.1f, 0.3f, 1.0f);
+      locked.is_clearing = true;
+      game.locked_in.push_back(locked);
+    }
+  }
+  game.events.clearing_rows = (1u << board_max_height) - 1;
+
+  auto particles = std::make_unique<Particles>();
+  f64 spawn_seconds = 0.0;
+  f64 update_seconds = 0.0;
+  f64 slowest_update = 0.0;
+  u64 total_particles = 0;
+
+  for (u32 frame = 0; frame < frames; ++frame) {
+    auto started = std::chrono::steady_clock::now();
+    for (usize i = 0; i < board_count; ++i) {
+      particles_spawn_for_events(*particles, game, make_vector2((f32) (i * board_max_width), 0.0f));
+    }
+    auto spawned = std::chrono::steady_clock::now();
+    particles_update(*particles, frame_time);
+    auto updated = std::chrono::steady_clock::now();
+
+    spawn_seconds += std::chrono::duration<f64>(spawned - started).count();
+    auto took = std::chrono::duration<f64>(updated - spawned).count();
+    update_seconds += took;
+    slowest_update = std::max(slowest_update, took);
+    total_particles += particles->count;
+  }
+
+  log("{} frames, {:.0f} particles live on average of {}", frames, (f64) total_particles / frames, particle_capacity);
+  log("Spawning {:.2f} us per frame, updating {:.2f} us per frame on average and {:.2f} us at worst, {:.2f} ns per particle",
+      spawn_seconds * 1e6 / frames, update_seconds * 1e6 / frames, slowest_update * 1e6, update_seconds * 1e9 / (f64) total_particles);
+
+  return 0;
+}
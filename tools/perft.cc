@@ -0,0 +1,527 @@
+// Counts every distinct sequence of placements reachable from a board with a
+// given run of pieces, down to a given depth, the way chess engines count
+// move sequences to check their move generators. A placement is a resting
+// spot the game's moves (left, right, rotate with wall kicks, down) can
+// steer a piece into from its spawn, told apart by the cells it covers. Full rows
+// are cleared before the next piece; a placement that leaves a cell in the
+// top row ends the game, so it counts at its own depth but has no children.
+//
+// Every depth is counted by a bitboard generator, once plainly to measure
+// placements per second and once through a transposition table, and up to
+// `reference depth` by a slow generator written directly against
+// tetromino_fits, rotate_tetromino and board_drop_distance, comparing the
+// placements of every position it visits with the bitboard's. Any
+// disagreement is reported and the exit status is 1, so the counts double as
+// a regression check for the movement rules. From an empty 10 x 20 board
+// with pieces 0123456 they are 17, 578, 20351, 372343 and 7050324.
+//
+// The board file, if given, has one line per row from the top, '#' for an
+// occupied cell and '.' for an empty one. Pieces repeat when the depth is
+// longer than the run.
+//
+//   perft [depth] [pieces, kinds 0-6] [reference depth] [board file]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <set>
+#include <tuple>
+
+#include "game.h"
+#include "hash_table.h"
+
+constexpr u32 perft_orientations = tetromino_rotations;
+
+// The way the game's rotate key turns.
+constexpr auto perft_direction = RotationDirection::counter_clockwise;
+
+// Bit x of a row is column x.
+struct PerftBoard {
+  i32 width = 0;
+  i32 height = 0;
+  u16 rows[board_max_height] = {};
+};
+
+// One orientation of a piece as row masks, from the top left of its bounding
+// box.
+struct PerftShape {
+  Coordinate offset = {}; // Of the bounding box from the piece's origin.
+  i32 width = 0;
+  i32 height = 0;
+  u16 rows[tetromino_max_pieces] = {};
+
+  u32 same_as = 0; // First orientation covering the same cells, for symmetric pieces.
+};
+
+struct PerftPiece {
+  PerftShape shapes[perft_orientations] = {};
+  TetrominoKicks kicks[perft_orientations] = {}; // Turning from each orientation.
+};
+
+// Where the top left of the bounding box comes to rest.
+struct PerftPlacement {
+  u8 shape = 0;
+  u8 left = 0;
+  u8 top = 0;
+};
+
+constexpr usize perft_max_placements = perft_orientations * board_max_width * board_max_height;
+using PerftPlacements = FixedVec<PerftPlacement, perft_max_placements>;
+
+struct PerftStats {
+  u64 placements = 0; // Generated, over every position visited.
+  f64 seconds = 0.0;
+};
+
+struct PerftKey {
+  u16 rows[board_max_height] = {};
+  u32 depth = 0;
+
+  bool operator==(const PerftKey&) const = default;
+};
+
+struct PerftKeyHash {
+  usize operator()(const PerftKey& key) const {
+    u64 hash = 0xCBF29CE484222325ull ^ key.depth;
+    for (auto row : key.rows) hash = (hash ^ row) * 0x100000001B3ull;
+    return (usize) (hash ^ hash >> 29);
+  }
+};
+
+using PerftTable = HashTable<PerftKey, u64, PerftKeyHash>;
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [depth, at least 1] [pieces, kinds 0-{}] [reference depth] [board file]", argv[0], tetromino_kinds - 1);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback, u32 min) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || value < min || value > UINT32_MAX) usage(argv);
+  return (u32) value;
+}
+
+static f64 seconds_since(std::chrono::steady_clock::time_point started) {
+  return std::chrono::duration<f64>(std::chrono::steady_clock::now() - started).count();
+}
+
+// Orientation r is the piece's rotation r, with its offset from the rotation box.
+static PerftPiece make_perft_piece(u32 kind) {
+  PerftPiece piece;
+
+  for (u32 r = 0; r < perft_orientations; ++r) {
+    auto& shape = piece.shapes[r];
+    auto pieces = tetromino_pieces(kind, r);
+    piece.kicks[r] = tetromino_kicks(kind, r, perft_direction);
+
+    auto min = pieces[0];
+    auto max = pieces[0];
+    for (auto cell : pieces) {
+      min = make_vector2(std::min(min.x, cell.x), std::min(min.y, cell.y));
+      max = make_vector2(std::max(max.x, cell.x), std::max(max.y, cell.y));
+    }
+
+    shape.offset = min;
+    shape.width = max.x - min.x + 1;
+    shape.height = max.y - min.y + 1;
+    for (auto cell : pieces) shape.rows[cell.y - min.y] |= (u16) (1u << (cell.x - min.x));
+
+    shape.same_as = r;
+    for (u32 other = 0; other < r; ++other) {
+      auto& earlier = piece.shapes[other];
+      if (earlier.width == shape.width && earlier.height == shape.height && std::equal(earlier.rows, earlier.rows + tetromino_max_pieces, shape.rows)) {
+        shape.same_as = other;
+        break;
+      }
+    }
+  }
+
+  return piece;
+}
+
+// Bit `left` is set where the shape fits with its box's top left at (left, top).
+static u16 fit_mask(const PerftBoard& board, const PerftShape& shape, i32 top) {
+  if (top < 0 || top + shape.height > board.height || shape.width > board.width) return 0;
+
+  u32 collides = 0;
+  for (i32 i = 0; i < shape.height; ++i) {
+    for (i32 x = 0; x < shape.width; ++x) {
+      if (shape.rows[i] & (1u << x)) collides |= (u32) board.rows[top + i] >> x;
+    }
+  }
+  return (u16) (~collides & ((1u << (board.width - shape.width + 1)) - 1));
+}
+
+static u16 shift_mask(u16 mask, i32 by) {
+  return (u16) (by >= 0 ? (u32) mask << by : (u32) mask >> -by);
+}
+
+// Flood fills the states the piece can reach, a whole row of positions at a
+// time: `reach[r][top]` has bit `left` set where orientation r can get its
+// box to (left, top). Moving sideways spreads a row within its fit mask,
+// moving down copies it to the next row and turning shifts it by each kick
+// plus the change in box offset. Rows are swept top to bottom, again while a turn has added
+// positions to a row already swept. A reached position the piece can't move
+// down from is a placement.
+static void generate_placements(const PerftBoard& board, const PerftPiece& piece, PerftPlacements* placements) {
+  placements->clear();
+
+  u16 fits[perft_orientations][board_max_height + 1] = {};
+  u16 reach[perft_orientations][board_max_height] = {};
+  for (u32 r = 0; r < perft_orientations; ++r) {
+    for (i32 top = 0; top < board.height; ++top) fits[r][top] = fit_mask(board, piece.shapes[r], top);
+  }
+
+  auto spawn = tetromino_spawn + piece.shapes[0].offset;
+  if (spawn.y < 0 || spawn.x < 0) return;
+  reach[0][spawn.y] = fits[0][spawn.y] & (u16) (1u << spawn.x);
+
+  auto is_sweeping = true;
+  while (is_sweeping) {
+    is_sweeping = false;
+    for (i32 top = 0; top < board.height; ++top) {
+      for (u32 r = 0; r < perft_orientations; ++r) {
+        auto row = reach[r][top];
+        if (!row) continue;
+
+        auto fit = fits[r][top];
+        while (true) {
+          auto spread = (u16) (row | (((u32) row << 1 | row >> 1) & fit));
+          if (spread == row) break;
+          row = spread;
+        }
+        reach[r][top] = row;
+
+        if (top + 1 < board.height) reach[r][top + 1] |= row & fits[r][top + 1];
+
+        // Each position takes the first kick that fits, so later kicks only
+        // see the positions still turning.
+        auto turned = tetromino_turned(r, perft_direction);
+        auto turning = row;
+        for (auto kick : piece.kicks[r]) {
+          auto delta = kick + piece.shapes[turned].offset - piece.shapes[r].offset;
+          auto turned_top = top + delta.y;
+          if (turned_top < 0 || turned_top >= board.height) continue;
+
+          auto landed = (u16) (shift_mask(turning, delta.x) & fits[turned][turned_top]);
+          turning &= (u16) ~shift_mask(landed, -delta.x);
+
+          auto added = (u16) (landed & ~reach[turned][turned_top]);
+          reach[turned][turned_top] |= added;
+          if (added && (turned_top < top || (turned_top == top && turned < r))) is_sweeping = true;
+          if (!turning) break;
+        }
+      }
+    }
+  }
+
+  u16 placed[perft_orientations][board_max_height] = {};
+  for (u32 r = 0; r < perft_orientations; ++r) {
+    auto same_as = piece.shapes[r].same_as;
+    for (i32 top = 0; top < board.height; ++top) {
+      auto resting = (u16) (reach[r][top] & ~fits[r][top + 1] & ~placed[same_as][top]);
+      placed[same_as][top] |= resting;
+      for (; resting; resting &= (u16) (resting - 1)) {
+        placements->push_back({(u8) same_as, (u8) __builtin_ctz(resting), (u8) top});
+      }
+    }
+  }
+}
+
+// Returns false if the placement tops out.
+static bool place(PerftBoard* board, const PerftPiece& piece, PerftPlacement placement) {
+  auto& shape = piece.shapes[placement.shape];
+  for (i32 i = 0; i < shape.height; ++i) board->rows[placement.top + i] |= (u16) (shape.rows[i] << placement.left);
+  if (board->rows[0] != 0) return false;
+
+  auto full = (u16) ((1u << board->width) - 1);
+  auto to = board->height - 1;
+  for (auto from = board->height - 1; from >= 0; --from) {
+    if (board->rows[from] != full) board->rows[to--] = board->rows[from];
+  }
+  while (to >= 0) board->rows[to--] = 0;
+  return true;
+}
+
+static u64 perft(const PerftBoard& board, const Vec<PerftPiece>& pieces, u32 index, u32 depth, PerftStats* stats, PerftTable* table) {
+  if (depth == 0) return 1;
+
+  PerftKey key;
+  if (table) {
+    std::copy(board.rows, board.rows + board_max_height, key.rows);
+    key.depth = depth;
+    if (auto count = table->find(key)) return *count;
+  }
+
+  auto& piece = pieces[index % pieces.size()];
+  PerftPlacements placements;
+  generate_placements(board, piece, &placements);
+  stats->placements += placements.size();
+
+  u64 count = placements.size();
+  if (depth > 1) {
+    count = 0;
+    for (auto placement : placements) {
+      auto child = board;
+      if (place(&child, piece, placement)) count += perft(child, pieces, index + 1, depth - 1, stats, table);
+    }
+  }
+
+  if (table) table->insert(key, count);
+  return count;
+}
+
+// Reference
+
+// Placements as the sorted board indices of the cells they cover.
+using ReferencePlacements = std::set<Vec<i32>>;
+
+struct ReferenceStats {
+  u64 placements = 0;
+  u64 positions = 0;
+  u64 mismatched_positions = 0; // Where the bitboard found different placements.
+  u64 wrong_drop_distances = 0; // Where board_drop_distance disagreed with stepping down.
+  f64 seconds = 0.0;
+};
+
+static ReferencePlacements reference_placements(Board& board, u32 kind, ReferenceStats* stats) {
+  ReferencePlacements placements;
+
+  Tetromino spawn;
+  spawn.coordinate = tetromino_spawn;
+  spawn.kind = (u8) kind;
+  spawn.pieces = tetromino_pieces(kind, 0);
+  if (!tetromino_fits(spawn, make_vector2(0, 0), board)) return placements;
+
+  std::set<std::tuple<i32, i32, u32>> visited;
+  std::deque<Tetromino> queue;
+
+  auto visit = [&](const Tetromino& tetromino) {
+    if (visited.insert({tetromino.coordinate.x, tetromino.coordinate.y, tetromino.rotation}).second) queue.push_back(tetromino);
+  };
+  visit(spawn);
+
+  while (!queue.empty()) {
+    auto tetromino = queue.front();
+    queue.pop_front();
+
+    for (auto dx : {-1, 1}) {
+      if (tetromino_fits(tetromino, make_vector2(dx, 0), board)) {
+        auto moved = tetromino;
+        moved.coordinate.x += dx;
+        visit(moved);
+      }
+    }
+
+    auto turned = tetromino;
+    if (rotate_tetromino(turned, board, perft_direction)) visit(turned);
+
+    i32 distance = 0;
+    while (tetromino_fits(tetromino, make_vector2(0, distance + 1), board)) distance += 1;
+    if (tetromino_drop_distance(tetromino, board) != distance) stats->wrong_drop_distances += 1;
+
+    if (distance > 0) {
+      auto moved = tetromino;
+      moved.coordinate.y += 1;
+      visit(moved);
+      continue;
+    }
+
+    Vec<i32> cells;
+    for (auto piece : tetromino.pieces) {
+      auto cell = tetromino.coordinate + piece;
+      cells.push_back(cell.y * board.width + cell.x);
+    }
+    std::sort(cells.begin(), cells.end());
+    placements.insert(cells);
+  }
+
+  return placements;
+}
+
+// Locks the cells in and clears full rows the slow way. Returns false if the
+// placement tops out, by check_lines' rule.
+static bool reference_place(Board* board, const Vec<i32>& cells) {
+  auto is_topped_out = false;
+  for (auto index : cells) {
+    auto cell = make_vector2(index % board->width, index / board->width);
+    board_add(*board, cell);
+    if (cell.y == 0) is_topped_out = true;
+  }
+  if (is_topped_out) return false;
+
+  auto cleared = make_board(board->width, board->height);
+  auto to = board->height - 1;
+  for (auto from = board->height - 1; from >= 0; --from) {
+    if (board_is_row_full(*board, from)) continue;
+    for (i32 x = 0; x < board->width; ++x) {
+      if (board_is_occupied(*board, make_vector2(x, from))) board_add(cleared, make_vector2(x, to));
+    }
+    to -= 1;
+  }
+  *board = cleared;
+  return true;
+}
+
+static PerftBoard to_perft_board(const Board& board) {
+  PerftBoard perft_board;
+  perft_board.width = board.width;
+  perft_board.height = board.height;
+  for (i32 y = 0; y < board.height; ++y) {
+    for (i32 x = 0; x < board.width; ++x) {
+      if (board_is_occupied(board, make_vector2(x, y))) perft_board.rows[y] |= (u16) (1u << x);
+    }
+  }
+  return perft_board;
+}
+
+static void log_board(const Board& board) {
+  for (i32 y = 0; y < board.height; ++y) {
+    String row;
+    for (i32 x = 0; x < board.width; ++x) row += board_is_occupied(board, make_vector2(x, y)) ? '#' : '.';
+    log("  {}", row);
+  }
+}
+
+static void check_placements(const Board& board, const PerftPiece& piece, u32 kind, const ReferencePlacements& expected, ReferenceStats* stats) {
+  PerftPlacements placements;
+  generate_placements(to_perft_board(board), piece, &placements);
+
+  ReferencePlacements found;
+  for (auto placement : placements) {
+    auto& shape = piece.shapes[placement.shape];
+    Vec<i32> cells;
+    for (i32 i = 0; i < shape.height; ++i) {
+      for (i32 x = 0; x < shape.width; ++x) {
+        if (shape.rows[i] & (1u << x)) cells.push_back((placement.top + i) * board.width + placement.left + x);
+      }
+    }
+    found.insert(cells);
+  }
+  if (found == expected && placements.size() == found.size()) return;
+
+  stats->mismatched_positions += 1;
+  if (stats->mismatched_positions > 3) return;
+  log_error("Piece {}: the bitboard found {} placements ({} distinct) where the reference found {}, on", kind, placements.size(), found.size(),
+            expected.size());
+  log_board(board);
+}
+
+static u64 reference_perft(const Board& board, const Vec<u32>& kinds, const Vec<PerftPiece>& pieces, u32 index, u32 depth, ReferenceStats* stats) {
+  if (depth == 0) return 1;
+
+  auto kind = kinds[index % kinds.size()];
+  auto scratch = board;
+  auto placements = reference_placements(scratch, kind, stats);
+  stats->placements += placements.size();
+  stats->positions += 1;
+  check_placements(board, pieces[index % pieces.size()], kind, placements, stats);
+
+  if (depth == 1) return placements.size();
+
+  u64 count = 0;
+  for (auto& cells : placements) {
+    auto child = board;
+    if (reference_place(&child, cells)) count += reference_perft(child, kinds, pieces, index + 1, depth - 1, stats);
+  }
+  return count;
+}
+
+static Board read_board(const char* path) {
+  auto read = read_file(path);
+  if (read.isErr()) log_fatal("Could not read board {}", path);
+  auto contents = std::move(read).unwrap().contents;
+
+  Vec<String> rows;
+  usize start = 0;
+  while (start < contents.size()) {
+    auto end = std::min(contents.find('\n', start), contents.size());
+    auto row = contents.substr(start, end - start);
+    if (!row.empty() && row.back() == '\r') row.pop_back();
+    if (!row.empty()) rows.push_back(row);
+    start = end + 1;
+  }
+
+  if (rows.empty() || rows[0].size() > (usize) board_max_width || rows.size() > (usize) board_max_height) {
+    log_fatal("Board {} must be 1 to {} rows of 1 to {} cells", path, board_max_height, board_max_width);
+  }
+
+  auto board = make_board((i32) rows[0].size(), (i32) rows.size());
+  for (i32 y = 0; y < board.height; ++y) {
+    auto& row = rows[(usize) y];
+    if (row.size() != rows[0].size()) log_fatal("Row {} of board {} is {} cells, not {}", y, path, row.size(), rows[0].size());
+    for (i32 x = 0; x < board.width; ++x) {
+      auto cell = row[(usize) x];
+      if (cell != '#' && cell != '.') log_fatal("Board {} has '{}' at ({}, {}), not '#' or '.'", path, cell, x, y);
+      if (cell == '#') board_add(board, make_vector2(x, y));
+    }
+  }
+  return board;
+}
+
+int main(int argc, char* argv[]) {
+  auto depth = argument(argc, argv, 1, 4, 1);
+  const char* sequence = argc > 2 ? argv[2] : "0123456";
+  auto reference_depth = argument(argc, argv, 3, std::min(depth, 3u), 0);
+  auto board = argc > 4 ? read_board(argv[4]) : make_board(10, 20);
+
+  Vec<u32> kinds;
+  for (auto c = sequence; *c; ++c) {
+    if (*c < '0' || (u32) (*c - '0') >= tetromino_kinds) log_fatal("Pieces must be kinds 0 to {}, not '{}'", tetromino_kinds - 1, *c);
+    kinds.push_back((u32) (*c - '0'));
+  }
+  if (kinds.empty()) usage(argv);
+
+  Vec<PerftPiece> pieces;
+  for (auto kind : kinds) pieces.push_back(make_perft_piece(kind));
+
+  if (board.width < tetromino_spawn.x + 4) {
+    log_fatal("Pieces spawn across columns {} to {}, so the board must be at least {} wide", tetromino_spawn.x, tetromino_spawn.x + 3, tetromino_spawn.x + 4);
+  }
+
+  auto start = to_perft_board(board);
+  auto is_ok = true;
+  log("{} x {} board, pieces {}", board.width, board.height, sequence);
+
+  for (u32 d = 1; d <= depth; ++d) {
+    PerftStats plain;
+    auto started = std::chrono::steady_clock::now();
+    auto count = perft(start, pieces, 0, d, &plain, nullptr);
+    plain.seconds = seconds_since(started);
+
+    PerftStats tabled;
+    PerftTable table;
+    started = std::chrono::steady_clock::now();
+    auto tabled_count = perft(start, pieces, 0, d, &tabled, &table);
+    tabled.seconds = seconds_since(started);
+
+    log("perft({}) = {}: {} placements in {:.3f} s, {:.1f} M/s; with a table of {} positions {:.3f} s", d, count, plain.placements, plain.seconds,
+        (f64) plain.placements / std::max(plain.seconds, 1e-9) / 1e6, table.size(), tabled.seconds);
+
+    if (tabled_count != count) {
+      log_error("perft({}) through the table is {}, not {}", d, tabled_count, count);
+      is_ok = false;
+    }
+
+    if (d > reference_depth) continue;
+
+    ReferenceStats reference;
+    started = std::chrono::steady_clock::now();
+    auto reference_count = reference_perft(board, kinds, pieces, 0, d, &reference);
+    reference.seconds = seconds_since(started);
+
+    log("  reference: {} over {} positions in {:.3f} s, {:.3f} M placements/s", reference_count, reference.positions, reference.seconds,
+        (f64) reference.placements / std::max(reference.seconds, 1e-9) / 1e6);
+
+    if (reference_count != count || reference.mismatched_positions != 0 || reference.wrong_drop_distances != 0) {
+      log_error("The reference counts {} ({} positions with different placements, {} wrong drop distances)", reference_count,
+                reference.mismatched_positions, reference.wrong_drop_distances);
+      is_ok = false;
+    }
+  }
+
+  return is_ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// Compares Pool and MemoryPoolResource with std::allocator: allocating a batch
+// of objects and freeing it, churning a full pool by freeing and replacing
+// random objects, and a linked list on each. Prints ns per operation, and
+// fails if the two sides of a comparison didn't compute the same sum.
+//
+//   pool_bench [objects] [rounds]
+
+#include <chrono>
+#include <cstdlib>
+#include <list>
+#include <memory_resource>
+
+#include "core.h"
+
+struct BenchObject {
+  u64 id = 0;
+  u64 payload[5] = {};
+};
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [objects, at least 1] [rounds, at least 1]", argv[0]);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || value == 0 || value > UINT32_MAX) usage(argv);
+  return (u32) value;
+}
+
+struct BenchTiming {
+  f64 seconds = 0.0;
+  u64 checksum = 0;
+};
+
+template <typename F>
+static BenchTiming timed(F run) {
+  BenchTiming timing;
+  auto started = std::chrono::steady_clock::now();
+  timing.checksum = run();
+  timing.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - started).count();
+  return timing;
+}
+
+static void report(const char* name, u64 operations, BenchTiming pool, BenchTiming standard) {
+  log("{:<8} pool {:6.2f} ns/op, std::allocator {:6.2f} ns/op, {:.2f}x", name, pool.seconds * 1e9 / (f64) operations,
+      standard.seconds * 1e9 / (f64) operations, standard.seconds / pool.seconds);
+  if (pool.checksum != standard.checksum) log_fatal("{}: checksums differ, {} against {}", name, pool.checksum, standard.checksum);
+}
+
+int main(int argc, char* argv[]) {
+  auto count = argument(argc, argv, 1, 100000);
+  auto rounds = argument(argc, argv, 2, 20);
+
+  Vec<BenchObject*> objects(count);
+  std::allocator<BenchObject> allocator;
+
+  // Allocate everything, then free everything.
+  auto pool = make_pool<BenchObject>(count);
+  auto batch_pool = timed([&] {
+    u64 sum = 0;
+    for (u32 round = 0; round < rounds; ++round) {
+      for (u32 i = 0; i < count; ++i) objects[i] = pool_create(&pool, (u64) i);
+      for (auto object : objects) sum += object->id;
+      for (auto object : objects) pool_destroy(&pool, object);
+    }
+    return sum;
+  });
+  auto batch_standard = timed([&] {
+    u64 sum = 0;
+    for (u32 round = 0; round < rounds; ++round) {
+      for (u32 i = 0; i < count; ++i) {
+        objects[i] = allocator.allocate(1);
+        new (objects[i]) BenchObject{(u64) i};
+      }
+      for (auto object : objects) sum += object->id;
+      for (auto object : objects) allocator.deallocate(object, 1);
+    }
+    return sum;
+  });
+  report("batch", (u64) count * rounds * 2, batch_pool, batch_standard);
+
+  // A full set of objects where random ones are freed and replaced, so the
+  // free list comes out of address order, as it does in a long-running game.
+  auto churn = [&](auto create, auto destroy) {
+    u64 random_state = 7;
+    u64 sum = 0;
+    for (u32 i = 0; i < count; ++i) objects[i] = create((u64) i);
+    for (u64 step = 0; step < (u64) count * rounds; ++step) {
+      auto& object = objects[random_next(&random_state) % count];
+      sum += object->id;
+      destroy(object);
+      object = create(step);
+    }
+    for (auto object : objects) destroy(object);
+    return sum;
+  };
+  auto churn_pool = timed([&] {
+    return churn([&](u64 id) { return pool_create(&pool, id); }, [&](BenchObject* object) { pool_destroy(&pool, object); });
+  });
+  auto churn_standard = timed([&] {
+    return churn(
+      [&](u64 id) {
+        auto object = allocator.allocate(1);
+        new (object) BenchObject{id};
+        return object;
+      },
+      [&](BenchObject* object) { allocator.deallocate(object, 1); });
+  });
+  report("churn", (u64) count * rounds * 2, churn_pool, churn_standard);
+
+  // A node-based container, on MemoryPoolResource and on the default allocator.
+  auto fill_list = [&](auto& list) {
+    u64 sum = 0;
+    for (u32 round = 0; round < rounds; ++round) {
+      for (u32 i = 0; i < count; ++i) list.push_back(i);
+      for (auto it = list.begin(); it != list.end();) {
+        sum += *it;
+        it = list.erase(it);
+        if (it != list.end()) ++it;
+      }
+      list.clear();
+    }
+    return sum;
+  };
+  // A list node is two pointers and the value.
+  constexpr usize node_size = 2 * sizeof(void*) + sizeof(u64);
+  auto node_memory_size = (usize) count * node_size + alignof(void*) - 1;
+  auto node_pool_memory = std::make_unique<u8[]>(node_memory_size);
+  auto node_pool = make_memory_pool(node_pool_memory.get(), node_memory_size, node_size, alignof(void*));
+  MemoryPoolResource resource(&node_pool);
+  auto list_pool = timed([&] {
+    std::pmr::list<u64> list(&resource);
+    return fill_list(list);
+  });
+  auto list_standard = timed([&] {
+    std::list<u64> list;
+    return fill_list(list);
+  });
+  report("list", (u64) count * rounds * 2, list_pool, list_standard);
+
+  return 0;
+}
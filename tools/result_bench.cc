@@ -0,0 +1,178 @@
+// Checks at compile time that a Result of trivial types stays trivial and
+// small enough to come back in registers, then times an out-of-line function
+// that fails now and then, reporting failure as a Result, as a return code
+// with an out parameter, as a std::optional and as an exception. Prints ns
+// and instructions per call, call and loop included, and the size of each
+// function's code, and fails if the four didn't compute the same sum.
+// Instructions are counted with perf_event_open and left out where the
+// kernel or machine has no counter for them.
+//
+//   result_bench [calls] [failures per 1000 calls]
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+
+#include "core.h"
+
+enum class BenchError : i32 { none, negative };
+
+static_assert(std::is_trivially_copyable_v<Result<i32, BenchError>>);
+static_assert(std::is_trivially_destructible_v<Result<void, BenchError>>);
+static_assert(sizeof(Result<i32, BenchError>) == 2 * sizeof(i32));
+static_assert(sizeof(Result<i32, BenchError>) == sizeof(std::optional<i32>));
+static_assert(Result<i32, BenchError>(Ok(2)).map([](i32 x) { return x * 2; }).unwrap() == 4);
+static_assert(Result<i32, BenchError>(Err(BenchError::negative)).unwrapOr(7) == 7);
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [calls, at least 1] [failures per 1000 calls, at most 1000]", argv[0]);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback, u32 min, u32 max) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || value < min || value > max) usage(argv);
+  return (u32) value;
+}
+
+// The same work four ways. noinline, or the compiler sees through all of
+// them and the comparison is of nothing. Each gets a section of its own, so
+// the linker's __start_ and __stop_ symbols for it bound its code.
+#define BENCH_FUNCTION(name) __attribute__((noinline, section("result_bench_" #name)))
+
+extern "C" const u8 __start_result_bench_result[], __stop_result_bench_result[];
+extern "C" const u8 __start_result_bench_code[], __stop_result_bench_code[];
+extern "C" const u8 __start_result_bench_optional[], __stop_result_bench_optional[];
+extern "C" const u8 __start_result_bench_exception[], __stop_result_bench_exception[];
+
+BENCH_FUNCTION(result) static Result<i32, BenchError> halve_result(i32 value) {
+  if (value < 0) return Err(BenchError::negative);
+  return Ok(value / 2);
+}
+
+BENCH_FUNCTION(code) static BenchError halve_code(i32 value, i32* out) {
+  if (value < 0) return BenchError::negative;
+  *out = value / 2;
+  return BenchError::none;
+}
+
+BENCH_FUNCTION(optional) static std::optional<i32> halve_optional(i32 value) {
+  if (value < 0) return std::nullopt;
+  return value / 2;
+}
+
+struct BenchException {
+  BenchError error;
+};
+
+BENCH_FUNCTION(exception) static i32 halve_throwing(i32 value) {
+  if (value < 0) throw BenchException{BenchError::negative};
+  return value / 2;
+}
+
+// User-space instructions retired by this thread, or -1 if they can't be counted.
+static int open_instruction_counter() {
+  perf_event_attr attributes = {};
+  attributes.type = PERF_TYPE_HARDWARE;
+  attributes.size = sizeof(attributes);
+  attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attributes.disabled = 1;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+struct BenchTiming {
+  f64 seconds = 0.0;
+  u64 instructions = 0;
+  u64 checksum = 0;
+};
+
+template <typename F>
+static BenchTiming timed(int counter, F run) {
+  BenchTiming timing;
+  if (counter >= 0) {
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  auto started = std::chrono::steady_clock::now();
+  timing.checksum = run();
+  timing.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - started).count();
+  if (counter >= 0) {
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(counter, &timing.instructions, sizeof(timing.instructions)) != sizeof(timing.instructions)) timing.instructions = 0;
+  }
+  return timing;
+}
+
+int main(int argc, char* argv[]) {
+  auto calls = argument(argc, argv, 1, 10000000, 1, UINT32_MAX);
+  auto failures = argument(argc, argv, 2, 10, 0, 1000);
+
+  u64 random_state = 3;
+  Vec<i32> values(calls);
+  for (auto& value : values) {
+    auto fails = random_next(&random_state) % 1000 < failures;
+    value = (i32) (random_next(&random_state) % 1000) * (fails ? -1 : 1) - fails;
+  }
+
+  auto counter = open_instruction_counter();
+  defer(if (counter >= 0) close(counter));
+
+  // Failures count 1 each, so a path that drops one shows in the sum.
+  auto result = timed(counter, [&] {
+    u64 sum = 0;
+    for (auto value : values) {
+      auto halved = halve_result(value);
+      sum += halved.isOk() ? (u64) std::move(halved).unwrap() : 1;
+    }
+    return sum;
+  });
+  auto code = timed(counter, [&] {
+    u64 sum = 0;
+    for (auto value : values) {
+      i32 halved = 0;
+      sum += halve_code(value, &halved) == BenchError::none ? (u64) halved : 1;
+    }
+    return sum;
+  });
+  auto optional = timed(counter, [&] {
+    u64 sum = 0;
+    for (auto value : values) {
+      auto halved = halve_optional(value);
+      sum += halved ? (u64) *halved : 1;
+    }
+    return sum;
+  });
+  auto exception = timed(counter, [&] {
+    u64 sum = 0;
+    for (auto value : values) {
+      try {
+        sum += (u64) halve_throwing(value);
+      } catch (const BenchException&) {
+        sum += 1;
+      }
+    }
+    return sum;
+  });
+
+  log("{} calls, {} failures per 1000{}:", calls, failures, counter >= 0 ? "" : ", no instruction counter");
+  auto line = [&](const char* name, BenchTiming timing, const u8* code_start, const u8* code_end) {
+    auto instructions = counter >= 0 ? fmt::format(", {:5.2f} instructions/call", (f64) timing.instructions / (f64) calls) : String();
+    log("  {:<12} {:6.2f} ns/call{}, {:3} bytes of code", name, timing.seconds * 1e9 / (f64) calls, instructions, code_end - code_start);
+    if (timing.checksum != result.checksum) log_fatal("{}: checksum {}, against {} for Result", name, timing.checksum, result.checksum);
+  };
+  line("Result", result, __start_result_bench_result, __stop_result_bench_result);
+  line("return code", code, __start_result_bench_code, __stop_result_bench_code);
+  line("optional", optional, __start_result_bench_optional, __stop_result_bench_optional);
+  line("exception", exception, __start_result_bench_exception, __stop_result_bench_exception);
+
+  return 0;
+}
@@ -0,0 +1,207 @@
+// Plays a two player versus match with rollback between two processes on this
+// machine, in real time, over loopback UDP behind a simulated link with the
+// given latency, jitter and loss. Each process is one bot: it guesses the
+// other's inputs, rolls back when they turn out different, and records a
+// checksum of every tick once it is verified. The second process sends its
+// checksums back over a pipe and the first compares them; any difference is
+// a desync.
+//
+//   rollback_sim [ticks] [latency ms] [jitter ms] [loss %] [rollback ticks] [input delay] [base port]
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "rollback.h"
+
+struct Bot {
+  OwnPtr<RollbackSession> session = {};
+  u64 random_state = 0;
+
+  Vec<u64> checksums = {}; // After each verified tick.
+  u64 advance_ns = 0;      // Time spent in rollback_advance, including resimulation.
+  u64 slowest_advance_ns = 0;
+};
+
+// Mostly idle, sometimes moving or rotating, now and then dropping.
+static u8 bot_input(Bot* bot) {
+  auto random = random_next(&bot->random_state);
+  switch (random % 24) {
+  case 0: return 1 << (u8) InputAction::move_left;
+  case 1: return 1 << (u8) InputAction::move_right;
+  case 2: return 1 << (u8) InputAction::rotate;
+  case 3: return 1 << (u8) InputAction::hard_drop;
+  case 4: return 1 << (u8) InputAction::soft_drop;
+  default: return 0;
+  }
+}
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [ticks, at least 1] [latency ms] [jitter ms] [loss % 0-100] [rollback ticks 0-{}] [input delay 0-{}] [base port]",
+            argv[0], rollback_max_ticks, lockstep_max_input_delay);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback, u32 min, u32 max) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || argv[index][0] == '-' || value < min || value > max) usage(argv);
+  return (u32) value;
+}
+
+static u64 elapsed_ns(std::chrono::steady_clock::time_point since) {
+  return (u64) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Runs one side of the match until `tick_count` ticks are verified, then
+// keeps answering the other side for a while so it can finish too.
+static void play(Bot* bot, const LockstepConfig& config, u32 tick_count, u32 rollback_ticks) {
+  constexpr u64 seed = 1;
+  constexpr u32 linger_ms = 1000;
+
+  auto transport = lockstep_start(config, seed + config.local_player);
+  if (transport.isErr()) {
+    auto error = transport.unwrapErr();
+    if (error.error_kind == NetError::Kind::invalid_config) log_fatal("Lockstep can't run with this configuration");
+    log_fatal("Could not open UDP port {}", error.port);
+  }
+
+  auto versus = make_versus(config.player_count, 8, 16, seed);
+  bot->session = std::make_unique<RollbackSession>();
+  auto& session = *bot->session;
+  rollback_start(session, std::move(transport).unwrap(), versus, rollback_ticks);
+  bot->random_state = 1000 + config.local_player;
+
+  auto started = std::chrono::steady_clock::now();
+  auto now_ms = [&] { return (u32) (elapsed_ns(started) / 1000000); };
+
+  u32 next_tick_at = config.local_player * 7;
+  u32 done_at = 0;
+  while (done_at == 0 || now_ms() - done_at < linger_ms) {
+    auto now = now_ms();
+    lockstep_poll(&session.transport, now);
+
+    while ((i32) (now - next_tick_at) >= 0) {
+      if (lockstep_needs_local_input(session.transport)) {
+        lockstep_add_local_input(&session.transport, bot_input(bot));
+        lockstep_poll(&session.transport, now);
+      }
+
+      auto advance_started = std::chrono::steady_clock::now();
+      auto advanced = rollback_advance(session);
+      auto advance_ns = elapsed_ns(advance_started);
+      bot->advance_ns += advance_ns;
+      bot->slowest_advance_ns = std::max(bot->slowest_advance_ns, advance_ns);
+
+      while (bot->checksums.size() < std::min(session.verified_until, tick_count)) {
+        auto& state = rollback_state_at(session, (u32) bot->checksums.size() + 1);
+        bot->checksums.push_back(versus_checksum(state));
+      }
+
+      if (!advanced) break;
+      next_tick_at += versus_tick_ms;
+    }
+
+    if (done_at == 0 && bot->checksums.size() == tick_count) done_at = std::max(now, 1u);
+    if (now > tick_count * versus_tick_ms * 4 + 10000) {
+      log_fatal("Player {} stuck at {} ms: tick {}, verified {} of {}", config.local_player, now, session.transport.tick,
+                session.verified_until, tick_count);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  auto& stats = session.stats;
+  auto& net_stats = session.transport.socket.stats;
+  auto ticks = std::max(session.transport.tick, 1u);
+  log("player {}: {} rollbacks, {} ticks resimulated (deepest {}), {} stalls, {:.1f} bytes per tick, "
+      "advance {:.1f} us average and {:.1f} us at worst",
+      config.local_player, stats.rollbacks, stats.resimulated_ticks, stats.deepest, stats.stalled,
+      (f64) net_stats.bytes_sent / ticks, (f64) bot->advance_ns / ticks / 1000.0, (f64) bot->slowest_advance_ns / 1000.0);
+}
+
+int main(int argc, char* argv[]) {
+  LockstepConfig config;
+  auto tick_count = argument(argc, argv, 1, 600, 1, UINT32_MAX);
+  config.conditions.latency = argument(argc, argv, 2, 30, 0, UINT32_MAX);
+  config.conditions.jitter = argument(argc, argv, 3, 10, 0, UINT32_MAX);
+  config.conditions.loss = (f32) argument(argc, argv, 4, 5, 0, 100) / 100.0f;
+  auto rollback_ticks = argument(argc, argv, 5, rollback_max_ticks, 0, rollback_max_ticks);
+  config.input_delay = argument(argc, argv, 6, 1, 0, lockstep_max_input_delay);
+  config.base_port = (u16) argument(argc, argv, 7, lockstep_default_port, 1, UINT16_MAX);
+
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0) log_fatal("Could not create a pipe");
+
+  auto child = fork();
+  if (child < 0) log_fatal("Could not fork");
+
+  Bot bot;
+  if (child == 0) {
+    close(pipe_fds[0]);
+    config.local_player = 1;
+    play(&bot, config, tick_count, rollback_ticks);
+
+    auto bytes = (const char*) bot.checksums.data();
+    auto remaining = bot.checksums.size() * sizeof(u64);
+    while (remaining > 0) {
+      auto written = write(pipe_fds[1], bytes, remaining);
+      if (written <= 0) return 1;
+      bytes += written;
+      remaining -= (usize) written;
+    }
+    return 0;
+  }
+
+  close(pipe_fds[1]);
+  config.local_player = 0;
+  play(&bot, config, tick_count, rollback_ticks);
+
+  Vec<u64> other(tick_count);
+  auto bytes = (char*) other.data();
+  auto remaining = other.size() * sizeof(u64);
+  while (remaining > 0) {
+    auto got = read(pipe_fds[0], bytes, remaining);
+    if (got <= 0) break;
+    bytes += got;
+    remaining -= (usize) got;
+  }
+
+  int status = 0;
+  waitpid(child, &status, 0);
+  if (remaining > 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    log_error("Player 1 did not finish");
+    return 1;
+  }
+
+  // What keeping a tick costs: a copy of the match as it ended.
+  auto& final_state = bot.session->versus;
+  auto copy = std::make_unique<Versus>();
+  constexpr u32 copies = 100000;
+  auto copy_started = std::chrono::steady_clock::now();
+  for (u32 i = 0; i < copies; ++i) {
+    copy_versus(*copy, final_state);
+    asm volatile("" : : "r"(copy.get()) : "memory");
+  }
+  auto copy_ns = (f64) elapsed_ns(copy_started) / copies;
+
+  log("{} ticks ({:.1f} s of play), {} ticks of rollback, {} tick input delay", tick_count,
+      (f64) (tick_count * versus_tick_ms) / 1000.0, rollback_ticks, config.input_delay);
+  log("link: {} ms latency, {} ms jitter, {:.0f}% loss", config.conditions.latency, config.conditions.jitter,
+      config.conditions.loss * 100.0f);
+  log("saving a tick: {:.0f} ns for {} bytes of state", copy_ns, sizeof(Versus));
+
+  for (u32 tick = 0; tick < tick_count; ++tick) {
+    if (bot.checksums[tick] != other[tick]) {
+      log_error("Desync at tick {}", tick);
+      return 1;
+    }
+  }
+
+  log("in sync on every tick");
+  return 0;
+}
@@ -0,0 +1,465 @@
+// Differential and property checks of the game rules in game.cc. Plays random
+// input sequences on random boards through the game's own functions, and
+// through a plain model of the rules written out below: pieces spawn with
+// their box at (3, 0), turn counter-clockwise within the box and take the
+// first Super Rotation System kick that fits, lock where they can't fall,
+// score one per cell locked and per row dropped, clear full rows for
+// width * 10 * n each, and a locked cell in the top row ends the game.
+//
+// After every input the game's animations are run to the end, so the model
+// can clear rows at once, and the two are compared: piece, score, state and
+// every cell. The game's own state is also checked for consistency: board
+// counts against the locked in cells, the column height cache against the
+// cells, and board_drop_distance against stepping the piece down.
+//
+// A failing case is shrunk, inputs first and then board cells, to the
+// smallest one that still fails, and printed. Exits with status 1 if any
+// case failed.
+//
+//   rules_fuzz [cases] [seed] [max inputs per case]
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "game.h"
+
+// One input per character.
+constexpr char fuzz_left = 'L';
+constexpr char fuzz_right = 'R';
+constexpr char fuzz_rotate = 'U';
+constexpr char fuzz_gravity = 'D'; // A gravity step, as when the piece's frame time runs out.
+constexpr char fuzz_hard_drop = 'H';
+
+// Enough animation steps to finish any clear and the drops after it.
+constexpr u32 fuzz_max_settle_steps = 4 * board_max_height + 16;
+
+struct FuzzCase {
+  i32 width = 10;
+  i32 height = 20;
+  u64 seed = 0;
+  Vec<Coordinate> cells = {}; // Occupied at the start.
+  String inputs = "";
+};
+
+struct FuzzResult {
+  bool is_failed = false;
+  usize input = 0; // Index of the input after which it failed.
+  String message = "";
+
+  u32 pieces_locked = 0;
+  u32 lines_cleared = 0;
+};
+
+struct Model {
+  i32 width = 0;
+  i32 height = 0;
+  Vec<u8> cells = {};
+
+  Coordinate origin = {};
+  TetrominoPieces pieces = {};
+  u32 kind = 0;
+  u32 rotation = 0;
+
+  u32 score = 0;
+  bool is_over = false;
+  u64 random_state = 0;
+};
+
+// Counter-clockwise turns from rotations 0, R, 2 and L, y up as the Super
+// Rotation System tables are published. Kind 0 is the I piece.
+constexpr i32 model_kicks[2][4][5][2] = {
+    {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}},
+     {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}},
+     {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}},
+     {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}},
+    {{{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}},
+     {{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}},
+     {{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}},
+     {{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}},
+};
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [cases, at least 1] [seed] [max inputs per case, at least 1]", argv[0]);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback, u32 min) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || value < min || value > UINT32_MAX) usage(argv);
+  return (u32) value;
+}
+
+// Model
+
+static bool model_is_occupied(const Model& model, Coordinate cell) {
+  return model.cells[(usize) (cell.y * model.width + cell.x)] != 0;
+}
+
+static bool model_fits(const Model& model, Coordinate origin, const TetrominoPieces& pieces) {
+  for (auto piece : pieces) {
+    auto cell = origin + piece;
+    if (cell.x < 0 || cell.x >= model.width || cell.y < 0 || cell.y >= model.height) return false;
+    if (model_is_occupied(model, cell)) return false;
+  }
+  return true;
+}
+
+static void model_spawn(Model* model) {
+  auto kind = (u32) (random_next(&model->random_state) >> 32) % tetromino_kinds;
+  model->origin = make_vector2(3, 0);
+  model->pieces = tetromino_pieces(kind, 0);
+  model->kind = kind;
+  model->rotation = 0;
+}
+
+static void model_clear_rows(Model* model) {
+  auto is_full = [&](i32 y) {
+    for (i32 x = 0; x < model->width; ++x) {
+      if (!model_is_occupied(*model, make_vector2(x, y))) return false;
+    }
+    return true;
+  };
+
+  // Scored bottom up, the nth row found scoring n times as much.
+  u32 cleared = 0;
+  for (i32 y = model->height - 1; y >= 0; --y) {
+    if (!is_full(y)) continue;
+    cleared += 1;
+    model->score += (u32) model->width * 10 * cleared;
+  }
+
+  for (i32 x = 0; x < model->width; ++x) {
+    if (model_is_occupied(*model, make_vector2(x, 0))) model->is_over = true;
+  }
+
+  auto to = model->height - 1;
+  for (auto from = model->height - 1; from >= 0; --from) {
+    if (is_full(from)) continue;
+    if (to != from) {
+      for (i32 x = 0; x < model->width; ++x) model->cells[(usize) (to * model->width + x)] = model->cells[(usize) (from * model->width + x)];
+    }
+    to -= 1;
+  }
+  for (; to >= 0; --to) {
+    for (i32 x = 0; x < model->width; ++x) model->cells[(usize) (to * model->width + x)] = 0;
+  }
+}
+
+static void model_lock(Model* model) {
+  for (auto piece : model->pieces) {
+    auto cell = model->origin + piece;
+    model->cells[(usize) (cell.y * model->width + cell.x)] = 1;
+    model->score += 1;
+  }
+  model_spawn(model);
+}
+
+static void model_input(Model* model, char input) {
+  if (model->is_over) return;
+
+  switch (input) {
+  case fuzz_left:
+  case fuzz_right: {
+    auto moved = model->origin + make_vector2(input == fuzz_left ? -1 : 1, 0);
+    if (model_fits(*model, moved, model->pieces)) model->origin = moved;
+  } break;
+
+  case fuzz_rotate: {
+    auto is_i = model->kind == 0;
+    auto box_size = is_i ? 4 : 3;
+    auto turned = model->pieces;
+    for (auto& piece : turned) piece = make_vector2(piece.y, box_size - 1 - piece.x);
+
+    for (auto& kick : model_kicks[is_i][model->rotation]) {
+      auto origin = model->origin + make_vector2(kick[0], -kick[1]);
+      if (model_fits(*model, origin, turned)) {
+        model->origin = origin;
+        model->pieces = turned;
+        model->rotation = (model->rotation + 3) % 4;
+        break;
+      }
+    }
+  } break;
+
+  case fuzz_gravity: {
+    auto below = model->origin + make_vector2(0, 1);
+    if (model_fits(*model, below, model->pieces)) {
+      model->origin = below;
+      model->score += 1;
+    } else {
+      model_lock(model);
+    }
+    model_clear_rows(model);
+  } break;
+
+  case fuzz_hard_drop: {
+    while (model_fits(*model, model->origin + make_vector2(0, 1), model->pieces)) {
+      model->origin.y += 1;
+      model->score += 1;
+    }
+    model_lock(model);
+    model_clear_rows(model);
+  } break;
+  }
+}
+
+// Game
+
+static Game make_fuzz_game(const FuzzCase& fuzz) {
+  auto game = make_game(fuzz.width, fuzz.height, fuzz.seed);
+  for (auto cell : fuzz.cells) {
+    LockedIn locked;
+    locked.coordinate = cell;
+    game.locked_in.push_back(locked);
+    board_add(game.board, cell);
+  }
+  return game;
+}
+
+// Returns false if the animations never finish.
+static bool settle(Game* game) {
+  for (u32 i = 0; i < fuzz_max_settle_steps; ++i) {
+    auto is_animating = std::any_of(game->locked_in.begin(), game->locked_in.end(),
+                                    [](const LockedIn& locked) { return locked.is_clearing || locked.is_dropping; });
+    if (!is_animating) return true;
+    update_animations(*game, drop_animation_time);
+  }
+  return false;
+}
+
+static void game_input(Game* game, char input, u32* now) {
+  InputCommand command;
+  command.is_pressed = true;
+
+  switch (input) {
+  case fuzz_left: command.action = InputAction::move_left; break;
+  case fuzz_right: command.action = InputAction::move_right; break;
+  case fuzz_rotate: command.action = InputAction::rotate; break;
+  case fuzz_hard_drop: command.action = InputAction::hard_drop; break;
+  case fuzz_gravity: {
+    *now += (u32) (game->frame_time * 1000.0f) + 1;
+    try_to_move_tetromino(*game, *now);
+    return;
+  }
+  }
+
+  command.timestamp = *now;
+  apply_input_command(*game, command);
+}
+
+// Checks
+
+static String describe_cells(const Game& game, const Model& model) {
+  String out;
+  for (i32 y = 0; y < model.height; ++y) {
+    out += "\n  ";
+    for (i32 x = 0; x < model.width; ++x) out += board_is_occupied(game.board, make_vector2(x, y)) ? '#' : '.';
+    out += "  ";
+    for (i32 x = 0; x < model.width; ++x) out += model_is_occupied(model, make_vector2(x, y)) ? '#' : '.';
+  }
+  return out;
+}
+
+static String check_game(Game* game, const Model& model) {
+  auto& board = game->board;
+  auto& tetromino = game->tetromino;
+
+  if ((game->state != GameState::playing) != model.is_over) {
+    return fmt::format("the game is {}over, the model {}", game->state == GameState::playing ? "not " : "", model.is_over ? "is" : "isn't");
+  }
+  if (game->score != model.score) return fmt::format("the score is {}, the model's {}", game->score, model.score);
+  if (tetromino.coordinate != model.origin) {
+    return fmt::format("the piece is at ({}, {}), the model's at ({}, {})", tetromino.coordinate.x, tetromino.coordinate.y, model.origin.x, model.origin.y);
+  }
+  if (!std::equal(tetromino.pieces.begin(), tetromino.pieces.end(), model.pieces.begin(), model.pieces.end())) {
+    return "the piece has a different shape or orientation from the model's";
+  }
+
+  for (i32 y = 0; y < board.height; ++y) {
+    for (i32 x = 0; x < board.width; ++x) {
+      auto cell = make_vector2(x, y);
+      if (board_is_occupied(board, cell) != model_is_occupied(model, cell)) {
+        return fmt::format("cell ({}, {}) differs, game on the left and model on the right:{}", x, y, describe_cells(*game, model));
+      }
+
+      auto locked = std::count_if(game->locked_in.begin(), game->locked_in.end(), [&](const LockedIn& locked) { return locked.coordinate == cell; });
+      if (locked != board.cells[y * board.width + x]) {
+        return fmt::format("cell ({}, {}) counts {} on the board but {} locked in", x, y, board.cells[y * board.width + x], locked);
+      }
+    }
+  }
+
+  for (i32 x = 0; x < board.width; ++x) {
+    i32 y = 0;
+    while (y < board.height && !board_is_occupied(board, make_vector2(x, y))) y += 1;
+    if (board.column_heights[x] != board.height - y) {
+      return fmt::format("column {} is cached {} high, but is {}", x, board.column_heights[x], board.height - y);
+    }
+  }
+
+  if (tetromino_fits(tetromino, make_vector2(0, 0), board)) {
+    i32 distance = 0;
+    while (tetromino_fits(tetromino, make_vector2(0, distance + 1), board)) distance += 1;
+    auto cached = tetromino_drop_distance(tetromino, board);
+    if (cached != distance) return fmt::format("the drop distance is {}, but the piece can fall {}", cached, distance);
+  }
+
+  return "";
+}
+
+static FuzzResult run_case(const FuzzCase& fuzz) {
+  auto game = make_fuzz_game(fuzz);
+
+  Model model;
+  model.width = fuzz.width;
+  model.height = fuzz.height;
+  model.cells.resize((usize) (fuzz.width * fuzz.height));
+  for (auto cell : fuzz.cells) model.cells[(usize) (cell.y * fuzz.width + cell.x)] = 1;
+  model.random_state = fuzz.seed;
+  model_spawn(&model);
+
+  FuzzResult result;
+  u32 now = 0;
+  for (usize i = 0; i <= fuzz.inputs.size(); ++i) {
+    // Checked before the first input too, to catch a bad start.
+    if (i > 0) {
+      game_input(&game, fuzz.inputs[i - 1], &now);
+      model_input(&model, fuzz.inputs[i - 1]);
+      if (!settle(&game)) {
+        result.is_failed = true;
+        result.input = i;
+        result.message = "the animations never finished";
+        break;
+      }
+    }
+
+    auto message = check_game(&game, model);
+    if (!message.empty()) {
+      result.is_failed = true;
+      result.input = i;
+      result.message = message;
+      break;
+    }
+    if (model.is_over) break;
+  }
+
+  result.pieces_locked = game.events.pieces_locked;
+  result.lines_cleared = game.events.lines_cleared;
+  return result;
+}
+
+// Generating and shrinking
+
+static FuzzCase random_case(u64* random_state, u32 max_inputs) {
+  FuzzCase fuzz;
+  fuzz.width = 7 + (i32) (random_next(random_state) % (u64) (board_max_width - 6));
+  fuzz.height = 6 + (i32) (random_next(random_state) % (u64) (board_max_height - 5));
+  fuzz.seed = random_next(random_state);
+
+  // Rubble in up to the bottom half, no row full. Dense enough that lines
+  // get cleared, often several at once.
+  auto rows = (i32) (random_next(random_state) % (u64) (fuzz.height / 2 + 1));
+  auto density = 40 + random_next(random_state) % 61;
+  for (auto y = fuzz.height - rows; y < fuzz.height; ++y) {
+    auto hole = (i32) (random_next(random_state) % (u64) fuzz.width);
+    for (i32 x = 0; x < fuzz.width; ++x) {
+      if (x != hole && random_next(random_state) % 100 < density) fuzz.cells.push_back(make_vector2(x, y));
+    }
+  }
+
+  // Runs of single inputs, mixed with whole placements: a few turns and
+  // moves to one side, then a hard drop.
+  auto count = 1 + random_next(random_state) % max_inputs;
+  while (fuzz.inputs.size() < count) {
+    if (random_next(random_state) % 2) {
+      fuzz.inputs.append(random_next(random_state) % 4, fuzz_rotate);
+      fuzz.inputs.append(random_next(random_state) % (u64) fuzz.width, random_next(random_state) % 2 ? fuzz_left : fuzz_right);
+      fuzz.inputs += fuzz_hard_drop;
+      continue;
+    }
+
+    for (auto i = random_next(random_state) % 16; i > 0; --i) {
+      auto roll = random_next(random_state) % 100;
+      fuzz.inputs += roll < 20 ? fuzz_left : roll < 40 ? fuzz_right : roll < 60 ? fuzz_rotate : roll < 95 ? fuzz_gravity : fuzz_hard_drop;
+    }
+  }
+  fuzz.inputs.resize(count);
+  return fuzz;
+}
+
+// Greedy: drops chunks of inputs, halving the chunk size down to single
+// inputs, then single board cells, keeping every removal that still fails.
+static FuzzCase shrink(FuzzCase fuzz, FuzzResult failure) {
+  fuzz.inputs.resize(failure.input);
+
+  for (auto chunk = std::max(fuzz.inputs.size() / 2, (usize) 1); chunk > 0; chunk /= 2) {
+    for (usize start = 0; start < fuzz.inputs.size();) {
+      auto smaller = fuzz;
+      smaller.inputs.erase(start, chunk);
+      auto result = run_case(smaller);
+      if (result.is_failed) {
+        fuzz = smaller;
+        fuzz.inputs.resize(result.input);
+      } else {
+        start += chunk;
+      }
+    }
+  }
+
+  for (usize i = 0; i < fuzz.cells.size();) {
+    auto smaller = fuzz;
+    smaller.cells.erase(smaller.cells.begin() + (i64) i);
+    if (run_case(smaller).is_failed) {
+      fuzz = smaller;
+    } else {
+      i += 1;
+    }
+  }
+
+  return fuzz;
+}
+
+static void log_case(const FuzzCase& fuzz) {
+  log("  {} x {} board, seed {}, inputs \"{}\", starting from:", fuzz.width, fuzz.height, fuzz.seed, fuzz.inputs);
+  for (i32 y = 0; y < fuzz.height; ++y) {
+    String row(fuzz.width, '.');
+    for (auto cell : fuzz.cells) {
+      if (cell.y == y) row[(usize) cell.x] = '#';
+    }
+    log("  {}", row);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  auto case_count = argument(argc, argv, 1, 2000, 1);
+  u64 random_state = argument(argc, argv, 2, 1, 0);
+  auto max_inputs = argument(argc, argv, 3, 400, 1);
+
+  u32 failed = 0;
+  u64 inputs = 0;
+  u64 pieces_locked = 0;
+  u64 lines_cleared = 0;
+  for (u32 i = 0; i < case_count; ++i) {
+    auto fuzz = random_case(&random_state, max_inputs);
+    inputs += fuzz.inputs.size();
+
+    auto result = run_case(fuzz);
+    pieces_locked += result.pieces_locked;
+    lines_cleared += result.lines_cleared;
+    if (!result.is_failed) continue;
+
+    failed += 1;
+    if (failed > 3) continue; // Shrinking is slow, and the first few are usually the same bug.
+
+    auto smallest = shrink(fuzz, result);
+    auto shrunk = run_case(smallest);
+    log_error("Case {} failed after input {} of {}: {}", i, result.input, fuzz.inputs.size(), result.message);
+    log("Shrunk to {} inputs and {} cells, failing after input {}: {}", smallest.inputs.size(), smallest.cells.size(), shrunk.input, shrunk.message);
+    log_case(smallest);
+  }
+
+  log("{} of {} cases failed; {} inputs played, {} pieces locked, {} lines cleared", failed, case_count, inputs, pieces_locked, lines_cleared);
+  return failed == 0 ? 0 : 1;
+}
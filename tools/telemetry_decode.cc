@@ -0,0 +1,234 @@
+// Decodes telemetry files written by the game and summarises each session:
+// frame time distribution, update cost, pieces per second, line clears and
+// score. Rotated files of the same session are merged; see telemetry.h for
+// the layout.
+//
+//   telemetry_decode <telemetry file>...
+
+#include <algorithm>
+#include <cstring>
+
+#include "core.h"
+#include "telemetry.h"
+
+struct SessionSummary {
+  u64 started_at = 0;
+  u32 file_count = 0;
+  u32 first_time = UINT32_MAX; // ms since the session started
+  u32 last_time = 0;
+
+  u64 frame_count = 0;
+  u64 total_frame_us = 0;
+  u32 max_frame_us = 0;
+  u64 total_update_us = 0;
+  u32 max_update_us = 0;
+  u64 frame_buckets[telemetry_histogram_buckets] = {};
+
+  u64 pieces_locked = 0;
+  u64 line_clears = 0;
+  u64 lines_cleared = 0;
+  u32 lines_by_count[5] = {}; // Clears of 1 to 4 lines at once; index 0 is unused.
+  u32 game_overs = 0;
+  u32 final_score = 0;
+  u32 best_score = 0;
+
+  u64 unknown_records = 0;
+};
+
+template <typename T>
+static bool read_at(const String& contents, usize offset, T* out) {
+  if (offset > contents.size() || contents.size() - offset < sizeof(T)) return false;
+  std::memcpy(out, contents.data() + offset, sizeof(T));
+  return true;
+}
+
+// Files can be given in any order, so the final score is whichever was
+// recorded last rather than read last.
+static void add_time(SessionSummary* session, u32 begin, u32 end, u32 score) {
+  session->first_time = std::min(session->first_time, begin);
+  if (end >= session->last_time) {
+    session->last_time = end;
+    session->final_score = score;
+  }
+  session->best_score = std::max(session->best_score, score);
+}
+
+static void add_summary(SessionSummary* session, const TelemetryFrameSummary& summary) {
+  session->frame_count += summary.frame_count;
+  session->total_frame_us += summary.total_frame_us;
+  session->total_update_us += summary.total_update_us;
+  session->max_frame_us = std::max(session->max_frame_us, summary.max_frame_us);
+  session->max_update_us = std::max(session->max_update_us, summary.max_update_us);
+  for (u32 i = 0; i < telemetry_histogram_buckets; ++i) {
+    session->frame_buckets[i] += summary.frame_buckets[i];
+  }
+  add_time(session, summary.header.time, summary.header.time + summary.interval, summary.score);
+}
+
+static void add_event(SessionSummary* session, const TelemetryEvent& event) {
+  switch (event.header.kind) {
+  case TelemetryRecordKind::piece_locked: {
+    session->pieces_locked += event.value;
+  } break;
+
+  case TelemetryRecordKind::lines_cleared: {
+    session->line_clears += 1;
+    session->lines_cleared += event.value;
+    session->lines_by_count[std::min(event.value, 4u)] += 1;
+  } break;
+
+  case TelemetryRecordKind::game_over: {
+    session->game_overs += 1;
+  } break;
+
+  case TelemetryRecordKind::frame_summary: break;
+  }
+
+  add_time(session, event.header.time, event.header.time, event.score);
+}
+
+static void decode_record(SessionSummary* session, const String& pending, usize offset, const TelemetryRecordHeader& record) {
+  if (record.kind == TelemetryRecordKind::frame_summary && record.size == sizeof(TelemetryFrameSummary)) {
+    TelemetryFrameSummary summary;
+    read_at(pending, offset, &summary);
+    add_summary(session, summary);
+  } else if (record.kind <= TelemetryRecordKind::game_over && record.size == sizeof(TelemetryEvent)) {
+    TelemetryEvent event;
+    read_at(pending, offset, &event);
+    add_event(session, event);
+  } else {
+    session->unknown_records += 1;
+  }
+}
+
+// Streams the file in chunks, so memory use doesn't grow with file size.
+static bool decode_file(const Path& path, Table<u64, SessionSummary>* sessions) {
+  auto opened = open_file_reader(path);
+  if (opened.isErr()) {
+    log_error("Could not open {}", path.string());
+    return false;
+  }
+  auto reader = std::move(opened).unwrap();
+  defer(close_file_reader(&reader));
+
+  // Records can straddle chunks, so whatever is left undecoded at the end of
+  // one chunk carries over to the next.
+  String pending = "";
+  u64 pending_offset = 0;
+  SessionSummary* session = nullptr;
+
+  while (true) {
+    StringView chunk;
+    if (read_file_chunk(&reader, &chunk).isErr()) {
+      log_error("Could not read {} past offset {}", path.string(), reader.offset);
+      return session != nullptr;
+    }
+    if (chunk.empty()) break;
+    pending.append(chunk);
+
+    usize used = 0;
+    if (!session) {
+      TelemetryFileHeader header;
+      if (!read_at(pending, 0, &header)) continue;
+
+      if (header.magic != telemetry_magic) {
+        log_error("{} is not a telemetry file", path.string());
+        return false;
+      }
+      if (header.version != telemetry_version) {
+        log_error("{} has unsupported version {}", path.string(), header.version);
+        return false;
+      }
+
+      session = &(*sessions)[header.session_started_at];
+      session->started_at = header.session_started_at;
+      session->file_count += 1;
+      used = sizeof(header);
+    }
+
+    TelemetryRecordHeader record;
+    while (read_at(pending, used, &record)) {
+      if (record.size < sizeof(TelemetryRecordHeader)) {
+        log_warning("{}: corrupt record at offset {}, skipping the rest of the file", path.string(), pending_offset + used);
+        return true;
+      }
+      if (pending.size() - used < record.size) break;
+
+      decode_record(session, pending, used, record);
+      used += record.size;
+    }
+
+    pending.erase(0, used);
+    pending_offset += used;
+  }
+
+  if (!session) {
+    log_error("{} is not a telemetry file", path.string());
+    return false;
+  }
+  if (!pending.empty()) {
+    log_warning("{}: {} trailing bytes, the file was probably cut short", path.string(), pending.size());
+  }
+
+  return true;
+}
+
+// Upper bound of the bucket the given fraction of frames fall into, or the
+// slowest frame if that is lower.
+static f64 frame_percentile_ms(const SessionSummary& session, f64 fraction) {
+  auto target = (u64) ((f64) session.frame_count * fraction);
+  u64 seen = 0;
+  for (u32 i = 0; i < telemetry_histogram_buckets; ++i) {
+    seen += session.frame_buckets[i];
+    if (seen > target) return (f64) std::min((u64) 2 << i, (u64) session.max_frame_us) / 1000.0;
+  }
+  return (f64) session.max_frame_us / 1000.0;
+}
+
+static void print_session(const SessionSummary& session) {
+  auto duration = session.last_time > session.first_time ? session.last_time - session.first_time : 0;
+  auto seconds = (f64) duration / 1000.0;
+  auto per_second = [&](u64 count) { return seconds > 0.0 ? (f64) count / seconds : 0.0; };
+  auto average_ms = [&](u64 total_us) { return session.frame_count ? (f64) total_us / (f64) session.frame_count / 1000.0 : 0.0; };
+
+  log("Session {} ({} file{}, {:.1f} s)", session.started_at, session.file_count, session.file_count == 1 ? "" : "s", seconds);
+  log("  frames        {} ({:.1f} fps)", session.frame_count, per_second(session.frame_count));
+  log("  frame time    avg {:.2f} ms, p50 <= {:.2f} ms, p90 <= {:.2f} ms, p99 <= {:.2f} ms, max {:.2f} ms",
+      average_ms(session.total_frame_us),
+      frame_percentile_ms(session, 0.50), frame_percentile_ms(session, 0.90), frame_percentile_ms(session, 0.99),
+      (f64) session.max_frame_us / 1000.0);
+  log("  update time   avg {:.3f} ms, max {:.3f} ms ({:.1f}% of frame time)",
+      average_ms(session.total_update_us), (f64) session.max_update_us / 1000.0,
+      session.total_frame_us ? 100.0 * (f64) session.total_update_us / (f64) session.total_frame_us : 0.0);
+  log("  pieces        {} ({:.2f} per second)", session.pieces_locked, per_second(session.pieces_locked));
+  log("  lines         {} in {} clears (singles {}, doubles {}, triples {}, tetrises {})",
+      session.lines_cleared, session.line_clears,
+      session.lines_by_count[1], session.lines_by_count[2], session.lines_by_count[3], session.lines_by_count[4]);
+  log("  score         final {}, best {}, {} game over{}",
+      session.final_score, session.best_score, session.game_overs, session.game_overs == 1 ? "" : "s");
+
+  if (session.unknown_records) {
+    log("  skipped {} records of unknown kinds", session.unknown_records);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    log_fatal("Usage: {} <telemetry file>...", argv[0]);
+  }
+
+  Table<u64, SessionSummary> sessions = {};
+  for (int i = 1; i < argc; ++i) {
+    decode_file(argv[i], &sessions);
+  }
+
+  if (sessions.empty()) {
+    log_fatal("No telemetry to summarise");
+  }
+
+  for (auto& [started_at, session] : sessions) {
+    print_session(session);
+  }
+
+  return 0;
+}
@@ -0,0 +1,152 @@
+// Plays a versus match between bots in one process to check the lockstep
+// protocol. Every bot runs its own copy of the match with its own lockstep
+// session on a loopback UDP port, behind a simulated link with the given
+// latency, jitter and loss. At the end the copies are compared tick by tick;
+// any difference is a desync. Also reports what the protocol cost on the wire.
+//
+// Time is simulated in 1 ms steps, so a long match runs in moments.
+//
+//   versus_sim [players] [ticks] [latency ms] [jitter ms] [loss %] [input delay] [base port]
+
+#include <cstdlib>
+
+#include "lockstep.h"
+#include "versus.h"
+
+struct Bot {
+  LockstepSession session = {};
+  Versus versus = {};
+  u64 random_state = 0;
+
+  u32 next_tick_at = 0; // ms
+  u32 stalled_ms = 0;
+  Vec<u64> checksums = {}; // After each tick.
+};
+
+// Mostly idle, sometimes moving or rotating, now and then dropping.
+static u8 bot_input(Bot* bot) {
+  auto random = random_next(&bot->random_state);
+  switch (random % 24) {
+  case 0: return 1 << (u8) InputAction::move_left;
+  case 1: return 1 << (u8) InputAction::move_right;
+  case 2: return 1 << (u8) InputAction::rotate;
+  case 3: return 1 << (u8) InputAction::hard_drop;
+  case 4: return 1 << (u8) InputAction::soft_drop;
+  default: return 0;
+  }
+}
+
+static void usage(char* argv[]) {
+  log_fatal("Usage: {} [players 2-{}] [ticks, at least 1] [latency ms] [jitter ms] [loss % 0-100] [input delay 0-{}] [base port]",
+            argv[0], lockstep_max_players, lockstep_max_input_delay);
+}
+
+static u32 argument(int argc, char* argv[], int index, u32 fallback, u32 min, u32 max) {
+  if (index >= argc) return fallback;
+
+  char* end = nullptr;
+  auto value = std::strtoul(argv[index], &end, 10);
+  if (end == argv[index] || *end != 0 || argv[index][0] == '-' || value < min || value > max) usage(argv);
+  return (u32) value;
+}
+
+int main(int argc, char* argv[]) {
+  LockstepConfig config;
+  config.player_count = argument(argc, argv, 1, 2, 2, lockstep_max_players);
+  auto tick_count = argument(argc, argv, 2, 3000, 1, UINT32_MAX);
+  config.conditions.latency = argument(argc, argv, 3, 30, 0, UINT32_MAX);
+  config.conditions.jitter = argument(argc, argv, 4, 10, 0, UINT32_MAX);
+  config.conditions.loss = (f32) argument(argc, argv, 5, 5, 0, 100) / 100.0f;
+  config.input_delay = argument(argc, argv, 6, 3, 0, lockstep_max_input_delay);
+  config.base_port = (u16) argument(argc, argv, 7, lockstep_default_port, 1, UINT16_MAX);
+
+  constexpr u64 seed = 1;
+  Vec<Bot> bots(config.player_count);
+  for (u32 player = 0; player < config.player_count; ++player) {
+    auto& bot = bots[player];
+    config.local_player = player;
+
+    auto session = lockstep_start(config, seed + player);
+    if (session.isErr()) {
+      auto error = session.unwrapErr();
+      if (error.error_kind == NetError::Kind::invalid_config) usage(argv);
+      log_fatal("Could not open UDP port {}", error.port);
+    }
+
+    bot.session = std::move(session).unwrap();
+    bot.versus = make_versus(config.player_count, 8, 16, seed);
+    bot.random_state = 1000 + player;
+
+    // Start the bots a little apart, as real players would.
+    bot.next_tick_at = player * 7;
+  }
+
+  u32 now = 0;
+  u8 inputs[lockstep_max_players] = {};
+  while (true) {
+    auto is_done = true;
+    for (auto& bot : bots) {
+      auto& session = bot.session;
+      lockstep_poll(&session, now);
+
+      while (session.tick < tick_count && (i32) (now - bot.next_tick_at) >= 0) {
+        if (lockstep_needs_local_input(session)) {
+          lockstep_add_local_input(&session, bot_input(&bot));
+          lockstep_poll(&session, now);
+        }
+
+        if (!lockstep_advance(&session, inputs)) {
+          bot.stalled_ms += 1;
+          break;
+        }
+
+        versus_step(bot.versus, inputs);
+        bot.checksums.push_back(versus_checksum(bot.versus));
+        bot.next_tick_at += versus_tick_ms;
+      }
+
+      if (session.tick < tick_count) is_done = false;
+    }
+
+    if (is_done) break;
+
+    now += 1;
+    if (now > tick_count * versus_tick_ms * 4 + 10000) {
+      log_fatal("Stuck at {} ms: tick {} of {}", now, bots[0].session.tick, tick_count);
+    }
+  }
+
+  auto desync_tick = tick_count;
+  for (u32 tick = 0; tick < tick_count && desync_tick == tick_count; ++tick) {
+    for (auto& bot : bots) {
+      if (bot.checksums[tick] != bots[0].checksums[tick]) desync_tick = tick;
+    }
+  }
+
+  log("{} players, {} ticks ({:.1f} s of play) in {:.1f} s simulated", config.player_count, tick_count,
+      (f64) (tick_count * versus_tick_ms) / 1000.0, (f64) now / 1000.0);
+  log("link: {} ms latency, {} ms jitter, {:.0f}% loss, {} tick input delay",
+      config.conditions.latency, config.conditions.jitter, config.conditions.loss * 100.0f, config.input_delay);
+
+  for (u32 player = 0; player < config.player_count; ++player) {
+    auto& bot = bots[player];
+    auto& stats = bot.session.socket.stats;
+    auto& game = bot.versus.players[player].game;
+    log("player {}: {:.1f} bytes and {:.2f} packets sent per tick, {} dropped, {} ms stalled, score {}, {}",
+        player, (f64) stats.bytes_sent / tick_count, (f64) stats.packets_sent / tick_count, stats.packets_dropped,
+        bot.stalled_ms, game.score, game.state == GameState::playing ? "still playing" : "topped out");
+  }
+
+  auto winner = versus_winner(bots[0].versus);
+  if (winner >= 0) log("winner: player {}", winner);
+
+  for (auto& bot : bots) lockstep_stop(&bot.session);
+
+  if (desync_tick != tick_count) {
+    log_error("Desync at tick {}", desync_tick);
+    return 1;
+  }
+
+  log("in sync on every tick");
+  return 0;
+}